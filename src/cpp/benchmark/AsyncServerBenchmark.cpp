@@ -0,0 +1,216 @@
+/*
+ * AsyncServerBenchmark.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "Benchmark.hpp"
+
+#include <unistd.h>
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/FilePath.hpp>
+#include <core/BoostThread.hpp>
+#include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
+#include <core/http/AsyncConnection.hpp>
+#include <core/http/TcpIpAsyncServer.hpp>
+#include <core/http/LocalStreamAsyncServer.hpp>
+#include <core/http/LocalStreamAsyncClient.hpp>
+
+using namespace core;
+using namespace core::http;
+
+namespace benchmark {
+
+namespace {
+
+// concurrent clients (browsers) and the requests each makes per measurement
+const int kClients = 32;
+const int kRequestsPerClient = 500;
+
+// threads handling requests in the stand-in session
+const std::size_t kSessionThreads = 4;
+
+// exposes the port the server is listening on (we bind to port 0)
+class BenchmarkServer : public TcpIpAsyncServer
+{
+public:
+   BenchmarkServer() : TcpIpAsyncServer("Benchmark") {}
+
+   unsigned short port()
+   {
+      return acceptorService().acceptor().local_endpoint().port();
+   }
+};
+
+// stand-in for an rpc handled by the session
+void handleSessionRequest(const Request& request, Response* pResponse)
+{
+   pResponse->setContentType("application/json");
+   pResponse->setBody("{\"result\":null}");
+}
+
+void handleSessionResponse(boost::shared_ptr<AsyncConnection> ptrConnection,
+                           const Response& response)
+{
+   ptrConnection->writeResponse(response);
+}
+
+void handleSessionError(boost::shared_ptr<AsyncConnection> ptrConnection,
+                        const Error& error)
+{
+   ptrConnection->response().setStatusCode(status::ServiceUnavailable);
+   ptrConnection->writeResponse();
+}
+
+// forward the request to the session (on the connection's io_service) as
+// the server's session proxy does
+void proxyToSession(const FilePath& streamPath,
+                    boost::shared_ptr<AsyncConnection> ptrConnection)
+{
+   boost::shared_ptr<LocalStreamAsyncClient> pClient(
+         new LocalStreamAsyncClient(ptrConnection->ioService(), streamPath));
+   pClient->request().assign(ptrConnection->request());
+   pClient->execute(boost::bind(handleSessionResponse, ptrConnection, _1),
+                    boost::bind(handleSessionError, ptrConnection, _1));
+}
+
+// make requests one after another (each on a new connection, since the
+// server closes connections after responding) recording their latency
+void runClient(unsigned short port, Samples* pLatencyMs, int* pFailures)
+{
+   using namespace boost::asio;
+   using namespace boost::posix_time;
+
+   const std::string request = "POST /rpc/get_state HTTP/1.1\r\n"
+                               "Host: localhost\r\n"
+                               "Content-Type: application/json\r\n"
+                               "Content-Length: 2\r\n"
+                               "\r\n"
+                               "{}";
+   ip::tcp::endpoint endpoint(ip::address_v4::loopback(), port);
+   io_service ioService;
+   for (int i = 0; i < kRequestsPerClient; i++)
+   {
+      ptime start = microsec_clock::universal_time();
+
+      boost::system::error_code ec;
+      ip::tcp::socket socket(ioService);
+      socket.connect(endpoint, ec);
+      if (!ec)
+         write(socket, buffer(request), ec);
+
+      std::string response;
+      char buff[4096];
+      while (!ec)
+      {
+         std::size_t bytes = socket.read_some(buffer(buff), ec);
+         response.append(buff, bytes);
+      }
+
+      pLatencyMs->add(elapsedSeconds(start) * 1000);
+      if (ec != error::eof || response.find(" 200 ") == std::string::npos)
+         (*pFailures)++;
+   }
+}
+
+} // anonymous namespace
+
+// load the server with concurrent clients whose requests are proxied to a
+// local stand-in session, reporting requests per second and the p99
+// latency as the thread pool grows (both with the threads sharing an
+// io_service and with an io_service per thread)
+void runAsyncServerBenchmark()
+{
+   using namespace boost::posix_time;
+
+   // start the stand-in session
+   FilePath streamPath("/tmp/rstudio-async-server-benchmark-" +
+                       boost::lexical_cast<std::string>(::getpid()));
+   LocalStreamAsyncServer session("Session");
+   session.setBlockingDefaultHandler(handleSessionRequest);
+   Error error = session.init(streamPath);
+   if (!error)
+      error = session.run(kSessionThreads);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   const std::size_t threads[] = { 1, 2, 4, 8 };
+   for (std::size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++)
+   {
+      for (int perThread = 0; perThread < 2; perThread++)
+      {
+         BenchmarkServer server;
+         server.setIoServicePerThread(perThread == 1);
+         server.setDefaultHandler(boost::bind(proxyToSession, streamPath, _1));
+         error = server.init("127.0.0.1", "0");
+         if (!error)
+            error = server.run(threads[i]);
+         if (error)
+         {
+            LOG_ERROR(error);
+            continue;
+         }
+
+         // run the clients
+         std::vector<Samples> latencies(kClients);
+         std::vector<int> failures(kClients, 0);
+         std::vector<boost::shared_ptr<boost::thread> > clients;
+         ptime start = microsec_clock::universal_time();
+         for (int j = 0; j < kClients; j++)
+         {
+            clients.push_back(boost::shared_ptr<boost::thread>(
+                  new boost::thread(boost::bind(runClient,
+                                                server.port(),
+                                                &latencies[j],
+                                                &failures[j]))));
+         }
+         for (int j = 0; j < kClients; j++)
+            clients[j]->join();
+         double seconds = elapsedSeconds(start);
+
+         server.stop();
+         server.waitUntilStopped();
+
+         Samples latencyMs;
+         std::size_t failed = 0;
+         for (int j = 0; j < kClients; j++)
+         {
+            latencyMs.add(latencies[j]);
+            failed += failures[j];
+         }
+
+         report("AsyncServer",
+                boost::format("%1% threads (%2%), %3$.0f requests/s, "
+                              "p99 %4$.2f ms")
+                   % threads[i]
+                   % (perThread ? "io_service per thread"
+                                : "shared io_service")
+                   % perSecond(latencyMs.size(), seconds)
+                   % latencyMs.percentile(99),
+                failed);
+      }
+   }
+
+   session.stop();
+   session.waitUntilStopped();
+}
+
+} // namespace benchmark
@@ -0,0 +1,91 @@
+/*
+ * Benchmark.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "Benchmark.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+
+namespace benchmark {
+
+double elapsedSeconds(const boost::posix_time::ptime& start)
+{
+   using namespace boost::posix_time;
+   return (microsec_clock::universal_time() - start).total_microseconds() /
+                                                                  1000000.0;
+}
+
+double megabytesPerSecond(std::size_t bytes, double seconds)
+{
+   return seconds > 0 ? (bytes / (1024.0 * 1024.0)) / seconds : 0;
+}
+
+double perSecond(std::size_t count, double seconds)
+{
+   return seconds > 0 ? count / seconds : 0;
+}
+
+void Samples::add(double value)
+{
+   values_.push_back(value);
+   sorted_ = false;
+}
+
+void Samples::add(const Samples& samples)
+{
+   values_.insert(values_.end(),
+                  samples.values_.begin(),
+                  samples.values_.end());
+   sorted_ = false;
+}
+
+double Samples::mean() const
+{
+   if (values_.empty())
+      return 0;
+   return std::accumulate(values_.begin(), values_.end(), 0.0) /
+                                                         values_.size();
+}
+
+double Samples::percentile(int percent) const
+{
+   if (values_.empty())
+      return 0;
+   sort();
+   std::size_t index = (values_.size() * percent) / 100;
+   return values_[std::min(index, values_.size() - 1)];
+}
+
+void Samples::sort() const
+{
+   if (!sorted_)
+   {
+      std::sort(values_.begin(), values_.end());
+      sorted_ = true;
+   }
+}
+
+void report(const std::string& name,
+            const boost::format& result,
+            std::size_t failures)
+{
+   std::cout << name << ": " << result;
+   if (failures > 0)
+      std::cout << " (" << failures << " FAILED)";
+   std::cout << std::endl;
+}
+
+} // namespace benchmark
@@ -0,0 +1,74 @@
+/*
+ * Benchmark.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef BENCHMARK_BENCHMARK_HPP
+#define BENCHMARK_BENCHMARK_HPP
+
+#include <string>
+#include <vector>
+
+#include <boost/format.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace benchmark {
+
+// benchmarks (each reports a line per measurement to std::cout)
+void runHashBenchmark();
+void runRequestParserBenchmark();
+void runTokenizerBenchmark();
+void runClientEventQueueBenchmark();
+#ifndef _WIN32
+void runChildProcessBenchmark();
+void runAsyncServerBenchmark();
+#endif
+
+// process about this many bytes for each throughput measurement
+const std::size_t kBytesPerMeasurement = 256 * 1024 * 1024;
+
+// seconds elapsed since start
+double elapsedSeconds(const boost::posix_time::ptime& start);
+
+// rates (0 if no time elapsed)
+double megabytesPerSecond(std::size_t bytes, double seconds);
+double perSecond(std::size_t count, double seconds);
+
+// a set of timings (e.g. the latencies of individual requests)
+class Samples
+{
+public:
+   Samples() : sorted_(true) {}
+
+   void add(double value);
+   void add(const Samples& samples);
+
+   std::size_t size() const { return values_.size(); }
+   double mean() const;
+   double percentile(int percent) const;
+
+private:
+   void sort() const;
+
+   mutable std::vector<double> values_;
+   mutable bool sorted_;
+};
+
+// write a measurement as "<name>: <result>", noting any failures
+void report(const std::string& name,
+            const boost::format& result,
+            std::size_t failures = 0);
+
+} // namespace benchmark
+
+#endif // BENCHMARK_BENCHMARK_HPP
@@ -0,0 +1,94 @@
+/*
+ * BenchmarkMain.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/system/System.hpp>
+
+#include "Benchmark.hpp"
+
+using namespace core;
+
+namespace {
+
+struct Benchmark
+{
+   const char* name;
+   void (*run)();
+};
+
+const Benchmark kBenchmarks[] =
+{
+   { "hash", benchmark::runHashBenchmark },
+   { "request-parser", benchmark::runRequestParserBenchmark },
+   { "tokenizer", benchmark::runTokenizerBenchmark },
+   { "client-event-queue", benchmark::runClientEventQueueBenchmark },
+#ifndef _WIN32
+   { "child-process", benchmark::runChildProcessBenchmark },
+   { "async-server", benchmark::runAsyncServerBenchmark },
+#endif
+};
+
+const std::size_t kBenchmarkCount = sizeof(kBenchmarks) /
+                                    sizeof(kBenchmarks[0]);
+
+} // anonymous namespace
+
+// run the benchmarks named on the command line (or all of them)
+int main(int argc, char** argv)
+{
+   core::system::initializeStderrLog("rstudio-benchmark",
+                                     core::system::kLogLevelWarning);
+
+   // ignore SIGPIPE
+   Error error = core::system::ignoreSignal(core::system::SigPipe);
+   if (error)
+      LOG_ERROR(error);
+
+   std::vector<std::string> names(argv + 1, argv + argc);
+   for (std::size_t i = 0; i < names.size(); i++)
+   {
+      bool found = false;
+      for (std::size_t j = 0; j < kBenchmarkCount; j++)
+         found = found || (names[i] == kBenchmarks[j].name);
+
+      if (!found)
+      {
+         std::cerr << "Unknown benchmark: " << names[i] << std::endl
+                   << "Available benchmarks:";
+         for (std::size_t j = 0; j < kBenchmarkCount; j++)
+            std::cerr << " " << kBenchmarks[j].name;
+         std::cerr << std::endl;
+         return EXIT_FAILURE;
+      }
+   }
+
+   for (std::size_t i = 0; i < kBenchmarkCount; i++)
+   {
+      if (names.empty() ||
+          std::find(names.begin(), names.end(), kBenchmarks[i].name) !=
+                                                                names.end())
+      {
+         kBenchmarks[i].run();
+      }
+   }
+
+   return EXIT_SUCCESS;
+}
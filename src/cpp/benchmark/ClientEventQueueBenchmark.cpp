@@ -0,0 +1,177 @@
+/*
+ * ClientEventQueueBenchmark.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "Benchmark.hpp"
+
+#include <boost/bind.hpp>
+
+#include <core/BoostThread.hpp>
+#include <core/Thread.hpp>
+
+#include <session/SessionClientEvent.hpp>
+
+#include "SessionClientEventQueue.hpp"
+
+using namespace core;
+using namespace session;
+
+namespace benchmark {
+
+namespace {
+
+const int kEvents = 500000;
+
+// takes events from the queue the way the event service thread does
+// (wait, then remove everything available) until stopped
+class EventConsumer
+{
+public:
+   explicit EventConsumer(ClientEventQueue* pQueue)
+      : pQueue_(pQueue), stopped_(false), eventsRemoved_(0)
+   {
+   }
+
+   void run()
+   {
+      std::vector<ClientEvent> events;
+      while (!stopped())
+      {
+         pQueue_->waitForEvent(boost::posix_time::milliseconds(50));
+         pQueue_->remove(&events);
+         addRemoved(events.size());
+         events.clear();
+      }
+
+      // take whatever is left
+      pQueue_->remove(&events);
+      addRemoved(events.size());
+   }
+
+   void stop()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         stopped_ = true;
+      }
+      END_LOCK_MUTEX
+   }
+
+   std::size_t eventsRemoved()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         return eventsRemoved_;
+      }
+      END_LOCK_MUTEX
+
+      return 0;
+   }
+
+private:
+   bool stopped()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         return stopped_;
+      }
+      END_LOCK_MUTEX
+
+      return true;
+   }
+
+   void addRemoved(std::size_t count)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         eventsRemoved_ += count;
+      }
+      END_LOCK_MUTEX
+   }
+
+   ClientEventQueue* pQueue_;
+   boost::mutex mutex_;
+   bool stopped_;
+   std::size_t eventsRemoved_;
+};
+
+} // anonymous namespace
+
+// add events from this thread (standing in for the R thread) while another
+// thread removes them, and report the rate at which they are added along
+// with how long each add stalls the adding thread
+void runClientEventQueueBenchmark()
+{
+   using namespace boost::posix_time;
+
+   // (the queue is a singleton which coalesces events as the session does)
+   static bool s_initialized = false;
+   if (!s_initialized)
+   {
+      initializeClientEventQueue();
+      s_initialized = true;
+   }
+   ClientEventQueue& queue = clientEventQueue();
+
+   struct Scenario
+   {
+      const char* name;
+      int type;
+   };
+   const Scenario scenarios[] =
+   {
+      { "file changed (queued)", client_events::kFileChanged },
+      { "workspace refresh (last wins)", client_events::kWorkspaceRefresh }
+   };
+
+   for (std::size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+   {
+      const Scenario& scenario = scenarios[i];
+      queue.clear();
+
+      // create the event up front (constructing one generates a uuid)
+      ClientEvent event(scenario.type, std::string("value"));
+
+      EventConsumer consumer(&queue);
+      boost::thread consumerThread(boost::bind(&EventConsumer::run,
+                                               &consumer));
+
+      // time each add
+      Samples stallUs;
+      ptime start = microsec_clock::universal_time();
+      for (int j = 0; j < kEvents; j++)
+      {
+         ptime addStart = microsec_clock::universal_time();
+         queue.add(event);
+         stallUs.add((microsec_clock::universal_time() - addStart)
+                                                   .total_microseconds());
+      }
+      double seconds = elapsedSeconds(start);
+
+      consumer.stop();
+      consumerThread.join();
+
+      report("ClientEventQueue",
+             boost::format("%1%, %2$.0f events/s, add stall mean %3$.2f us, "
+                           "p99 %4% us, max %5% us, %6% events delivered")
+                % scenario.name
+                % perSecond(kEvents, seconds)
+                % stallUs.mean()
+                % stallUs.percentile(99)
+                % stallUs.percentile(100)
+                % consumer.eventsRemoved());
+   }
+}
+
+} // namespace benchmark
@@ -0,0 +1,102 @@
+/*
+ * HashBenchmark.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "Benchmark.hpp"
+
+#include <algorithm>
+
+#include <boost/crc.hpp>
+
+#include <core/Hash.hpp>
+
+using namespace core;
+
+namespace benchmark {
+
+// compare crc32Checksum with boost::crc_32_type (the previous
+// implementation) across content sizes, and time crc32Splice
+void runHashBenchmark()
+{
+   using namespace boost::posix_time;
+
+   const std::size_t sizes[] = { 1024,
+                                 64 * 1024,
+                                 1024 * 1024,
+                                 16 * 1024 * 1024,
+                                 100 * 1024 * 1024 };
+
+   for (std::size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+   {
+      // deterministic, non-repeating content
+      std::string content(sizes[i], '\0');
+      boost::uint32_t seed = 1;
+      for (std::size_t j = 0; j < content.size(); j++)
+      {
+         seed = seed * 1103515245 + 12345;
+         content[j] = static_cast<char>(seed >> 16);
+      }
+      std::size_t iterations =
+                     std::max<std::size_t>(1, kBytesPerMeasurement / sizes[i]);
+
+      // crc32Checksum
+      boost::uint32_t crc = 0;
+      ptime start = microsec_clock::universal_time();
+      for (std::size_t j = 0; j < iterations; j++)
+         crc = hash::crc32Checksum(content);
+      double crcSeconds = elapsedSeconds(start);
+
+      // boost::crc_32_type
+      boost::uint32_t boostCrc = 0;
+      start = microsec_clock::universal_time();
+      for (std::size_t j = 0; j < iterations; j++)
+      {
+         boost::crc_32_type result;
+         result.process_bytes(content.data(), content.length());
+         boostCrc = result.checksum();
+      }
+      double boostSeconds = elapsedSeconds(start);
+
+      // crc32Splice of a one character edit three quarters of the way
+      // through the content (as when typing in a document)
+      boost::uint32_t spliceCrc = 0;
+      std::size_t offset = (content.size() / 4) * 3;
+      std::size_t spliceIterations = 1000;
+      start = microsec_clock::universal_time();
+      for (std::size_t j = 0; j < spliceIterations; j++)
+         spliceCrc = hash::crc32Splice(crc, content, offset, 1, "x");
+      double spliceSeconds = elapsedSeconds(start);
+
+      // the results should agree
+      std::string edited = content;
+      edited.replace(offset, 1, "x");
+      std::size_t failures = 0;
+      if (crc != boostCrc)
+         failures++;
+      if (spliceCrc != hash::crc32Checksum(edited))
+         failures++;
+
+      report("Hash",
+             boost::format("%1% bytes, crc32Checksum %2$.0f MB/s, "
+                           "boost::crc_32_type %3$.0f MB/s, "
+                           "crc32Splice %4$.1f us")
+                % sizes[i]
+                % megabytesPerSecond(sizes[i] * iterations, crcSeconds)
+                % megabytesPerSecond(sizes[i] * iterations, boostSeconds)
+                % (spliceSeconds * 1000000 / spliceIterations),
+             failures);
+   }
+}
+
+} // namespace benchmark
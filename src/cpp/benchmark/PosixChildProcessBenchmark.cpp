@@ -0,0 +1,122 @@
+/*
+ * PosixChildProcessBenchmark.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "Benchmark.hpp"
+
+#include <unistd.h>
+
+#include <fstream>
+#include <new>
+
+#include <core/Error.hpp>
+#include <core/system/Process.hpp>
+
+using namespace core;
+
+namespace benchmark {
+
+namespace {
+
+const int kSpawnsPerMeasurement = 100;
+
+// resident set size of this process in MB
+double residentMegabytes()
+{
+   std::ifstream statm("/proc/self/statm");
+   long pages = 0, residentPages = 0;
+   if (!(statm >> pages >> residentPages))
+      return 0;
+   return (residentPages * ::sysconf(_SC_PAGESIZE)) / (1024.0 * 1024.0);
+}
+
+// (providing an onAfterFork function makes ChildProcess fork rather
+// than vfork)
+void noopAfterFork()
+{
+}
+
+// launch times in ms (returns the number of failed launches)
+std::size_t timeSpawns(bool useFork, Samples* pSpawnMs)
+{
+   using namespace boost::posix_time;
+
+   core::system::ProcessOptions options;
+   if (useFork)
+      options.onAfterFork = noopAfterFork;
+
+   std::size_t failures = 0;
+   std::vector<std::string> args;
+   for (int i = 0; i < kSpawnsPerMeasurement; i++)
+   {
+      core::system::ProcessResult result;
+      ptime start = microsec_clock::universal_time();
+      Error error = core::system::runProgram("/bin/true",
+                                             args,
+                                             "",
+                                             options,
+                                             &result);
+      pSpawnMs->add(elapsedSeconds(start) * 1000);
+      if (error || result.exitStatus != 0)
+         failures++;
+   }
+   return failures;
+}
+
+} // anonymous namespace
+
+// run a trivial program repeatedly (as the session does for e.g. git and
+// svn commands) while this process holds increasingly large amounts of
+// memory (standing in for the R heap), comparing the time taken to launch
+// it using vfork with the time taken using fork
+void runChildProcessBenchmark()
+{
+   const std::size_t heapSizes[] = { 0,
+                                     256 * 1024 * 1024,
+                                     1024 * 1024 * 1024 };
+
+   for (std::size_t i = 0; i < sizeof(heapSizes) / sizeof(heapSizes[0]); i++)
+   {
+      // touch every page so the memory is resident
+      std::vector<char> heap;
+      try
+      {
+         heap.resize(heapSizes[i], 'x');
+      }
+      catch(const std::bad_alloc&)
+      {
+         report("ChildProcess",
+                boost::format("unable to allocate %1% bytes (SKIPPED)")
+                   % heapSizes[i]);
+         continue;
+      }
+
+      Samples vforkMs, forkMs;
+      std::size_t failures = timeSpawns(false, &vforkMs) +
+                             timeSpawns(true, &forkMs);
+
+      report("ChildProcess",
+             boost::format("%1$.0f MB resident, "
+                           "vfork mean %2$.2f ms p99 %3$.2f ms, "
+                           "fork mean %4$.2f ms p99 %5$.2f ms")
+                % residentMegabytes()
+                % vforkMs.mean()
+                % vforkMs.percentile(99)
+                % forkMs.mean()
+                % forkMs.percentile(99),
+             failures);
+   }
+}
+
+} // namespace benchmark
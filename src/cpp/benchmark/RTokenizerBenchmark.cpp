@@ -0,0 +1,83 @@
+/*
+ * RTokenizerBenchmark.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "Benchmark.hpp"
+
+#include <core/StringUtils.hpp>
+#include <core/r_util/RTokenizer.hpp>
+
+using namespace core;
+
+namespace benchmark {
+
+namespace {
+
+// a representative sample of R code (functions, S4 definitions, strings,
+// comments, numbers and operators)
+const char * const kSampleCode =
+   "# compute summary statistics for each group\n"
+   "summarizeGroups <- function(data, groups, na.rm = TRUE) {\n"
+   "   result <- list()\n"
+   "   for (g in unique(data[[groups]])) {\n"
+   "      rows <- data[data[[groups]] == g, , drop = FALSE]\n"
+   "      result[[as.character(g)]] <- c(mean = mean(rows$x, na.rm = na.rm),\n"
+   "                                     sd = sd(rows$x, na.rm = na.rm),\n"
+   "                                     n = nrow(rows))\n"
+   "   }\n"
+   "   do.call(rbind, result)\n"
+   "}\n"
+   "\n"
+   "setClass(\"track\", representation(x = \"numeric\", y = \"numeric\"))\n"
+   "setMethod(\"plot\", signature(x = \"track\", y = \"missing\"),\n"
+   "          function(x, y, ...) plot(x@x, x@y, ...))\n"
+   "\n"
+   "`%+%` <- function(a, b) paste0(a, b)\n"
+   "label <- 'value: ' %+% format(1.5e-3, nsmall = 2L) # inline comment\n"
+   "mask <- bitwAnd(0xFF, 12L) > 0 && !is.null(label) || 2i != 0\n";
+
+const int kTargetBytes = 4 * 1024 * 1024;
+const int kIterations = 5;
+
+} // anonymous namespace
+
+// tokenize a few MB of R code, reporting throughput in terms of the
+// (UTF-8) source size
+void runTokenizerBenchmark()
+{
+   using namespace boost::posix_time;
+
+   // build the code from the sample
+   std::string code;
+   while (code.size() < static_cast<std::size_t>(kTargetBytes))
+      code.append(kSampleCode);
+   std::wstring wCode = string_utils::utf8ToWide(code);
+
+   std::size_t tokenCount = 0;
+   ptime start = microsec_clock::universal_time();
+   for (int i = 0; i < kIterations; i++)
+   {
+      r_util::RTokens rTokens(wCode);
+      tokenCount = rTokens.size();
+   }
+   double seconds = elapsedSeconds(start);
+
+   report("RTokenizer",
+          boost::format("%1% tokens in %2% bytes, %3$.1f MB/s")
+             % tokenCount
+             % code.size()
+             % megabytesPerSecond(code.size() * kIterations, seconds));
+}
+
+} // namespace benchmark
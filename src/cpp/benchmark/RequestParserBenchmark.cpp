@@ -0,0 +1,108 @@
+/*
+ * RequestParserBenchmark.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "Benchmark.hpp"
+
+#include <algorithm>
+
+#include <boost/lexical_cast.hpp>
+
+#include <core/http/Request.hpp>
+#include <core/http/RequestParser.hpp>
+
+using namespace core;
+
+namespace benchmark {
+
+namespace {
+
+// the session and server listeners both read into 8K buffers
+const std::size_t kReadSize = 8192;
+
+// an rpc post like those sent by the browser (via the server proxy)
+std::string rpcRequest(std::size_t bodySize)
+{
+   std::string body = "{\"method\":\"save_document\",\"params\":[\"";
+   while (body.size() < bodySize - 3)
+      body.append("x <- rnorm(100); summary(x)\\n");
+   body.resize(bodySize - 3);
+   body.append("\"]}");
+
+   return "POST /rpc/save_document HTTP/1.1\r\n"
+          "Host: localhost:8787\r\n"
+          "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36\r\n"
+          "Accept: */*\r\n"
+          "Accept-Encoding: gzip, deflate\r\n"
+          "Accept-Language: en-US,en;q=0.8\r\n"
+          "Content-Type: application/json\r\n"
+          "Cookie: user-id=rstudio|Tue%2C%2016%20Oct%202012; csrf-token=1\r\n"
+          "X-RS-RID: 1c2b4e1a-a7f6-4b3c-9a20-1f3f6b0c1d2e\r\n"
+          "Connection: keep-alive\r\n"
+          "Content-Length: " +
+          boost::lexical_cast<std::string>(body.size()) + "\r\n"
+          "\r\n" + body;
+}
+
+} // anonymous namespace
+
+// parse rpc posts of increasing size as they would arrive from the socket
+void runRequestParserBenchmark()
+{
+   using namespace boost::posix_time;
+
+   const std::size_t bodySizes[] = { 256,
+                                     16 * 1024,
+                                     1024 * 1024,
+                                     5 * 1024 * 1024 };
+
+   for (std::size_t i = 0; i < sizeof(bodySizes) / sizeof(bodySizes[0]); i++)
+   {
+      std::string data = rpcRequest(bodySizes[i]);
+      std::size_t iterations =
+                  std::max<std::size_t>(1, kBytesPerMeasurement / data.size());
+
+      std::size_t failures = 0;
+      http::RequestParser parser;
+      ptime start = microsec_clock::universal_time();
+      for (std::size_t j = 0; j < iterations; j++)
+      {
+         http::Request request;
+         parser.reset();
+         http::RequestParser::status status = http::RequestParser::incomplete;
+         for (std::size_t offset = 0;
+              offset < data.size() && status == http::RequestParser::incomplete;
+              offset += kReadSize)
+         {
+            const char* begin = data.data() + offset;
+            const char* end = begin + std::min(kReadSize,
+                                               data.size() - offset);
+            status = parser.parse(request, begin, end);
+         }
+         if (status != http::RequestParser::complete ||
+             request.body().size() != bodySizes[i])
+            failures++;
+      }
+      double seconds = elapsedSeconds(start);
+
+      report("RequestParser",
+             boost::format("%1% byte body, %2$.0f MB/s, %3$.0f requests/s")
+                % bodySizes[i]
+                % megabytesPerSecond(data.size() * iterations, seconds)
+                % perSecond(iterations, seconds),
+             failures);
+   }
+}
+
+} // namespace benchmark
@@ -16,8 +16,8 @@
 #include <core/Hash.hpp>
 
 #include <sstream>
+#include <algorithm>
 
-#include <boost/crc.hpp>
 #include <boost/lexical_cast.hpp>
 
 #include <core/SafeConvert.hpp>
@@ -25,22 +25,202 @@
 namespace core {
 namespace hash {   
 
+namespace {
+
+// the (reflected) crc-32 polynomial, i.e. the crc computed by zlib and
+// boost::crc_32_type. polynomials below are in the same representation:
+// the coefficient of x^0 is the high bit and that of x^31 the low bit
+const boost::uint32_t kCrc32Polynomial = 0xEDB88320;
+const boost::uint32_t kOne = 0x80000000;
+
+// x^-1 is (P(x) + 1) / x
+const boost::uint32_t kXInverse = ((kCrc32Polynomial & ~kOne) << 1) | 1;
+
+boost::uint32_t multiplyModP(boost::uint32_t a, boost::uint32_t b)
+{
+   boost::uint32_t product = 0;
+   for (boost::uint32_t m = kOne; m != 0; m >>= 1)
+   {
+      if (a & m)
+         product ^= b;
+      b = (b & 1) ? (b >> 1) ^ kCrc32Polynomial : b >> 1;
+   }
+   return product;
+}
+
+class Crc32Tables
+{
+private:
+   friend const Crc32Tables& crc32Tables();
+   Crc32Tables()
+   {
+      // slicing-by-8 tables: bytes[k][b] is the crc of byte b followed by
+      // k zero bytes
+      for (boost::uint32_t b = 0; b < 256; b++)
+      {
+         boost::uint32_t crc = b;
+         for (int i = 0; i < 8; i++)
+            crc = (crc & 1) ? (crc >> 1) ^ kCrc32Polynomial : crc >> 1;
+         bytes[0][b] = crc;
+      }
+      for (int k = 1; k < 8; k++)
+      {
+         for (int b = 0; b < 256; b++)
+         {
+            bytes[k][b] = (bytes[k-1][b] >> 8) ^
+                          bytes[0][bytes[k-1][b] & 0xFF];
+         }
+      }
+
+      // x^(2^k) and x^-(2^k) for shifting a crc by a number of bytes
+      powers[0] = kOne >> 1;
+      inversePowers[0] = kXInverse;
+      for (int k = 1; k < 64; k++)
+      {
+         powers[k] = multiplyModP(powers[k-1], powers[k-1]);
+         inversePowers[k] = multiplyModP(inversePowers[k-1],
+                                         inversePowers[k-1]);
+      }
+   }
+
+public:
+   boost::uint32_t bytes[8][256];
+   boost::uint32_t powers[64];
+   boost::uint32_t inversePowers[64];
+};
+
+const Crc32Tables& crc32Tables()
+{
+   static Crc32Tables instance;
+   return instance;
+}
+
+// x^(8n) (or x^(-8n)) mod P, the multiplier which appends (or removes)
+// n zero bytes to a crc
+boost::uint32_t byteShift(std::size_t n, bool inverse)
+{
+   const boost::uint32_t* powers = inverse ? crc32Tables().inversePowers :
+                                             crc32Tables().powers;
+   boost::uint32_t result = kOne;
+   for (int k = 3; n != 0 && k < 64; n >>= 1, k++)
+   {
+      if (n & 1)
+         result = multiplyModP(powers[k], result);
+   }
+   return result;
+}
+
+boost::uint32_t readWord(const unsigned char* p)
+{
+   return static_cast<boost::uint32_t>(p[0]) |
+          static_cast<boost::uint32_t>(p[1]) << 8 |
+          static_cast<boost::uint32_t>(p[2]) << 16 |
+          static_cast<boost::uint32_t>(p[3]) << 24;
+}
+
+} // anonymous namespace
+
+boost::uint32_t crc32Update(boost::uint32_t crc,
+                            const char* data,
+                            std::size_t length)
+{
+   const boost::uint32_t (*bytes)[256] = crc32Tables().bytes;
+   const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+
+   // eight bytes at a time
+   crc = ~crc;
+   for (; length >= 8; p += 8, length -= 8)
+   {
+      boost::uint32_t low = crc ^ readWord(p);
+      boost::uint32_t high = readWord(p + 4);
+      crc = bytes[7][low & 0xFF] ^
+            bytes[6][(low >> 8) & 0xFF] ^
+            bytes[5][(low >> 16) & 0xFF] ^
+            bytes[4][low >> 24] ^
+            bytes[3][high & 0xFF] ^
+            bytes[2][(high >> 8) & 0xFF] ^
+            bytes[1][(high >> 16) & 0xFF] ^
+            bytes[0][high >> 24];
+   }
+
+   // then the remainder a byte at a time
+   for (; length > 0; p++, length--)
+      crc = (crc >> 8) ^ bytes[0][(crc ^ *p) & 0xFF];
+
+   return ~crc;
+}
+
+boost::uint32_t crc32Checksum(const std::string& content)
+{
+   return crc32Update(0, content.data(), content.length());
+}
+
+boost::uint32_t crc32Combine(boost::uint32_t crc1,
+                             boost::uint32_t crc2,
+                             std::size_t length2)
+{
+   return multiplyModP(byteShift(length2, false), crc1) ^ crc2;
+}
+
+boost::uint32_t crc32Splice(boost::uint32_t crc,
+                            const std::string& content,
+                            std::size_t offset,
+                            std::size_t length,
+                            const std::string& replacement)
+{
+   // content is prefix + removed + suffix, where
+   //    crc = prefixCrc * x^8(removedLength + suffixLength) +
+   //          removedCrc * x^8(suffixLength) +
+   //          suffixCrc
+   // so we can solve for whichever of prefixCrc and suffixCrc we
+   // don't compute directly
+   offset = std::min(offset, content.length());
+   length = std::min(length, content.length() - offset);
+   std::size_t suffixOffset = offset + length;
+   std::size_t suffixLength = content.length() - suffixOffset;
+
+   boost::uint32_t removedCrc = crc32Update(0,
+                                            content.data() + offset,
+                                            length);
+   boost::uint32_t prefixCrc, suffixCrc;
+   if (offset <= suffixLength)
+   {
+      prefixCrc = crc32Update(0, content.data(), offset);
+      suffixCrc = crc ^ multiplyModP(byteShift(suffixLength, false),
+                                     crc32Combine(prefixCrc,
+                                                  removedCrc,
+                                                  length));
+   }
+   else
+   {
+      suffixCrc = crc32Update(0,
+                              content.data() + suffixOffset,
+                              suffixLength);
+      boost::uint32_t leadingCrc = multiplyModP(byteShift(suffixLength, true),
+                                                crc ^ suffixCrc);
+      prefixCrc = multiplyModP(byteShift(length, true),
+                               leadingCrc ^ removedCrc);
+   }
+
+   // crc of prefix + replacement + suffix
+   boost::uint32_t replacementCrc = crc32Checksum(replacement);
+   return crc32Combine(crc32Combine(prefixCrc,
+                                    replacementCrc,
+                                    replacement.length()),
+                       suffixCrc,
+                       suffixLength);
+}
+
 std::string crc32Hash(const std::string& content)
 {
-   boost::crc_32_type result;
-   result.process_bytes(content.data(), content.length());
-   return safe_convert::numberToString(result.checksum());
+   return safe_convert::numberToString(crc32Checksum(content));
 }
 
 std::string crc32HexHash(const std::string& content)
 {
-   // compute checksum
-   boost::crc_32_type result;
-   result.process_bytes(content.data(), content.length());
-
    // return hex representation
    std::ostringstream output;
-   output << std::uppercase << std::hex << result.checksum();
+   output << std::uppercase << std::hex << crc32Checksum(content);
    return output.str();
 }
    
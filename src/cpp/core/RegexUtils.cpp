@@ -16,6 +16,8 @@
 #include <core/RegexUtils.hpp>
 
 #include <vector>
+#include <cstring>
+#include <cwctype>
 
 #include <boost/regex.hpp>
 #include <boost/algorithm/string.hpp>
@@ -25,6 +27,97 @@
 namespace core {
 namespace regex_utils {
 
+namespace {
+
+// append a character which should match itself
+void appendLiteral(wchar_t ch, bool ignoreCase, std::string* pRegex)
+{
+   if (ch < 0x80)
+   {
+      if (ch != 0 && std::strchr("\\^$.|?*+()[]{}", static_cast<char>(ch)))
+         pRegex->push_back('\\');
+      pRegex->push_back(static_cast<char>(ch));
+      return;
+   }
+
+   // non-ASCII characters are grouped so that a quantifier which follows
+   // them applies to all of their bytes. icase only folds single bytes so
+   // their other case (according to the current locale, as with grep) is
+   // added explicitly
+   std::wstring variants(1, ch);
+   if (ignoreCase)
+   {
+      wchar_t lower = static_cast<wchar_t>(std::towlower(ch));
+      wchar_t upper = static_cast<wchar_t>(std::towupper(ch));
+      if (lower != ch)
+         variants.push_back(lower);
+      if (upper != ch && upper != lower)
+         variants.push_back(upper);
+   }
+
+   pRegex->append("(?:");
+   for (std::size_t i = 0; i < variants.size(); i++)
+   {
+      if (i > 0)
+         pRegex->push_back('|');
+      pRegex->append(string_utils::wideToUtf8(std::wstring(1, variants[i])));
+   }
+   pRegex->append(")");
+}
+
+// append the bracket expression which starts at pos, returning the position
+// after it. backslashes are literal within brackets in grep's syntax but are
+// escapes in perl's
+std::size_t appendBracketExpression(const std::wstring& pattern,
+                                    std::size_t pos,
+                                    std::string* pRegex)
+{
+   std::wstring expression(L"[");
+   std::size_t i = pos + 1;
+   if (i < pattern.size() && pattern[i] == L'^')
+      expression.push_back(pattern[i++]);
+   if (i < pattern.size() && pattern[i] == L']')
+   {
+      expression.append(L"\\]");
+      i++;
+   }
+
+   while (i < pattern.size() && pattern[i] != L']')
+   {
+      // character classes, collating symbols and equivalence classes
+      // (e.g. [:alpha:]) are the same in both
+      if (pattern[i] == L'[' && i + 1 < pattern.size() &&
+          (pattern[i+1] == L':' || pattern[i+1] == L'.' || pattern[i+1] == L'='))
+      {
+         std::wstring close(1, pattern[i+1]);
+         close.push_back(L']');
+         std::size_t end = pattern.find(close, i + 2);
+         if (end == std::wstring::npos)
+            break;
+         expression.append(pattern, i, end + 2 - i);
+         i = end + 2;
+      }
+      else if (pattern[i] == L'\\')
+      {
+         expression.append(L"\\\\");
+         i++;
+      }
+      else
+      {
+         expression.push_back(pattern[i++]);
+      }
+   }
+
+   // (an unterminated expression is left open so that it fails to compile)
+   if (i < pattern.size() && pattern[i] == L']')
+      expression.push_back(pattern[i++]);
+
+   pRegex->append(string_utils::wideToUtf8(expression));
+   return i;
+}
+
+} // anonymous namespace
+
 boost::regex wildcardPatternToRegex(const std::string& pattern)
 {
    // split into componenents
@@ -45,6 +138,120 @@ boost::regex wildcardPatternToRegex(const std::string& pattern)
    return boost::regex(regex);
 }
 
+std::string grepPatternToRegex(const std::string& pattern, bool ignoreCase)
+{
+   std::wstring wide = string_utils::utf8ToWide(pattern);
+   std::string regex;
+
+   // at the start of an expression '*' is literal and '^' is an anchor
+   bool atStart = true;
+   std::size_t i = 0;
+   while (i < wide.size())
+   {
+      wchar_t ch = wide[i];
+      bool start = atStart;
+      atStart = false;
+
+      if (ch == L'\\' && i + 1 < wide.size())
+      {
+         wchar_t next = wide[i+1];
+         i += 2;
+         switch (next)
+         {
+            // groups and alternation (which start a new expression)
+            case L'(':
+            case L'|':
+               regex.push_back(static_cast<char>(next));
+               atStart = true;
+               break;
+
+            // the other operators which are escaped in grep's syntax
+            case L')':
+            case L'{':
+            case L'}':
+            case L'+':
+            case L'?':
+               regex.push_back(static_cast<char>(next));
+               break;
+
+            // word characters include the (non-ASCII) bytes of encoded
+            // characters, which are nearly always letters
+            case L'w':
+               regex.append("[\\w\\x80-\\xff]");
+               break;
+            case L'W':
+               regex.append("[^\\w\\x80-\\xff]");
+               break;
+
+            // word and buffer boundaries, space classes, and back
+            // references are the same in both
+            case L'<':
+            case L'>':
+            case L'b':
+            case L'B':
+            case L's':
+            case L'S':
+            case L'`':
+            case L'\'':
+            case L'1': case L'2': case L'3': case L'4': case L'5':
+            case L'6': case L'7': case L'8': case L'9':
+               regex.push_back('\\');
+               regex.push_back(static_cast<char>(next));
+               break;
+
+            // anything else escaped is literal
+            default:
+               appendLiteral(next, ignoreCase, &regex);
+               break;
+         }
+      }
+      else if (ch == L'[')
+      {
+         i = appendBracketExpression(wide, i, &regex);
+      }
+      else if (ch == L'^')
+      {
+         regex.append(start ? "^" : "\\^");
+         atStart = start;
+         i++;
+      }
+      else if (ch == L'$')
+      {
+         // an anchor only at the end of an expression
+         bool atEnd = (i + 1 == wide.size()) ||
+                      (wide.compare(i + 1, 2, L"\\)") == 0) ||
+                      (wide.compare(i + 1, 2, L"\\|") == 0);
+         regex.append(atEnd ? "$" : "\\$");
+         i++;
+      }
+      else if (ch == L'.' || (ch == L'*' && !start))
+      {
+         regex.push_back(static_cast<char>(ch));
+         i++;
+      }
+      else
+      {
+         // (including a trailing backslash, which fails to compile as in grep)
+         if (ch == L'\\')
+            regex.push_back('\\');
+         else
+            appendLiteral(ch, ignoreCase, &regex);
+         i++;
+      }
+   }
+
+   return regex;
+}
+
+std::string literalToRegex(const std::string& literal, bool ignoreCase)
+{
+   std::wstring wide = string_utils::utf8ToWide(literal);
+   std::string regex;
+   for (std::size_t i = 0; i < wide.size(); i++)
+      appendLiteral(wide[i], ignoreCase, &regex);
+   return regex;
+}
+
 bool textMatches(const std::string& text,
                  const boost::regex& regex,
                  bool prefixOnly,
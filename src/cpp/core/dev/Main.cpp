@@ -13,6 +13,7 @@
  *
  */
 
+#include <clocale>
 #include <iostream>
 
 #include <boost/test/minimal.hpp>
@@ -24,6 +25,8 @@
 
 using namespace core ;
 
+bool testGrepPatternToRegex();
+
 int test_main(int argc, char * argv[])
 {
    try
@@ -31,6 +34,10 @@ int test_main(int argc, char * argv[])
       // initialize log
       initializeSystemLog("coredev", core::system::kLogLevelWarning);
 
+      // use the user's locale (as the session does)
+      std::setlocale(LC_ALL, "");
+
+      BOOST_CHECK(testGrepPatternToRegex());
 
 
       return EXIT_SUCCESS;
@@ -0,0 +1,142 @@
+/*
+ * RegexUtilsTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <cwctype>
+#include <iostream>
+
+#include <boost/regex.hpp>
+
+#include <core/RegexUtils.hpp>
+
+using namespace core;
+
+namespace {
+
+struct GrepCase
+{
+   const char* pattern;
+   bool ignoreCase;
+   const char* text;
+   bool matches;
+};
+
+// the results of these match those of GNU grep
+const GrepCase kGrepCases[] =
+{
+   // GNU extensions
+   { "foo\\|bar", false, "a bar", true },
+   { "foo\\|bar", false, "baz", false },
+   { "ba\\+r", false, "baaar", true },
+   { "ba\\+r", false, "br", false },
+   { "ba\\?r", false, "br", true },
+   { "\\bword\\b", false, "a word here", true },
+   { "\\bword\\b", false, "swords", false },
+   { "\\<word\\>", false, "a word here", true },
+   { "\\<word\\>", false, "sword", false },
+   { "\\w\\+", false, "x_y1", true },
+   { "\\w", false, "+-", false },
+   { "\\s", false, "tab\there", true },
+   { "\\S\\+$", false, "end ", false },
+
+   // operators which are literal unless escaped
+   { "a+b", false, "a+b", true },
+   { "a+b", false, "aab", false },
+   { "a?b", false, "a?b", true },
+   { "(x)", false, "(x)", true },
+   { "{2}", false, "{2}", true },
+   { "a|b", false, "a", false },
+
+   // groups, intervals and back references
+   { "\\(ab\\)\\{2\\}", false, "abab", true },
+   { "\\(ab\\)\\{2\\}", false, "ab", false },
+   { "\\(a\\)\\1", false, "aa", true },
+
+   // anchors (and where '^', '$' and '*' are literal)
+   { "^caret", false, "^caret", false },
+   { "\\^caret", false, "^caret", true },
+   { "a^b", false, "a^b", true },
+   { "doll$r", false, "doll$r", true },
+   { "end$", false, "end$", false },
+   { "x\\|end$", false, "the end", true },
+   { "*star", false, "*star", true },
+   { "^*star", false, "*star", true },
+
+   // bracket expressions (where backslash is literal)
+   { "[]]", false, "brack]et", true },
+   { "[\\]", false, "back\\slash", true },
+   { "[[:digit:]]\\+\\.[0-9]", false, "1.5e3", true },
+   { "a.c", false, "abc", true },
+   { "a\\.c", false, "abc", false },
+
+   // case
+   { "FOO\\|bar", true, "foo", true },
+   { "caf\xc3\xa9", false, "CAF\xc3\x89", false },
+   { "\xc3\xa9\\+", false, "\xc3\xa9\xc3\xa9", true }
+};
+
+bool grepMatches(const std::string& pattern,
+                 bool ignoreCase,
+                 const std::string& text)
+{
+   boost::regex::flag_type flags = boost::regex::perl;
+   if (ignoreCase)
+      flags |= boost::regex::icase;
+   boost::regex regex(regex_utils::grepPatternToRegex(pattern, ignoreCase),
+                      flags);
+   return boost::regex_search(text,
+                              regex,
+                              boost::match_default |
+                              boost::match_not_dot_newline);
+}
+
+} // anonymous namespace
+
+// (returns false and reports the failures if any checks fail)
+bool testGrepPatternToRegex()
+{
+   bool passed = true;
+   std::size_t count = sizeof(kGrepCases) / sizeof(kGrepCases[0]);
+   for (std::size_t i = 0; i < count; i++)
+   {
+      const GrepCase& grepCase = kGrepCases[i];
+      if (grepMatches(grepCase.pattern,
+                      grepCase.ignoreCase,
+                      grepCase.text) != grepCase.matches)
+      {
+         std::cerr << "grep pattern " << grepCase.pattern << " against "
+                   << grepCase.text << " failed" << std::endl;
+         passed = false;
+      }
+   }
+
+   // non-ASCII case is folded according to the locale
+   if (std::towupper(0xe9) == 0xc9 &&
+       !grepMatches("caf\xc3\xa9", true, "CAF\xc3\x89"))
+   {
+      std::cerr << "grep pattern failed to fold non-ASCII case" << std::endl;
+      passed = false;
+   }
+
+   // literals
+   boost::regex literal(regex_utils::literalToRegex("a.b*(c)", false));
+   if (!boost::regex_search(std::string("xa.b*(c)x"), literal) ||
+       boost::regex_search(std::string("axbb(c)"), literal))
+   {
+      std::cerr << "literal regex failed" << std::endl;
+      passed = false;
+   }
+
+   return passed;
+}
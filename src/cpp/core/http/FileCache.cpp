@@ -0,0 +1,332 @@
+/*
+ * FileCache.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/http/FileCache.hpp>
+
+#include <map>
+#include <list>
+#include <vector>
+#include <sstream>
+
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+#ifndef _WIN32
+#include <boost/iostreams/filter/gzip.hpp>
+#endif
+
+#include <core/Log.hpp>
+#include <core/Hash.hpp>
+#include <core/StringUtils.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/Thread.hpp>
+
+namespace core {
+namespace http {
+
+namespace {
+
+// files larger than this are prepared but not retained
+const uintmax_t kMaxCachedFileSize = 4 * 1024 * 1024;
+
+// maximum total size of the raw contents in the cache (gzipped contents,
+// which are created when first requested, are generally much smaller and
+// are not counted)
+const std::size_t kMaxCacheSize = 32 * 1024 * 1024;
+
+// files modified more recently than this (in seconds) are not retained.
+// modification times only have a resolution of a second, so a file which
+// is rewritten at the same size within the second it was cached would
+// otherwise be served stale (e.g. a regenerated preview or plot)
+const std::time_t kMinCachedFileAge = 2;
+
+// chunk size for checking whether large files are valid UTF-8
+const std::size_t kUtf8CheckChunkSize = 64 * 1024;
+
+std::string gzip(const std::string& contents)
+{
+#ifndef _WIN32
+   try
+   {
+      std::istringstream is(contents);
+      std::ostringstream os;
+      boost::iostreams::filtering_ostream filteringStream;
+      filteringStream.push(boost::iostreams::gzip_compressor());
+      filteringStream.push(os);
+      boost::iostreams::copy(is, filteringStream);
+      return os.str();
+   }
+   catch(const std::exception& e)
+   {
+      Error error = systemError(boost::system::errc::io_error,
+                                ERROR_LOCATION);
+      error.addProperty("what", e.what());
+      LOG_ERROR(error);
+   }
+#endif
+   return std::string();
+}
+
+std::size_t cachedSize(const CachedFile& file)
+{
+   return file.contents().size();
+}
+
+// length of the prefix of the buffer which doesn't end in the middle of a
+// UTF-8 sequence
+std::size_t completeUtf8Length(const std::string& buffer)
+{
+   std::size_t length = buffer.length();
+   for (std::size_t i = 1; i <= 3 && i <= length; i++)
+   {
+      unsigned char ch = static_cast<unsigned char>(buffer[length - i]);
+      if ((ch & 0xC0) == 0x80)
+         continue; // continuation byte
+
+      std::size_t sequenceLength = 1;
+      if ((ch & 0xE0) == 0xC0)
+         sequenceLength = 2;
+      else if ((ch & 0xF0) == 0xE0)
+         sequenceLength = 3;
+      else if ((ch & 0xF8) == 0xF0)
+         sequenceLength = 4;
+
+      return sequenceLength > i ? length - i : length;
+   }
+   return length;
+}
+
+bool isValidUtf8(const std::string& contents)
+{
+   std::size_t chars;
+   Error error = string_utils::utf8Distance(contents.begin(),
+                                            contents.end(),
+                                            &chars);
+   return !error;
+}
+
+class FileCache : boost::noncopyable
+{
+public:
+   FileCache() : size_(0) {}
+
+   boost::shared_ptr<const CachedFile> get(const std::string& path,
+                                           uintmax_t size,
+                                           std::time_t lastWriteTime)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         Entries::iterator it = entries_.find(path);
+         if (it != entries_.end())
+         {
+            const CachedFile& file = *(it->second.pFile);
+            if (file.contents().size() == size &&
+                file.lastWriteTime() == lastWriteTime)
+            {
+               // move to the back of the lru list
+               lru_.splice(lru_.end(), lru_, it->second.lruPos);
+               return it->second.pFile;
+            }
+            else
+            {
+               remove(it);
+            }
+         }
+      }
+      END_LOCK_MUTEX
+
+      return boost::shared_ptr<const CachedFile>();
+   }
+
+   void put(const std::string& path, boost::shared_ptr<const CachedFile> pFile)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         Entries::iterator it = entries_.find(path);
+         if (it != entries_.end())
+            remove(it);
+
+         Entry entry;
+         entry.pFile = pFile;
+         entry.lruPos = lru_.insert(lru_.end(), path);
+         entries_.insert(std::make_pair(path, entry));
+         size_ += cachedSize(*pFile);
+
+         // evict least recently used files until we are within our budget
+         while (size_ > kMaxCacheSize && !lru_.empty())
+            remove(entries_.find(lru_.front()));
+      }
+      END_LOCK_MUTEX
+   }
+
+private:
+   struct Entry
+   {
+      boost::shared_ptr<const CachedFile> pFile;
+      std::list<std::string>::iterator lruPos;
+   };
+   typedef std::map<std::string,Entry> Entries;
+
+   void remove(Entries::iterator it)
+   {
+      size_ -= cachedSize(*(it->second.pFile));
+      lru_.erase(it->second.lruPos);
+      entries_.erase(it);
+   }
+
+private:
+   boost::mutex mutex_;
+   Entries entries_;
+   std::list<std::string> lru_;
+   std::size_t size_;
+};
+
+FileCache& fileCache()
+{
+   static FileCache* s_pFileCache = new FileCache();
+   return *s_pFileCache;
+}
+
+} // anonymous namespace
+
+CachedFile::CachedFile(const std::string& contents,
+                       std::time_t lastWriteTime)
+   : contents_(contents),
+     eTag_(core::hash::crc32Hash(contents)),
+     lastWriteTime_(lastWriteTime)
+{
+}
+
+bool CachedFile::gzipSupported()
+{
+#ifndef _WIN32
+   return true;
+#else
+   return false;
+#endif
+}
+
+const std::string& CachedFile::gzippedContents() const
+{
+   LOCK_MUTEX(mutex_)
+   {
+      if (!gzippedContents_)
+         gzippedContents_ = gzip(contents_);
+   }
+   END_LOCK_MUTEX
+
+   // (never reassigned once set)
+   return *gzippedContents_;
+}
+
+bool CachedFile::isUtf8() const
+{
+   LOCK_MUTEX(mutex_)
+   {
+      if (!isUtf8_)
+         isUtf8_ = isValidUtf8(contents_);
+      return *isUtf8_;
+   }
+   END_LOCK_MUTEX
+
+   return false;
+}
+
+Error cachedFile(const FilePath& filePath,
+                 boost::shared_ptr<const CachedFile>* ppFile)
+{
+   // check the cache
+   std::string path = filePath.absolutePath();
+   uintmax_t size = filePath.size();
+   std::time_t lastWriteTime = filePath.lastWriteTime();
+   *ppFile = fileCache().get(path, size, lastWriteTime);
+   if (*ppFile)
+      return Success();
+
+   // read and prepare the file
+   std::string contents;
+   Error error = core::readStringFromFile(filePath, &contents);
+   if (error)
+      return error;
+   ppFile->reset(new CachedFile(contents, lastWriteTime));
+
+   // cache it if it isn't too large or too recently modified (note we
+   // check the size we read rather than the size we stat'ed in case it was
+   // written in between)
+   if (contents.size() == size && size <= kMaxCachedFileSize &&
+       std::time(NULL) - lastWriteTime >= kMinCachedFileAge)
+   {
+      fileCache().put(path, *ppFile);
+   }
+
+   return Success();
+}
+
+Error isUtf8File(const FilePath& filePath, bool* pIsUtf8)
+{
+   // files which can be cached are checked (once) by their CachedFile
+   if (filePath.size() <= kMaxCachedFileSize)
+   {
+      boost::shared_ptr<const CachedFile> pFile;
+      Error error = cachedFile(filePath, &pFile);
+      if (error)
+         return error;
+
+      *pIsUtf8 = pFile->isUtf8();
+      return Success();
+   }
+
+   // check larger files a chunk at a time (carrying sequences which span
+   // chunks over to the next one)
+   boost::shared_ptr<std::istream> pIfs;
+   Error error = filePath.open_r(&pIfs);
+   if (error)
+      return error;
+
+   std::vector<char> chunk(kUtf8CheckChunkSize);
+   std::string buffer;
+   while (true)
+   {
+      pIfs->read(&chunk[0], chunk.size());
+      std::size_t count = static_cast<std::size_t>(pIfs->gcount());
+      if (pIfs->bad())
+      {
+         error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+         error.addProperty("path", filePath.absolutePath());
+         return error;
+      }
+      buffer.append(&chunk[0], count);
+
+      // at the end of the file check everything that's left
+      bool endOfFile = pIfs->eof();
+      std::size_t length = endOfFile ? buffer.length() :
+                                       completeUtf8Length(buffer);
+      if (!isValidUtf8(buffer.substr(0, length)))
+      {
+         *pIsUtf8 = false;
+         return Success();
+      }
+      buffer.erase(0, length);
+
+      if (endOfFile)
+         break;
+   }
+
+   *pIsUtf8 = true;
+   return Success();
+}
+
+} // namespace http
+} // namespace core
@@ -16,314 +16,249 @@
 
 #include <core/http/RequestParser.hpp>
 
-#include <boost/lexical_cast.hpp>
+#include <cstring>
+#include <algorithm>
+
+#include <boost/algorithm/string/predicate.hpp>
 
 namespace core {
 namespace http {
 
+namespace {
+
+// limit on the size of the request line or a header line (longer lines
+// are rejected rather than buffered without bound)
+const std::size_t kMaxLineSize = 64 * 1024;
+
+// limit on the body storage reserved up front based on Content-Length
+const std::size_t kMaxBodyReserve = 64 * 1024 * 1024;
+
+} // anonymous namespace
+
 RequestParser::RequestParser()
-  : state_(method_start), 
-    content_length_(0), 
-    parsing_content_length_(false), 
-    parsing_body_(false)
+  : state_(request_line),
+    content_length_(0),
+    body_received_(0),
+    bodyTooLarge_(false)
 {
 }
 
 void RequestParser::reset()
 {
-  state_ = method_start;
+  state_ = request_line;
+  line_.clear();
   content_length_ = 0 ;
-  parsing_content_length_ = false ;
-  parsing_body_ = false ;
+  body_received_ = 0 ;
+  bodyTooLarge_ = false;
 }
 
-RequestParser::status RequestParser::consume(Request& req, char input)
+RequestParser::status RequestParser::parse(Request& req,
+                                           const char* begin,
+                                           const char* end)
 {
-  switch (state_)
+  while (begin != end)
   {
-  case method_start:
-    if (!is_char(input) || is_ctl(input) || is_tspecial(input))
-    {
-      return error;
-    }
-    else
-    {
-      state_ = method;
-      req.method_.push_back(input);
-      return incomplete;
-    }
-  case method:
-    if (input == ' ')
-    {
-      state_ = uri;
-      return incomplete;
-    }
-    else if (!is_char(input) || is_ctl(input) || is_tspecial(input))
-    {
-      return error;
-    }
-    else
-    {
-      req.method_.push_back(input);
-      return incomplete;
-    }
-  case uri_start:
-    if (is_ctl(input))
+    // body parsing (bulk copy of as much as we have)
+    if (state_ == body)
     {
-      return error;
-    }
-    else
-    {
-      state_ = uri;
-      req.uri_.push_back(input);
-      return incomplete;
-    }
-  case uri:
-    if (input == ' ')
-    {
-      state_ = http_version_h;
-      return incomplete;
-    }
-    else if (is_ctl(input))
-    {
-      return error;
-    }
-    else
-    {
-      req.uri_.push_back(input);
-      return incomplete;
-    }
-  case http_version_h:
-    if (input == 'H')
-    {
-      state_ = http_version_t_1;
-      return incomplete;
-    }
-    else
-    {
-      return error;
-    }
-  case http_version_t_1:
-    if (input == 'T')
-    {
-      state_ = http_version_t_2;
-      return incomplete;
-    }
-    else
-    {
-      return error;
-    }
-  case http_version_t_2:
-    if (input == 'T')
-    {
-      state_ = http_version_p;
-      return incomplete;
-    }
-    else
-    {
-      return error;
-    }
-  case http_version_p:
-    if (input == 'P')
-    {
-      state_ = http_version_slash;
-      return incomplete;
-    }
-    else
-    {
-      return error;
-    }
-  case http_version_slash:
-    if (input == '/')
-    {
-      req.httpVersionMajor_ = 0;
-      req.httpVersionMinor_ = 0;
-      state_ = http_version_major_start;
-      return incomplete;
-    }
-    else
-    {
-      return error;
-    }
-  case http_version_major_start:
-    if (is_digit(input))
-    {
-      req.httpVersionMajor_ = req.httpVersionMajor_ * 10 + input - '0';
-      state_ = http_version_major;
-      return incomplete;
-    }
-    else
-    {
-      return error;
-    }
-  case http_version_major:
-    if (input == '.')
-    {
-      state_ = http_version_minor_start;
-      return incomplete;
-    }
-    else if (is_digit(input))
-    {
-      req.httpVersionMajor_ = req.httpVersionMajor_ * 10 + input - '0';
-      return incomplete;
-    }
-    else
-    {
-      return error;
-    }
-  case http_version_minor_start:
-    if (is_digit(input))
-    {
-      req.httpVersionMinor_ = req.httpVersionMinor_ * 10 + input - '0';
-      state_ = http_version_minor;
-      return incomplete;
-    }
-    else
-    {
-      return error;
-    }
-  case http_version_minor:
-    if (input == '\r')
-    {
-      state_ = expecting_newline_1;
-      return incomplete;
-    }
-    else if (is_digit(input))
-    {
-      req.httpVersionMinor_ = req.httpVersionMinor_ * 10 + input - '0';
-      return incomplete;
-    }
-    else
-    {
-      return error;
-    }
-  case expecting_newline_1:
-    if (input == '\n')
-    {
-      state_ = header_line_start;
-      return incomplete;
-    }
-    else
-    {
-      return error;
-    }
-  case header_line_start:
-    if (input == '\r')
-    {
-      state_ = expecting_newline_3;
-      return incomplete;
+      std::size_t count = std::min(content_length_ - body_received_,
+                                   static_cast<std::size_t>(end - begin));
+      if (!bodyTooLarge_)
+        req.body_.append(begin, count);
+
+      begin += count;
+      body_received_ += count;
+      if (body_received_ == content_length_)
+        return bodyTooLarge_ ? error : complete;
+      else
+        continue;
     }
-    else if (!req.headers_.empty() && (input == ' ' || input == '\t'))
-    {
-      state_ = header_lws;
+
+    // header parsing: find the end of the current line
+    const char* newline = static_cast<const char*>(
+                              std::memchr(begin, '\n', end - begin));
+    if (newline == NULL)
+    {
+      if (line_.size() + (end - begin) > kMaxLineSize)
+        return error;
+      line_.append(begin, end);
       return incomplete;
     }
-    else if (!is_char(input) || is_ctl(input) || is_tspecial(input))
+
+    // handle the line (joining it to any partial line from the last chunk)
+    status st;
+    if (line_.empty())
     {
-      return error;
+      st = parseLine(req, begin, newline);
     }
     else
     {
-      req.headers_.push_back(Header());
-      req.headers_.back().name.push_back(input);
-      state_ = header_name;
-      return incomplete;
+      if (line_.size() + (newline - begin) > kMaxLineSize)
+        return error;
+      line_.append(begin, newline);
+      st = parseLine(req, line_.data(), line_.data() + line_.size());
+      line_.clear();
     }
-  case header_lws:
-    if (input == '\r')
-    {
-      state_ = expecting_newline_2;
-      return incomplete;
-    }
-    else if (input == ' ' || input == '\t')
-    {
-      return incomplete;
-    }
-    else if (is_ctl(input))
-    {
+    begin = newline + 1;
+
+    if (st != incomplete)
+      return st;
+  }
+  return incomplete;
+}
+
+RequestParser::status RequestParser::parseLine(Request& req,
+                                               const char* begin,
+                                               const char* end)
+{
+  // lines must be terminated by CRLF
+  if (begin == end || *(end - 1) != '\r')
+    return error;
+  --end;
+
+  if (state_ == request_line)
+    return parseRequestLine(req, begin, end);
+  else if (begin == end)
+    return headersComplete(req);
+  else
+    return parseHeaderLine(req, begin, end);
+}
+
+RequestParser::status RequestParser::parseRequestLine(Request& req,
+                                                      const char* begin,
+                                                      const char* end)
+{
+  // method
+  const char* methodEnd = static_cast<const char*>(
+                                 std::memchr(begin, ' ', end - begin));
+  if (methodEnd == NULL || !is_token(begin, methodEnd))
+    return error;
+  req.method_.assign(begin, methodEnd);
+
+  // uri
+  const char* uriBegin = methodEnd + 1;
+  const char* uriEnd = static_cast<const char*>(
+                           std::memchr(uriBegin, ' ', end - uriBegin));
+  if (uriEnd == NULL || uriEnd == uriBegin)
+    return error;
+  for (const char* p = uriBegin; p != uriEnd; ++p)
+  {
+    if (is_ctl(*p))
       return error;
-    }
-    else
-    {
-      state_ = header_value;
-      req.headers_.back().value.push_back(input);
-      return incomplete;
-    }
-  case header_name:
-    if (input == ':')
-    {
-      state_ = space_before_header_value;
-      
-      // look for special content-length state
-      if ( !req.headers_.back().name.compare("Content-Length") )
-         parsing_content_length_ = true ;
+  }
+  req.uri_.assign(uriBegin, uriEnd);
 
-      return incomplete;
-    }
-    else if (!is_char(input) || is_ctl(input) || is_tspecial(input))
-    {
+  // http version
+  const char* p = uriEnd + 1;
+  if (end - p < 5 || std::memcmp(p, "HTTP/", 5) != 0)
+    return error;
+  p += 5;
+
+  req.httpVersionMajor_ = 0;
+  req.httpVersionMinor_ = 0;
+  if (p == end || !is_digit(*p))
+    return error;
+  while (p != end && is_digit(*p))
+    req.httpVersionMajor_ = req.httpVersionMajor_ * 10 + *p++ - '0';
+  if (p == end || *p++ != '.')
+    return error;
+  if (p == end || !is_digit(*p))
+    return error;
+  while (p != end && is_digit(*p))
+    req.httpVersionMinor_ = req.httpVersionMinor_ * 10 + *p++ - '0';
+  if (p != end)
+    return error;
+
+  state_ = header_line;
+  return incomplete;
+}
+
+RequestParser::status RequestParser::parseHeaderLine(Request& req,
+                                                     const char* begin,
+                                                     const char* end)
+{
+  // continuation of the previous header's value
+  if (*begin == ' ' || *begin == '\t')
+  {
+    if (req.headers_.empty())
       return error;
-    }
-    else
-    {
-      req.headers_.back().name.push_back(input);
-      return incomplete;
-    }
-  case space_before_header_value:
-    if (input == ' ')
-    {
-      state_ = header_value;
-      return incomplete;
-    }
-    else
+
+    while (begin != end && (*begin == ' ' || *begin == '\t'))
+      ++begin;
+    for (const char* p = begin; p != end; ++p)
     {
-      return error;
+      if (is_ctl(*p) && *p != '\t')
+        return error;
     }
-  case header_value:
-    if (input == '\r')
-    {
-      state_ = expecting_newline_2;
+    req.headers_.back().value.append(begin, end);
+    return incomplete;
+  }
 
-      // if this header was Content-Length then save it
-      if (parsing_content_length_)
-      {
-         content_length_ = boost::lexical_cast<int>(req.headers_.back().value);
-         parsing_content_length_ = false ;
-      }
+  // name
+  const char* colon = static_cast<const char*>(
+                               std::memchr(begin, ':', end - begin));
+  if (colon == NULL || !is_token(begin, colon))
+    return error;
 
-      return incomplete;
-    }
-    else if (is_ctl(input))
-    {
+  // value
+  const char* value = colon + 1;
+  while (value != end && (*value == ' ' || *value == '\t'))
+    ++value;
+  for (const char* p = value; p != end; ++p)
+  {
+    if (is_ctl(*p) && *p != '\t')
       return error;
-    }
-    else
-    {
-      req.headers_.back().value.push_back(input);
-      return incomplete;
-    }
-  case expecting_newline_2:
-    if (input == '\n')
-    {
-      state_ = header_line_start;
-      return incomplete;
-    }
-    else
-    {
+  }
+
+  req.headers_.push_back(Header(std::string(begin, colon),
+                                std::string(value, end)));
+
+  // note the content length
+  if (boost::algorithm::iequals(req.headers_.back().name, "Content-Length"))
+  {
+    if (value == end)
       return error;
-    }
-  case expecting_newline_3:
-    if ( input == '\n' )
+
+    std::size_t length = 0;
+    for (const char* p = value; p != end; ++p)
     {
-      return complete ;
+      if (!is_digit(*p))
+        return error;
+      std::size_t next = length * 10 + (*p - '0');
+      if (next / 10 != length)
+        return error;
+      length = next;
     }
-    else
+    content_length_ = length;
+  }
+
+  return incomplete;
+}
+
+RequestParser::status RequestParser::headersComplete(Request& req)
+{
+  if (content_length_ == 0)
+    return complete;
+
+  if (maxBodySize_)
+  {
+    std::size_t maxBodySize = maxBodySize_(req);
+    if (maxBodySize > 0 && content_length_ > maxBodySize)
     {
-      return error ;
+      // read (and discard) the body anyway so that the client, which
+      // won't look for a response until it has sent the whole request,
+      // gets the response rather than a reset connection
+      bodyTooLarge_ = true;
     }
-  default:
-    return error;
   }
+
+  // size the body once rather than growing it as chunks arrive
+  if (!bodyTooLarge_)
+    req.body_.reserve(std::min(content_length_, kMaxBodyReserve));
+
+  state_ = body;
+  body_received_ = 0;
+  return incomplete;
 }
 
 bool RequestParser::is_char(int c)
@@ -355,5 +290,18 @@ bool RequestParser::is_digit(int c)
   return c >= '0' && c <= '9';
 }
 
+bool RequestParser::is_token(const char* begin, const char* end)
+{
+  if (begin == end)
+    return false;
+
+  for (const char* p = begin; p != end; ++p)
+  {
+    if (!is_char(*p) || is_ctl(*p) || is_tspecial(*p))
+      return false;
+  }
+  return true;
+}
+
 } // namespace http
 } // namespace core
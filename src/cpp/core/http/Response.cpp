@@ -27,6 +27,7 @@
 #include <core/http/URL.hpp>
 #include <core/http/Util.hpp>
 #include <core/http/Cookie.hpp>
+#include <core/http/FileCache.hpp>
 #include <core/Hash.hpp>
 
 #include <core/FileSerializer.hpp>
@@ -35,7 +36,8 @@ namespace core {
 namespace http {
 
 Response::Response() 
-   : Message(), statusCode_(status::Ok) 
+   : Message(), statusCode_(status::Ok), bodyFileOffset_(0),
+     bodyFileLength_(0)
 {
 }   
    
@@ -142,71 +144,132 @@ void Response::setDynamicHtml(const std::string& html,
 void Response::setRangeableFile(const FilePath& filePath,
                                 const Request& request)
 {
-   // read the file in from disk
-   std::string contents;
-   Error error = core::readStringFromFile(filePath, &contents);
-   if (error)
+   // ensure that the file exists
+   if (!filePath.exists())
    {
-      setError(error);
+      setError(http::status::NotFound, request.uri() + " not found");
       return;
    }
 
    // set content type
    setContentType(filePath.mimeContentType());
+   addHeader("Accept-Ranges", "bytes");
+
+   // note that we never gzip here: a compressed slice isn't a byte range
+   // of the file and the whole point is to avoid touching the rest of it
+   removeHeader("Content-Encoding");
+   boost::uint64_t total = filePath.size();
 
-   // parse the range field
+   // no range requested, send the whole file
    std::string range = request.headerValue("Range");
+   if (range.empty())
+   {
+      setBodyFile(filePath, 0, total);
+      return;
+   }
+
+   // parse the range field (we only support a single range)
    boost::regex re("bytes=(\\d*)\\-(\\d*)");
    boost::smatch match;
-   if (boost::regex_match(range, match, re))
+   bool satisfiable = false;
+   boost::uint64_t begin = 0, end = 0;
+   if (boost::regex_match(range, match, re) && total > 0)
    {
-      // specify partial content
-      setStatusCode(http::status::PartialContent);
-
-      // determine the byte range
-      const size_t kNone = -1;
-      size_t begin = safe_convert::stringTo<size_t>(match[1], kNone);
-      size_t end = safe_convert::stringTo<size_t>(match[2], kNone);
-      size_t total = contents.length();
+      const boost::uint64_t kNone = -1;
+      begin = safe_convert::stringTo<boost::uint64_t>(match[1], kNone);
+      end = safe_convert::stringTo<boost::uint64_t>(match[2], kNone);
 
-      if (end == kNone)
-      {
-         end = total-1;
-      }
-      if (begin == kNone)
+      // suffix range (the last n bytes)
+      if (begin == kNone && end != kNone)
       {
-         begin = total - end;
-         end = total-1;
+         begin = total - std::min(end, total);
+         end = total - 1;
       }
 
-      // set the byte range
-      addHeader("Accept-Ranges", "bytes");
+      // open ended range or one extending past the end of the file
+      if (end == kNone || end >= total)
+         end = total - 1;
+
+      satisfiable = begin != kNone && begin <= end;
+   }
+
+   if (satisfiable)
+   {
+      // specify partial content
+      setStatusCode(http::status::PartialContent);
       boost::format fmt("bytes %1%-%2%/%3%");
-      std::string range = boost::str(fmt % begin % end % contents.length());
-      addHeader("Content-Range", range);
-
-      // always attempt gzip
-      if (request.acceptsEncoding(http::kGzipEncoding))
-         setContentEncoding(http::kGzipEncoding);
-
-      // set body
-      if (begin == 0 && end == (contents.length()-1))
-         setBody(contents);
-      else
-         setBody(contents.substr(begin, end-begin));
+      addHeader("Content-Range", boost::str(fmt % begin % end % total));
+
+      // set body (the range is inclusive)
+      setBodyFile(filePath, begin, end - begin + 1);
    }
    else
    {
       setStatusCode(http::status::RangeNotSatisfiable);
       boost::format fmt("bytes */%1%");
-      std::string range = boost::str(fmt % contents.length());
-      addHeader("Content-Range", range);
+      addHeader("Content-Range", boost::str(fmt % total));
    }
 }
-   
+
+void Response::setBodyFile(const FilePath& filePath,
+                           boost::uint64_t offset,
+                           boost::uint64_t length)
+{
+   body_.clear();
+   bodyFile_ = filePath;
+   bodyFileOffset_ = offset;
+   bodyFileLength_ = length;
+
+   // setContentLength takes an int which won't do for large files
+   setHeader("Content-Length", boost::lexical_cast<std::string>(length));
+}
+
+void Response::setCachedFile(const FilePath& filePath, const Request& request)
+{
+   boost::shared_ptr<const CachedFile> pFile;
+   Error error = cachedFile(filePath, &pFile);
+   if (error)
+   {
+      setError(status::InternalServerError, error.code().message());
+      return;
+   }
+
+   // send the gzipped contents if we can (they are only created now that
+   // they're needed). the gzipped and raw contents are different
+   // representations so they have different ETags (and caches need to
+   // know the choice between them depends on Accept-Encoding)
+   bool gzipped = request.acceptsEncoding(kGzipEncoding) &&
+                  CachedFile::gzipSupported() &&
+                  !pFile->gzippedContents().empty();
+   std::string eTag = pFile->eTag() + (gzipped ? "-gzip" : "");
+   setHeader("Vary", "Accept-Encoding");
+
+   // validate using the ETag
+   setHeader("ETag", eTag);
+   if (eTag == request.headerValue("If-None-Match"))
+   {
+      removeHeader("Content-Type"); // upstream code may have set this
+      setStatusCode(status::NotModified);
+      return;
+   }
+
+   if (gzipped)
+   {
+      setContentEncoding(kGzipEncoding);
+      body_ = pFile->gzippedContents();
+   }
+   else
+   {
+      removeHeader("Content-Encoding");
+      body_ = pFile->contents();
+   }
+   setContentLength(body_.length());
+}
+
 void Response::setBodyUnencoded(const std::string& body)
 {
    removeHeader("Content-Encoding");
+   bodyFile_ = FilePath();
    body_ = body;
    setContentLength(body_.length());
 }
@@ -263,6 +326,9 @@ void Response::resetMembers()
 	statusCode_ = status::Ok ;
 	statusCodeStr_.clear() ;
 	statusMessage_.clear() ;
+   bodyFile_ = FilePath();
+   bodyFileOffset_ = 0;
+   bodyFileLength_ = 0;
 }
    
 void Response::removeCachingHeaders()
@@ -405,6 +471,53 @@ void Response::ensureStatusMessage() const
 }
 
 
+namespace {
+
+// size of the chunks in which file bodies are read and written
+const boost::uint64_t kBodyFileChunkSize = 64 * 1024;
+
+} // anonymous namespace
+
+Error BodyFileReader::open()
+{
+   Error error = filePath_.open_r(&pStream_);
+   if (error)
+      return error;
+
+   pStream_->seekg(static_cast<std::streamoff>(offset_));
+   if (!(*pStream_))
+   {
+      error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      error.addProperty("path", filePath_.absolutePath());
+      return error;
+   }
+
+   return Success();
+}
+
+Error BodyFileReader::readChunk(std::vector<char>* pBuffer)
+{
+   std::size_t size = static_cast<std::size_t>(
+                              std::min(remaining_, kBodyFileChunkSize));
+   pBuffer->resize(size);
+   if (size == 0)
+      return Success();
+
+   // a short read means the file was truncated after the headers
+   // (including Content-Length) were determined
+   pStream_->read(&(*pBuffer)[0], size);
+   if (static_cast<std::size_t>(pStream_->gcount()) != size)
+   {
+      Error error = systemError(boost::system::errc::io_error,
+                                ERROR_LOCATION);
+      error.addProperty("path", filePath_.absolutePath());
+      return error;
+   }
+
+   remaining_ -= size;
+   return Success();
+}
+
 std::ostream& operator << (std::ostream& stream, const Response& r)
 {
 	// output status line
@@ -18,9 +18,34 @@
 
 #include <string>
 
+#include <boost/cstdint.hpp>
+
 namespace core {
 namespace hash {
-   
+
+// crc32 of a sequence of buffers: start with a crc of 0 and pass the
+// result of each call to the next
+boost::uint32_t crc32Update(boost::uint32_t crc,
+                            const char* data,
+                            std::size_t length);
+
+boost::uint32_t crc32Checksum(const std::string& content);
+
+// crc32 of the concatenation of two buffers given the crc32 of each
+boost::uint32_t crc32Combine(boost::uint32_t crc1,
+                             boost::uint32_t crc2,
+                             std::size_t length2);
+
+// crc32 of content after [offset, offset+length) is replaced with
+// replacement, given the crc32 of content. only the replaced range, the
+// replacement, and the shorter of the content before or after the range
+// are processed
+boost::uint32_t crc32Splice(boost::uint32_t crc,
+                            const std::string& content,
+                            std::size_t offset,
+                            std::size_t length,
+                            const std::string& replacement);
+
 std::string crc32Hash(const std::string& content);
 
 std::string crc32HexHash(const std::string& content);
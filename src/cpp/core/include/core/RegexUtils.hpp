@@ -31,6 +31,17 @@ namespace regex_utils {
 // into a regulard expression
 boost::regex wildcardPatternToRegex(const std::string& pattern);
 
+// convert a (UTF-8) pattern in grep's basic regular expression syntax,
+// including the GNU extensions (e.g. \| \+ \? \< \> \b \w \s), into the
+// equivalent pattern in boost's perl syntax. if ignoreCase is true then
+// non-ASCII characters also match their other case (the regex should still
+// be compiled with icase for ASCII characters)
+std::string grepPatternToRegex(const std::string& pattern, bool ignoreCase);
+
+// convert a (UTF-8) literal into a perl syntax regex which matches it
+// (with the same handling of ignoreCase as grepPatternToRegex)
+std::string literalToRegex(const std::string& literal, bool ignoreCase);
+
 
 bool textMatches(const std::string& text,
                  const boost::regex& regex,
@@ -16,8 +16,10 @@
 #ifndef CORE_HTTP_ASYNC_CLIENT_HPP
 #define CORE_HTTP_ASYNC_CLIENT_HPP
 
+#include <boost/array.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/enable_shared_from_this.hpp>
 
 #include <boost/asio/write.hpp>
@@ -30,6 +32,7 @@
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
+#include <core/SafeConvert.hpp>
 
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
@@ -56,6 +59,19 @@ namespace http {
 typedef boost::function<void(const http::Response&)> ResponseHandler;
 typedef boost::function<void(const core::Error&)> ErrorHandler;
 
+// streaming responses: the headers handler is called with the response
+// headers (and any content which arrived along with them) and the content
+// handler with each subsequent chunk of content. no further content is read
+// until the handler calls the supplied ReadContentFunction (so a slow
+// consumer throttles the producer). the final call to the content handler
+// has complete set to true (and an empty chunk)
+typedef boost::function<void()> ReadContentFunction;
+typedef boost::function<void(const http::Response&,
+                             const ReadContentFunction&)> StreamHeadersHandler;
+typedef boost::function<void(const std::string&,
+                             bool,
+                             const ReadContentFunction&)> StreamContentHandler;
+
 
 template <typename SocketService>
 class AsyncClient :
@@ -65,7 +81,14 @@ class AsyncClient :
 public:
    AsyncClient(boost::asio::io_service& ioService)
       : ioService_(ioService),
-        connectionRetryContext_(ioService)
+        connectionRetryContext_(ioService),
+        keepAlive_(false),
+        reusedConnection_(false),
+        contentLength_(0),
+        contentLengthDelimited_(false),
+        contentBytesRead_(0),
+        streaming_(false),
+        streamStarted_(false)
    {
    }
 
@@ -97,6 +120,22 @@ public:
       connectAndWriteRequest();
    }
 
+   // execute the async client, streaming the response content to the
+   // handlers as it is read rather than buffering all of it. errors which
+   // occur before the headers are delivered go to the error handler;
+   // after that they are logged and end the stream
+   void executeStreaming(const StreamHeadersHandler& headersHandler,
+                         const StreamContentHandler& contentHandler,
+                         const ErrorHandler& errorHandler)
+   {
+      streaming_ = true;
+      streamHeadersHandler_ = headersHandler;
+      streamContentHandler_ = contentHandler;
+      errorHandler_ = errorHandler;
+
+      connectAndWriteRequest();
+   }
+
    void close()
    {
       Error error = closeSocket(socket().lowest_layer());
@@ -110,6 +149,24 @@ protected:
 
    virtual SocketService& socket() = 0;
 
+   // ask the server to keep the connection open after the response. if it
+   // agrees (and delimits the response with Content-Length) the connection
+   // is handed to releaseConnection rather than being closed
+   void setKeepAlive(bool keepAlive) { keepAlive_ = keepAlive; }
+
+   // subclasses call this when the connection they are about to write the
+   // request on was previously used (e.g. taken from a pool). if such a
+   // connection fails before any of the response is read then we assume it
+   // was closed by the server while idle and connect again
+   void setReusedConnection(bool reused) { reusedConnection_ = reused; }
+
+   // called with a kept-alive connection once the response has been fully
+   // read (default implementation just closes it)
+   virtual void releaseConnection()
+   {
+      close();
+   }
+
    void handleConnectionError(const Error& connectionError)
    {
       // retry if necessary, otherwise just forward the error to
@@ -126,7 +183,8 @@ protected:
       // write
       boost::asio::async_write(
           socket(),
-          request_.toBuffers(Header::connectionClose()),
+          request_.toBuffers(keepAlive_ ? Header("Connection", "keep-alive") :
+                                          Header::connectionClose()),
           boost::bind(
                &AsyncClient<SocketService>::handleWrite,
                AsyncClient<SocketService>::shared_from_this(),
@@ -139,8 +197,19 @@ protected:
       // close the socket
       close();
 
-      if (errorHandler_)
+      // once we've started streaming the consumer has already committed
+      // to the response so just end the stream
+      if (streamStarted_)
+      {
+         if (!http::isConnectionTerminatedError(error))
+            LOG_ERROR(error);
+
+         endStream();
+      }
+      else if (errorHandler_)
+      {
          errorHandler_(error);
+      }
    }
 
    void handleErrorCode(const boost::system::error_code& ec,
@@ -202,6 +271,19 @@ private:
    }
 
 
+   bool retryIfStaleConnection()
+   {
+      if (!reusedConnection_ || responseBuffer_.size() > 0)
+         return false;
+
+      // discard the stale connection and connect again
+      reusedConnection_ = false;
+      close();
+      responseBuffer_.consume(responseBuffer_.size());
+      connectAndWriteRequest();
+      return true;
+   }
+
    bool scheduleRetry()
    {
       // set expiration
@@ -261,7 +343,7 @@ private:
                           AsyncClient<SocketService>::shared_from_this(),
                           boost::asio::placeholders::error));
          }
-         else
+         else if (!retryIfStaleConnection())
          {
             handleErrorCode(ec, ERROR_LOCATION);
          }
@@ -273,6 +355,12 @@ private:
    {
       try
       {
+         if (ec && retryIfStaleConnection())
+            return;
+
+         // we are now committed to this connection
+         reusedConnection_ = false;
+
          if (!ec)
          {
             // parase status line
@@ -304,6 +392,17 @@ private:
 
    void readSomeContent()
    {
+      if (streaming_)
+      {
+         socket().async_read_some(
+            boost::asio::buffer(streamBuffer_),
+            boost::bind(&AsyncClient<SocketService>::handleStreamContent,
+                        AsyncClient<SocketService>::shared_from_this(),
+                        boost::asio::placeholders::error,
+                        boost::asio::placeholders::bytes_transferred));
+         return;
+      }
+
       boost::asio::async_read(
          socket(),
          responseBuffer_,
@@ -325,9 +424,35 @@ private:
             // append any lefover buffer contents to the body
             if (responseBuffer_.size() > 0)
                ResponseParser::appendToBody(&responseBuffer_, &response_);
+            contentBytesRead_ = response_.body().size();
+
+            // if the server agreed to keep the connection alive then the
+            // content is delimited by Content-Length (rather than eof)
+            std::string contentLength = response_.headerValue("Content-Length");
+            contentLengthDelimited_ =
+                  keepAlive_ &&
+                  !contentLength.empty() &&
+                  boost::algorithm::iequals(
+                        response_.headerValue("Connection"), "keep-alive");
+            if (contentLengthDelimited_)
+            {
+               contentLength_ = safe_convert::stringTo<std::size_t>(
+                                                         contentLength, 0);
+            }
+
+            // deliver the headers if we are streaming
+            if (streaming_)
+            {
+               streamStarted_ = true;
+               if (streamHeadersHandler_)
+               {
+                  streamHeadersHandler_(response_, readContentFunction());
+                  return;
+               }
+            }
 
             // start reading content
-            readSomeContent();
+            readNextContent();
          }
          else
          {
@@ -344,18 +469,47 @@ private:
          if (!ec)
          {
             // copy content
+            contentBytesRead_ += responseBuffer_.size();
             ResponseParser::appendToBody(&responseBuffer_, &response_);
 
             // continue reading content
-            readSomeContent();
+            readNextContent();
          }
          else if (ec == boost::asio::error::eof ||
                   isShutdownError(ec))
          {
-            close();
+            handleResponseComplete(false);
+         }
+         else
+         {
+            handleErrorCode(ec, ERROR_LOCATION);
+         }
+      }
+      CATCH_UNEXPECTED_ASYNC_CLIENT_EXCEPTION
+   }
 
-            if (responseHandler_)
-               responseHandler_(response_);
+   void handleStreamContent(const boost::system::error_code& ec,
+                            std::size_t bytesTransferred)
+   {
+      try
+      {
+         if (!ec)
+         {
+            // hand the chunk to the consumer (who will tell us when
+            // to read the next one)
+            contentBytesRead_ += bytesTransferred;
+            if (streamContentHandler_)
+            {
+               streamContentHandler_(std::string(streamBuffer_.data(),
+                                                 bytesTransferred),
+                                     false,
+                                     readContentFunction());
+            }
+         }
+         else if (ec == boost::asio::error::eof ||
+                  isShutdownError(ec))
+         {
+            handleResponseComplete(false);
          }
          else
          {
@@ -365,6 +519,55 @@ private:
       CATCH_UNEXPECTED_ASYNC_CLIENT_EXCEPTION
    }
 
+   ReadContentFunction readContentFunction()
+   {
+      return boost::bind(&AsyncClient<SocketService>::readNextContent,
+                         AsyncClient<SocketService>::shared_from_this());
+   }
+
+   void readNextContent()
+   {
+      try
+      {
+         if (isContentComplete())
+            handleResponseComplete(true);
+         else
+            readSomeContent();
+      }
+      CATCH_UNEXPECTED_ASYNC_CLIENT_EXCEPTION
+   }
+
+   bool isContentComplete() const
+   {
+      return contentLengthDelimited_ && contentBytesRead_ >= contentLength_;
+   }
+
+   void handleResponseComplete(bool connectionReusable)
+   {
+      if (connectionReusable)
+         releaseConnection();
+      else
+         close();
+
+      if (streaming_)
+         endStream();
+      else if (responseHandler_)
+         responseHandler_(response_);
+   }
+
+   void endStream()
+   {
+      // notify the consumer once (then drop the handlers since they
+      // typically hold references to the consumer)
+      if (streamContentHandler_)
+      {
+         StreamContentHandler contentHandler = streamContentHandler_;
+         streamContentHandler_ = StreamContentHandler();
+         streamHeadersHandler_ = StreamHeadersHandler();
+         contentHandler(std::string(), true, ReadContentFunction());
+      }
+   }
+
    virtual bool isShutdownError(const boost::system::error_code& ec)
    {
       return false;
@@ -393,6 +596,18 @@ private:
    http::Request request_;
    boost::asio::streambuf responseBuffer_;
    http::Response response_;
+   bool keepAlive_;
+   bool reusedConnection_;
+   std::size_t contentLength_;
+   bool contentLengthDelimited_;
+   std::size_t contentBytesRead_;
+
+   // streaming state
+   bool streaming_;
+   bool streamStarted_;
+   StreamHeadersHandler streamHeadersHandler_;
+   StreamContentHandler streamContentHandler_;
+   boost::array<char, 16384> streamBuffer_;
 };
    
 
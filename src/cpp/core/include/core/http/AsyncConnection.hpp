@@ -16,7 +16,10 @@
 #ifndef CORE_HTTP_ASYNC_CONNECTION_HPP
 #define CORE_HTTP_ASYNC_CONNECTION_HPP
 
+#include <string>
+
 #include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
 #include <boost/asio/io_service.hpp>
 
 namespace core {
@@ -28,6 +31,9 @@ namespace http {
 class Request;
 class Response;
 
+// called when a streamed write completes (or fails)
+typedef boost::function<void(const Error&)> WriteHandler;
+
 // abstract base (insulate clients from knowledge of protocol-specifics)
 class AsyncConnection
 {
@@ -47,6 +53,15 @@ public:
    // simple wrappers for writing an existing response or error
    virtual void writeResponse(const http::Response& response) = 0;
    virtual void writeError(const Error& error) = 0;
+
+   // streaming responses: populate the response then write its headers
+   // (along with any body it already has), then write further content as
+   // it becomes available. each write calls its handler when complete and
+   // only one write may be outstanding at a time. call close when done
+   virtual void writeResponseHeaders(const WriteHandler& handler) = 0;
+   virtual void writeResponseContent(const std::string& content,
+                                     const WriteHandler& handler) = 0;
+   virtual void close() = 0;
 };
 
 } // namespace http
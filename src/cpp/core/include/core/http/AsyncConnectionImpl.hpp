@@ -16,8 +16,11 @@
 #ifndef CORE_HTTP_ASYNC_CONNECTION_IMPL_HPP
 #define CORE_HTTP_ASYNC_CONNECTION_IMPL_HPP
 
+#include <vector>
+
 #include <boost/array.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/function.hpp>
 #include <boost/enable_shared_from_this.hpp>
 
@@ -89,13 +92,36 @@ public:
 
    virtual void writeResponse()
    {
+      // file bodies are streamed from disk after the headers (open the
+      // file up front so we can still respond with an error if need be)
+      if (response_.hasBodyFile())
+      {
+         pBodyFileReader_.reset(new BodyFileReader(response_));
+         Error error = pBodyFileReader_->open();
+         if (error)
+         {
+            LOG_ERROR(error);
+            pBodyFileReader_.reset();
+            response_.setError(error);
+         }
+      }
+
       // add extra response headers
-      response_.setHeader("Date", util::httpDate());
-      response_.setHeader("Connection", "close");
+      prepareResponse();
 
-      // call the response filter if we have one
-      if (responseFilter_)
-         responseFilter_(&response_);
+      // write headers then the file body
+      if (pBodyFileReader_)
+      {
+         boost::asio::async_write(
+             socket_,
+             response_.toBuffers(),
+             boost::bind(
+                  &AsyncConnectionImpl<ProtocolType>::handleBodyFileWrite,
+                  AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+                  boost::asio::placeholders::error)
+         );
+         return;
+      }
 
       // write
       boost::asio::async_write(
@@ -119,8 +145,61 @@ public:
       response_.setError(error);
       writeResponse();
    }
+
+   virtual void writeResponseHeaders(const WriteHandler& handler)
+   {
+      // add extra response headers
+      prepareResponse();
+
+      // write
+      boost::asio::async_write(
+          socket_,
+          response_.toBuffers(),
+          boost::bind(
+               &AsyncConnectionImpl<ProtocolType>::handleStreamWrite,
+               AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+               handler,
+               boost::asio::placeholders::error)
+      );
+   }
+
+   virtual void writeResponseContent(const std::string& content,
+                                     const WriteHandler& handler)
+   {
+      // copy to stable storage for the duration of the write
+      streamContent_ = content;
+
+      // write
+      boost::asio::async_write(
+          socket_,
+          boost::asio::buffer(streamContent_),
+          boost::bind(
+               &AsyncConnectionImpl<ProtocolType>::handleStreamWrite,
+               AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+               handler,
+               boost::asio::placeholders::error)
+      );
+   }
+
+   virtual void close()
+   {
+      Error error = closeSocket(socket_);
+      if (error)
+         LOG_ERROR(error);
+   }
    
 private:
+
+   void prepareResponse()
+   {
+      // add extra response headers
+      response_.setHeader("Date", util::httpDate());
+      response_.setHeader("Connection", "close");
+
+      // call the response filter if we have one
+      if (responseFilter_)
+         responseFilter_(&response_);
+   }
    
    void handleRead(const boost::system::error_code& e,
                    std::size_t bytesTransferred)
@@ -202,6 +281,63 @@ private:
       CATCH_UNEXPECTED_EXCEPTION
    }
    
+   void handleBodyFileWrite(const boost::system::error_code& e)
+   {
+      try
+      {
+         // done (or failed) so finish up as with any other response
+         if (e || pBodyFileReader_->finished())
+         {
+            pBodyFileReader_.reset();
+            handleWrite(e);
+            return;
+         }
+
+         // write the next chunk from the file
+         Error error = pBodyFileReader_->readChunk(&bodyFileBuffer_);
+         if (error)
+         {
+            // the headers are already out so all we can do is truncate
+            // the response by closing the socket
+            LOG_ERROR(error);
+            pBodyFileReader_.reset();
+            close();
+            return;
+         }
+
+         boost::asio::async_write(
+             socket_,
+             boost::asio::buffer(bodyFileBuffer_),
+             boost::bind(
+                  &AsyncConnectionImpl<ProtocolType>::handleBodyFileWrite,
+                  AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+                  boost::asio::placeholders::error)
+         );
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   void handleStreamWrite(const WriteHandler& handler,
+                          const boost::system::error_code& e)
+   {
+      try
+      {
+         // on error close the socket (the handler will stop streaming)
+         Error error;
+         if (e)
+         {
+            error = Error(e, ERROR_LOCATION);
+            close();
+         }
+
+         // release the content then notify the handler
+         streamContent_.clear();
+         if (handler)
+            handler(error);
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
    void readSome()
    {
       socket_.async_read_some(
@@ -223,6 +359,9 @@ private:
    RequestParser requestParser_ ;
    http::Request request_;
    http::Response response_;
+   std::string streamContent_;
+   boost::scoped_ptr<BodyFileReader> pBodyFileReader_;
+   std::vector<char> bodyFileBuffer_;
 };
    
 
@@ -53,6 +53,8 @@ public:
    AsyncServer(const std::string& serverName,
                const std::string& baseUri = std::string())
       : abortOnResourceError_(false),
+        ioServicePerThread_(false),
+        nextIoService_(0),
         serverName_(serverName),
         baseUri_(baseUri),
         acceptorService_(),
@@ -71,6 +73,16 @@ public:
       abortOnResourceError_ = abortOnResourceError;
    }
    
+   // give each thread in the pool its own io_service (rather than sharing
+   // a single io_service across the pool) and hand accepted connections to
+   // the threads round-robin. this avoids contention between the threads
+   // over the shared io_service when the pool is large
+   void setIoServicePerThread(bool ioServicePerThread)
+   {
+      BOOST_ASSERT(!running_);
+      ioServicePerThread_ = ioServicePerThread;
+   }
+
    void addHandler(const std::string& prefix,
                    const AsyncUriHandlerFunction& handler)
    {
@@ -113,6 +125,22 @@ public:
          // update state
          running_ = true;
 
+         // create an io_service for each additional thread if requested
+         // (the first thread runs the acceptor's io_service). work objects
+         // keep them running while they have no connections
+         if (ioServicePerThread_)
+         {
+            for (std::size_t i=1; i < threadPoolSize; ++i)
+            {
+               boost::shared_ptr<boost::asio::io_service> pIoService(
+                                             new boost::asio::io_service());
+               connectionIoServices_.push_back(pIoService);
+               connectionIoServiceWork_.push_back(
+                     boost::shared_ptr<boost::asio::io_service::work>(
+                           new boost::asio::io_service::work(*pIoService)));
+            }
+         }
+
          // get ready for next connection
          acceptNextConnection();
 
@@ -132,7 +160,8 @@ public:
             // run the thread
             boost::shared_ptr<boost::thread> pThread(new boost::thread(
                               &AsyncServer<ProtocolType>::runServiceThread,
-                              this));
+                              this,
+                              boost::ref(threadIoService(i))));
             
             // add to list of threads
             threads_.push_back(pThread);            
@@ -157,6 +186,9 @@ public:
       
       // stop the server 
       acceptorService_.ioService().stop();
+      connectionIoServiceWork_.clear();
+      for (std::size_t i=0; i < connectionIoServices_.size(); ++i)
+         connectionIoServices_[i]->stop();
 
       // update state
       running_ = false;
@@ -172,12 +204,28 @@ public:
    
 private:
 
-   void runServiceThread()
+   boost::asio::io_service& threadIoService(std::size_t thread)
+   {
+      if (thread == 0 || connectionIoServices_.empty())
+         return acceptorService_.ioService();
+      else
+         return *connectionIoServices_[thread - 1];
+   }
+
+   boost::asio::io_service& nextConnectionIoService()
+   {
+      // round-robin (only ever called from the acceptor's io_service)
+      std::size_t ioServices = connectionIoServices_.size() + 1;
+      nextIoService_ = (nextIoService_ + 1) % ioServices;
+      return threadIoService(nextIoService_);
+   }
+
+   void runServiceThread(boost::asio::io_service& ioService)
    {
       try
       {
          boost::system::error_code ec;
-         acceptorService_.ioService().run(ec);
+         ioService.run(ec);
          if (ec)
             LOG_ERROR(Error(ec, ERROR_LOCATION));
       }
@@ -190,7 +238,7 @@ private:
       ptrNextConnection_.reset(new AsyncConnectionImpl<ProtocolType>(
                                                                  
          // controlling io_service
-         acceptorService_.ioService(),
+         nextConnectionIoService(),
 
          // connection handler
          boost::bind(&AsyncServer<ProtocolType>::handleConnection,
@@ -415,6 +463,12 @@ private:
 
 private:
    bool abortOnResourceError_;
+   bool ioServicePerThread_;
+   std::vector<boost::shared_ptr<boost::asio::io_service> >
+                                                   connectionIoServices_;
+   std::vector<boost::shared_ptr<boost::asio::io_service::work> >
+                                                   connectionIoServiceWork_;
+   std::size_t nextIoService_;
    std::string serverName_;
    std::string baseUri_;
    boost::shared_ptr<AsyncConnectionImpl<ProtocolType> > ptrNextConnection_;
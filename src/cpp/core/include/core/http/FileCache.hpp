@@ -0,0 +1,84 @@
+/*
+ * FileCache.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_HTTP_FILE_CACHE_HPP
+#define CORE_HTTP_FILE_CACHE_HPP
+
+#include <ctime>
+#include <string>
+
+#include <boost/utility.hpp>
+#include <boost/optional.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/Thread.hpp>
+
+namespace core {
+namespace http {
+
+// The contents of a file prepared for serving: the raw bytes, a strong
+// ETag, and (computed the first time they are asked for) the gzipped bytes
+// and whether the contents are valid UTF-8. Instances can be shared
+// between threads.
+class CachedFile : boost::noncopyable
+{
+public:
+   CachedFile(const std::string& contents,
+              std::time_t lastWriteTime);
+
+   // whether gzippedContents is supported on this platform
+   static bool gzipSupported();
+
+   const std::string& contents() const { return contents_; }
+
+   // empty if compression isn't supported on this platform (or failed)
+   const std::string& gzippedContents() const;
+
+   const std::string& eTag() const { return eTag_; }
+
+   bool isUtf8() const;
+
+   std::time_t lastWriteTime() const { return lastWriteTime_; }
+
+private:
+   const std::string contents_;
+   const std::string eTag_;
+   const std::time_t lastWriteTime_;
+
+   // computed on demand (protected by mutex_)
+   mutable boost::mutex mutex_;
+   mutable boost::optional<std::string> gzippedContents_;
+   mutable boost::optional<bool> isUtf8_;
+};
+
+// Get the prepared contents of a file. Files are cached by path (and
+// validated against their size and modification time) so that repeated
+// requests don't re-read or re-compress them. Large files and files which
+// were modified within the last couple of seconds are prepared but not
+// retained.
+Error cachedFile(const FilePath& filePath,
+                 boost::shared_ptr<const CachedFile>* ppFile);
+
+// Determine whether a file is valid UTF-8 (using the cached file if there
+// is one; large files are checked a chunk at a time rather than being
+// prepared as a CachedFile)
+Error isUtf8File(const FilePath& filePath, bool* pIsUtf8);
+
+} // namespace http
+} // namespace core
+
+#endif // CORE_HTTP_FILE_CACHE_HPP
@@ -17,6 +17,7 @@
 #define CORE_HTTP_LOCAL_STREAM_ASYNC_CLIENT_HPP
 
 #include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <boost/asio/local/stream_protocol.hpp>
 
@@ -25,6 +26,7 @@
 
 #include <core/http/AsyncClient.hpp>
 #include <core/http/LocalStreamSocketUtils.hpp>
+#include <core/http/LocalStreamConnectionPool.hpp>
 
 namespace core {
 namespace http {  
@@ -34,26 +36,60 @@ class LocalStreamAsyncClient
 {
 public:
    LocalStreamAsyncClient(boost::asio::io_service& ioService,
-                          const FilePath localStreamPath)
+                          const FilePath localStreamPath,
+                          boost::shared_ptr<LocalStreamConnectionPool>
+                                 ptrConnectionPool =
+                                    boost::shared_ptr<LocalStreamConnectionPool>())
      : AsyncClient<boost::asio::local::stream_protocol::socket>(ioService),
-       socket_(ioService),
-       localStreamPath_(localStreamPath)
+       ptrSocket_(new boost::asio::local::stream_protocol::socket(ioService)),
+       localStreamPath_(localStreamPath),
+       ptrConnectionPool_(ptrConnectionPool)
    {
+      // keep connections alive if we have a pool to return them to
+      setKeepAlive(ptrConnectionPool_.get() != NULL);
    }
 
 protected:
 
    virtual boost::asio::local::stream_protocol::socket& socket()
    {
-      return socket_;
+      return *ptrSocket_;
+   }
+
+   virtual void releaseConnection()
+   {
+      if (ptrConnectionPool_)
+         ptrConnectionPool_->checkin(localStreamPath_, ptrSocket_);
+      else
+         close();
    }
 
 private:
 
    virtual void connectAndWriteRequest()
    {
-      // establish endpoint
+      // use an idle pooled connection if one is available
+      if (ptrConnectionPool_)
+      {
+         boost::shared_ptr<boost::asio::local::stream_protocol::socket>
+               ptrPooledSocket = ptrConnectionPool_->checkout(localStreamPath_,
+                                                              ioService());
+         if (ptrPooledSocket)
+         {
+            ptrSocket_ = ptrPooledSocket;
+            setReusedConnection(true);
+            writeRequest();
+            return;
+         }
+      }
+
+      // otherwise use a new socket (the current one may have been
+      // closed by a previous attempt)
       using boost::asio::local::stream_protocol;
+      ptrSocket_.reset(new stream_protocol::socket(ioService()));
+      setReusedConnection(false);
+
+      // establish endpoint
       stream_protocol::endpoint endpoint(localStreamPath_.absolutePath());
 
       // connect
@@ -91,8 +127,9 @@ private:
    }
 
 private:
-   boost::asio::local::stream_protocol::socket socket_;
+   boost::shared_ptr<boost::asio::local::stream_protocol::socket> ptrSocket_;
    core::FilePath localStreamPath_;
+   boost::shared_ptr<LocalStreamConnectionPool> ptrConnectionPool_;
 };
    
    
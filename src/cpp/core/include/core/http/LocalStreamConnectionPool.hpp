@@ -0,0 +1,246 @@
+/*
+ * LocalStreamConnectionPool.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_HTTP_LOCAL_STREAM_CONNECTION_POOL_HPP
+#define CORE_HTTP_LOCAL_STREAM_CONNECTION_POOL_HPP
+
+#include <map>
+#include <list>
+#include <utility>
+#include <algorithm>
+#include <string>
+
+#include <boost/array.hpp>
+#include <boost/bind.hpp>
+#include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/placeholders.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/Log.hpp>
+#include <core/Thread.hpp>
+
+#include <core/http/SocketUtils.hpp>
+
+namespace core {
+namespace http {
+
+// Pool of idle kept-alive connections to local stream servers (keyed by
+// stream path and the io_service which owns the socket, since a socket can
+// only be used by clients running on its own io_service). While a
+// connection is idle we keep a read pending on it so
+// that connections closed by the server (e.g. because the process exited)
+// are evicted immediately rather than being handed out again.
+class LocalStreamConnectionPool
+   : public boost::enable_shared_from_this<LocalStreamConnectionPool>,
+     boost::noncopyable
+{
+public:
+   typedef boost::asio::local::stream_protocol::socket Socket;
+
+   LocalStreamConnectionPool(
+         std::size_t maxIdlePerStream = 4,
+         const boost::posix_time::time_duration& maxIdleTime =
+                                          boost::posix_time::minutes(1))
+      : maxIdlePerStream_(maxIdlePerStream),
+        maxIdleTime_(maxIdleTime)
+   {
+   }
+
+   // take an idle connection to the stream path which belongs to the
+   // io_service (returns an empty pointer if there are none available)
+   boost::shared_ptr<Socket> checkout(const FilePath& streamPath,
+                                      boost::asio::io_service& ioService)
+   {
+      boost::shared_ptr<IdleConnection> ptrIdle;
+
+      LOCK_MUTEX(mutex_)
+      {
+         Connections& connections =
+                           idleConnections_[makeKey(streamPath, &ioService)];
+         while (!connections.empty())
+         {
+            // take the most recently used connection
+            boost::shared_ptr<IdleConnection> ptrCandidate = connections.back();
+            connections.pop_back();
+
+            if (isExpired(ptrCandidate))
+            {
+               closeConnection(ptrCandidate);
+            }
+            else
+            {
+               ptrIdle = ptrCandidate;
+               break;
+            }
+         }
+      }
+      END_LOCK_MUTEX
+
+      if (!ptrIdle)
+         return boost::shared_ptr<Socket>();
+
+      // cancel the pending read which was watching for the server closing
+      boost::system::error_code ec;
+      ptrIdle->ptrSocket->cancel(ec);
+      if (ec)
+      {
+         closeConnection(ptrIdle);
+         return boost::shared_ptr<Socket>();
+      }
+
+      return ptrIdle->ptrSocket;
+   }
+
+   // return a connection (after its response has been fully read)
+   void checkin(const FilePath& streamPath, boost::shared_ptr<Socket> ptrSocket)
+   {
+      boost::shared_ptr<IdleConnection> ptrIdle(new IdleConnection(ptrSocket));
+      Key key = makeKey(streamPath, &ptrSocket->get_io_service());
+
+      LOCK_MUTEX(mutex_)
+      {
+         Connections& connections = idleConnections_[key];
+         if (connections.size() >= maxIdlePerStream_)
+         {
+            closeConnection(ptrIdle);
+            return;
+         }
+
+         connections.push_back(ptrIdle);
+
+         // watch for the server closing the connection (or sending us
+         // something unexpected) while it is idle
+         ptrSocket->async_read_some(
+            boost::asio::buffer(ptrIdle->buffer),
+            boost::bind(&LocalStreamConnectionPool::handleIdleRead,
+                        shared_from_this(),
+                        key,
+                        ptrIdle,
+                        boost::asio::placeholders::error));
+      }
+      END_LOCK_MUTEX
+   }
+
+   // close all idle connections for the stream path (e.g. because the
+   // server has exited). this can be called from any thread: the sockets
+   // are closed on their own io_services.
+   void evict(const FilePath& streamPath)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         IdleConnections::iterator it =
+               idleConnections_.lower_bound(makeKey(streamPath, NULL));
+         while (it != idleConnections_.end() &&
+                it->first.first == streamPath.absolutePath())
+         {
+            it->first.second->post(
+                  boost::bind(&LocalStreamConnectionPool::closeConnections,
+                              it->second));
+            idleConnections_.erase(it++);
+         }
+      }
+      END_LOCK_MUTEX
+   }
+
+private:
+
+   struct IdleConnection
+   {
+      explicit IdleConnection(boost::shared_ptr<Socket> ptrSocket)
+         : ptrSocket(ptrSocket),
+           idleSince(boost::posix_time::microsec_clock::universal_time())
+      {
+      }
+
+      boost::shared_ptr<Socket> ptrSocket;
+      boost::posix_time::ptime idleSince;
+      boost::array<char, 1> buffer;
+   };
+
+   // stream path and owning io_service
+   typedef std::pair<std::string, boost::asio::io_service*> Key;
+
+   static Key makeKey(const FilePath& streamPath,
+                      boost::asio::io_service* pIoService)
+   {
+      return std::make_pair(streamPath.absolutePath(), pIoService);
+   }
+
+   typedef std::list<boost::shared_ptr<IdleConnection> > Connections;
+   typedef std::map<Key, Connections> IdleConnections;
+
+   bool isExpired(boost::shared_ptr<IdleConnection> ptrIdle) const
+   {
+      return boost::posix_time::microsec_clock::universal_time() >
+             (ptrIdle->idleSince + maxIdleTime_);
+   }
+
+   static void closeConnection(boost::shared_ptr<IdleConnection> ptrIdle)
+   {
+      Error error = closeSocket(*(ptrIdle->ptrSocket));
+      if (error && !isConnectionTerminatedError(error))
+         LOG_ERROR(error);
+   }
+
+   static void closeConnections(const Connections& connections)
+   {
+      std::for_each(connections.begin(),
+                    connections.end(),
+                    &LocalStreamConnectionPool::closeConnection);
+   }
+
+   void handleIdleRead(const Key& key,
+                       boost::shared_ptr<IdleConnection> ptrIdle,
+                       const boost::system::error_code& ec)
+   {
+      // cancelled because the connection was checked out
+      if (ec == boost::asio::error::operation_aborted)
+         return;
+
+      // anything else means the connection is no longer usable so
+      // remove it (if it is still in the pool)
+      LOCK_MUTEX(mutex_)
+      {
+         Connections& connections = idleConnections_[key];
+         Connections::iterator it = std::find(connections.begin(),
+                                              connections.end(),
+                                              ptrIdle);
+         if (it != connections.end())
+         {
+            connections.erase(it);
+            closeConnection(ptrIdle);
+         }
+      }
+      END_LOCK_MUTEX
+   }
+
+private:
+   const std::size_t maxIdlePerStream_;
+   const boost::posix_time::time_duration maxIdleTime_;
+   boost::mutex mutex_;
+   IdleConnections idleConnections_;
+};
+
+} // namespace http
+} // namespace core
+
+#endif // CORE_HTTP_LOCAL_STREAM_CONNECTION_POOL_HPP
@@ -17,6 +17,10 @@
 #ifndef CORE_HTTP_REQUEST_PARSER_HPP
 #define CORE_HTTP_REQUEST_PARSER_HPP
 
+#include <string>
+
+#include <boost/function.hpp>
+
 #include <core/http/Request.hpp>
 
 namespace core {
@@ -32,6 +36,19 @@ public:
   /// Reset to initial parser state.
   void reset();
 
+  /// Function which returns the largest Content-Length to accept for a
+  /// request once its request line and headers are parsed (0 for no limit).
+  /// The body of a larger request is read and discarded rather than stored,
+  /// and parsing then fails with bodyTooLarge().
+  typedef boost::function<std::size_t(const Request&)> MaxBodySize;
+  void setMaxBodySize(const MaxBodySize& maxBodySize)
+  {
+     maxBodySize_ = maxBodySize;
+  }
+
+  /// Whether the last error was due to the body exceeding the maximum size.
+  bool bodyTooLarge() const { return bodyTooLarge_; }
+
   // enum for parse results
   enum status
   {
@@ -40,47 +57,17 @@ public:
      error
   };
 
-  template <typename InputIterator>
-  status parse(Request& req, InputIterator begin, InputIterator end)
-  {
-    while (begin != end)
-    {
-       // header parsing
-      if (!parsing_body_)
-      {
-         status st = consume(req, *begin++);
-         if ( st == error )
-         {
-            return st ;
-         }
-         else if ( st == complete  )
-         {
-            // if we have a body then continue parsing it
-            if (content_length_ > 0)
-            {
-               parsing_body_ = true ;
-               continue ;
-            }
-            else
-            {
-               return st ;
-            }
-         }
-      }
-      // body parsing
-      else
-      {
-         req.body_.push_back(*begin++) ;
-         if (req.body_.size() == content_length_)
-            return complete ;
-      }
-    }
-    return incomplete ;
-  }
+  /// Parse the next chunk of input. Header lines are located with memchr
+  /// and handled a line at a time; once the headers are complete the body
+  /// is copied in bulk.
+  status parse(Request& req, const char* begin, const char* end);
 
 private:
-  /// Handle the next character of input.
-  status consume(Request& req, char input);
+  /// Handle a complete line (excluding its terminating newline).
+  status parseLine(Request& req, const char* begin, const char* end);
+  status parseRequestLine(Request& req, const char* begin, const char* end);
+  status parseHeaderLine(Request& req, const char* begin, const char* end);
+  status headersComplete(Request& req);
 
   /// Check if a byte is an HTTP character.
   static bool is_char(int c);
@@ -94,35 +81,25 @@ private:
   /// Check if a byte is a digit.
   static bool is_digit(int c);
 
+  /// Check if a range is a non-empty HTTP token.
+  static bool is_token(const char* begin, const char* end);
+
   /// The current state of the parser.
   enum state
   {
-    method_start,
-    method,
-    uri_start,
-    uri,
-    http_version_h,
-    http_version_t_1,
-    http_version_t_2,
-    http_version_p,
-    http_version_slash,
-    http_version_major_start,
-    http_version_major,
-    http_version_minor_start,
-    http_version_minor,
-    expecting_newline_1,
-    header_line_start,
-    header_lws,
-    header_name,
-    space_before_header_value,
-    header_value,
-    expecting_newline_2,
-    expecting_newline_3
+    request_line,
+    header_line,
+    body
   } state_;
-  
+
+  // partial line carried over between chunks
+  std::string line_;
+
   std::size_t content_length_ ;
-  bool parsing_content_length_ ;
-  bool parsing_body_ ;
+  std::size_t body_received_ ;
+
+  MaxBodySize maxBodySize_;
+  bool bodyTooLarge_;
 };
 
 } // namespace http
@@ -18,6 +18,7 @@
 
 #include <iostream>
 #include <sstream>
+#include <boost/cstdint.hpp>
 #include <boost/type_traits/is_same.hpp>
 #include <boost/iostreams/copy.hpp>
 #include <boost/iostreams/concepts.hpp>
@@ -92,6 +93,9 @@ public:
       statusCode_ = response.statusCode_;
       statusCodeStr_ = response.statusCodeStr_;
       statusMessage_ = response.statusMessage_;
+      bodyFile_ = response.bodyFile_;
+      bodyFileOffset_ = response.bodyFileOffset_;
+      bodyFileLength_ = response.bodyFileLength_;
    }
 
 public:   
@@ -263,6 +267,14 @@ public:
       // set content type
       setContentType(filePath.mimeContentType());
       
+      // unfiltered files are served from the file cache (which retains
+      // their gzipped contents and validates requests using an ETag)
+      if (boost::is_same<Filter, NullOutputFilter>::value)
+      {
+         setCachedFile(filePath, request);
+         return;
+      }
+      
       // gzip if possible
       if (request.acceptsEncoding(kGzipEncoding))
          setContentEncoding(kGzipEncoding);
@@ -309,6 +321,17 @@ public:
    }
 
    void setRangeableFile(const FilePath& filePath, const Request& request);
+
+   // set the body to a range of a file. the range is not read into memory
+   // here, rather connections stream it from disk (see BodyFileReader)
+   // after writing the headers
+   void setBodyFile(const FilePath& filePath,
+                    boost::uint64_t offset,
+                    boost::uint64_t length);
+   bool hasBodyFile() const { return !bodyFile_.empty(); }
+   const FilePath& bodyFile() const { return bodyFile_; }
+   boost::uint64_t bodyFileOffset() const { return bodyFileOffset_; }
+   boost::uint64_t bodyFileLength() const { return bodyFileLength_; }
    
    // these calls do no stream io or encoding so don't return errors
    void setBodyUnencoded(const std::string& body);
@@ -327,6 +350,7 @@ private:
       
 private:
    void ensureStatusMessage() const ;
+   void setCachedFile(const FilePath& filePath, const Request& request);
    void removeCachingHeaders();
    void setCacheForeverHeaders(bool publicAccessiblity);
    std::string eTagForContent(const std::string& content);
@@ -342,6 +366,39 @@ private:
 
    // string storage for integer members (need for toBuffers)
    mutable std::string statusCodeStr_ ;
+
+   // file range streamed as the body (see setBodyFile)
+   FilePath bodyFile_;
+   boost::uint64_t bodyFileOffset_;
+   boost::uint64_t bodyFileLength_;
+};
+
+// reads the file range backing a response body in fixed size chunks so
+// that connections can write it using constant memory
+class BodyFileReader : boost::noncopyable
+{
+public:
+   explicit BodyFileReader(const Response& response)
+      : filePath_(response.bodyFile()),
+        offset_(response.bodyFileOffset()),
+        remaining_(response.bodyFileLength())
+   {
+   }
+
+   // open the file and seek to the start of the range
+   Error open();
+
+   bool finished() const { return remaining_ == 0; }
+
+   // read the next chunk of the range into the buffer (which is resized
+   // to the number of bytes read)
+   Error readChunk(std::vector<char>* pBuffer);
+
+private:
+   FilePath filePath_;
+   boost::uint64_t offset_;
+   boost::uint64_t remaining_;
+   boost::shared_ptr<std::istream> pStream_;
 };
 
 std::ostream& operator << (std::ostream& stream, const Response& r) ;
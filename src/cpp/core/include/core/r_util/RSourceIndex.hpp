@@ -159,6 +159,17 @@ public:
                          column_);
    }
 
+   RSourceItem withLine(std::size_t line) const
+   {
+      return RSourceItem(context_,
+                         type_,
+                         name_,
+                         signature_,
+                         braceLevel_,
+                         line,
+                         column_);
+   }
+
 private:
    std::string context_;
    int type_;
@@ -183,6 +194,17 @@ public:
    RSourceIndex(const std::string& context,
                 const std::string& code);
 
+   // Update the index after the range [offset, offset+removedLength) of
+   // the previously indexed code was replaced with insertedLength bytes
+   // (code is the full code after the edit, offsets are in bytes). Only
+   // the top-level statements touched by the edit are re-tokenized,
+   // falling back to indexing all of the code when the edit changes the
+   // structure of the code which follows it.
+   void update(const std::string& code,
+               std::size_t offset,
+               std::size_t removedLength,
+               std::size_t insertedLength);
+
    const std::string& context() const { return context_; }
 
    template <typename OutputIterator>
@@ -256,9 +278,35 @@ public:
       return search(term, context_, prefixOnly, caseSensitive, out);
    }
 
+private:
+   // a line which begins a top-level statement (tokenizing can be
+   // restarted from the beginning of it) along with the number of items
+   // which precede it
+   struct Checkpoint
+   {
+      Checkpoint(std::size_t line, std::size_t item)
+         : line(line), item(item)
+      {
+      }
+      std::size_t line;
+      std::size_t item;
+   };
+
+   void indexCode(const std::string& code);
+
+   bool indexLines(const std::string& code,
+                   std::size_t begin,
+                   std::size_t end,
+                   std::size_t firstLine,
+                   std::vector<RSourceItem>* pItems,
+                   std::vector<Checkpoint>* pCheckpoints) const;
+
 private:
    std::string context_;
    std::vector<RSourceItem> items_;
+   std::vector<Checkpoint> checkpoints_;
+   std::size_t codeSize_;
+   std::size_t lineCount_;
 };
 
 
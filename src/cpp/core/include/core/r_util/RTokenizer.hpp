@@ -22,7 +22,6 @@
 
 #include <boost/utility.hpp>
 #include <boost/shared_ptr.hpp>
-#include <boost/regex_fwd.hpp>
 
 // On Linux confirm that wchar_t is Unicode
 #if !defined(_WIN32) && !defined(__APPLE__) && !defined(__STDC_ISO_10646__)
@@ -165,11 +164,11 @@ private:
    RToken matchUserOperator();
    RToken matchOperator();
    bool eol();
+   bool eol(std::size_t lookahead);
    wchar_t peek();
    wchar_t peek(std::size_t lookahead);
    wchar_t eat();
-   std::wstring peek(const boost::wregex& regex);
-   void eatUntil(const boost::wregex& regex);
+   std::size_t lengthThrough(wchar_t delim);
    RToken consumeToken(wchar_t tokenType, std::size_t length);
 
 private:
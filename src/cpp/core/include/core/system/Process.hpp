@@ -180,6 +180,8 @@ Error runCommand(const std::string& command,
 // their results will be delivered using the provided callbacks. Note that
 // the poll() method must be called periodically (e.g. during standard event
 // pumping / idle time) in  order to check for output & status of children.
+// Where supported (linux) the children's output streams are watched using
+// epoll so that poll() only reads from children which have output ready.
 //
 // If you want to pair a call to runProgam or runCommand with an object which
 // will live for the lifetime of the child process you should create a
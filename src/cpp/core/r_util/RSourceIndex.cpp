@@ -15,6 +15,9 @@
 
 #include <core/r_util/RSourceIndex.hpp>
 
+#include <algorithm>
+
+#include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
 
 #include <core/StringUtils.hpp>
@@ -190,14 +193,179 @@ void parseSignature(RTokens::const_iterator begin,
 }
 
 
+// number of parens and brackets a token opens (or closes if negative)
+int nestingChange(const RToken& token)
+{
+   wchar_t type = token.type();
+   if (type == RToken::LPAREN || type == RToken::LBRACKET)
+      return 1;
+   else if (type == RToken::RPAREN || type == RToken::RBRACKET)
+      return -1;
+   else if (type == RToken::LDBRACKET)
+      return 2;
+   else if (type == RToken::RDBRACKET)
+      return -2;
+   else
+      return 0;
+}
+
+// does the token join the code before it to the code after it (unmatched
+// closing tokens can bring the nesting level back to zero after an opening
+// token so those are included)
+bool continuesStatement(const RToken& token)
+{
+   wchar_t type = token.type();
+   return type == RToken::OPER ||
+          type == RToken::UOPER ||
+          type == RToken::COMMA ||
+          type == RToken::LBRACE ||
+          nestingChange(token) > 0;
+}
+
+std::size_t lineStart(const std::vector<std::size_t>& newlineLocs,
+                      std::size_t line)
+{
+   return line > 1 ? newlineLocs.at(line - 2) + 1 : 0;
+}
+
 }  // anonymous namespace
 
 RSourceIndex::RSourceIndex(const std::string& context,
                            const std::string& code)
-   : context_(context)
+   : context_(context), codeSize_(0), lineCount_(1)
+{
+   indexCode(code);
+}
+
+void RSourceIndex::update(const std::string& code,
+                          std::size_t offset,
+                          std::size_t removedLength,
+                          std::size_t insertedLength)
+{
+   // if the edit doesn't describe the code we indexed then start over
+   if ((offset + removedLength > codeSize_) ||
+       (offset + insertedLength > code.size()) ||
+       (codeSize_ - removedLength + insertedLength != code.size()))
+   {
+      indexCode(code);
+      return;
+   }
+
+   // find the linebreaks in the new code
+   std::vector<std::size_t> newlineLocs;
+   std::size_t nextNL = 0;
+   while ( (nextNL = code.find('\n', nextNL)) != std::string::npos )
+      newlineLocs.push_back(nextNL++);
+
+   // the code after the edit is unchanged so the line the edit ends on
+   // is the same distance from the last line before and after the edit
+   std::size_t lineCount = newlineLocs.size() + 1;
+   std::size_t editBeginLine = (std::lower_bound(newlineLocs.begin(),
+                                                 newlineLocs.end(),
+                                                 offset) -
+                                newlineLocs.begin()) + 1;
+   std::size_t linesAfterEdit = newlineLocs.end() -
+                                std::lower_bound(newlineLocs.begin(),
+                                                 newlineLocs.end(),
+                                                 offset + insertedLength);
+   std::size_t oldEditEndLine = lineCount_ - linesAfterEdit;
+   std::size_t editEndLine = lineCount - linesAfterEdit;
+
+   // re-tokenize from the last statement which begins on a line before
+   // the edit (if there is none then from the beginning of the code)...
+   std::vector<Checkpoint>::iterator beginIt = checkpoints_.begin();
+   while (beginIt != checkpoints_.end() && beginIt->line < editBeginLine)
+      ++beginIt;
+   Checkpoint first = (beginIt != checkpoints_.begin()) ?
+                                 *(beginIt - 1) : Checkpoint(1, 0);
+
+   // ...through the first statement which begins on a line after it
+   std::vector<Checkpoint>::iterator endIt = beginIt;
+   while (endIt != checkpoints_.end() && endIt->line <= oldEditEndLine)
+      ++endIt;
+
+   std::size_t begin = lineStart(newlineLocs, first.line);
+   std::size_t end = code.size();
+   if (endIt != checkpoints_.end())
+      end = lineStart(newlineLocs, endIt->line - oldEditEndLine + editEndLine);
+
+   std::vector<RSourceItem> items;
+   std::vector<Checkpoint> checkpoints;
+   bool topLevel = indexLines(code, begin, end, first.line,
+                              &items, &checkpoints);
+
+   // if the edited statements don't end at the top level (e.g. an
+   // unmatched brace was typed) then everything after them has changed
+   if (!topLevel && endIt != checkpoints_.end())
+   {
+      indexCode(code);
+      return;
+   }
+
+   // splice the re-indexed items into the index (moving the items which
+   // follow them by the number of lines added or removed)
+   std::size_t itemCount = first.item + items.size();
+   std::vector<RSourceItem> newItems(items_.begin(),
+                                     items_.begin() + first.item);
+   newItems.insert(newItems.end(), items.begin(), items.end());
+
+   std::vector<Checkpoint> newCheckpoints(checkpoints_.begin(), beginIt);
+   BOOST_FOREACH(const Checkpoint& checkpoint, checkpoints)
+   {
+      newCheckpoints.push_back(Checkpoint(checkpoint.line,
+                                          checkpoint.item + first.item));
+   }
+
+   if (endIt != checkpoints_.end())
+   {
+      for (std::vector<RSourceItem>::const_iterator it =
+                                          items_.begin() + endIt->item;
+           it != items_.end();
+           ++it)
+      {
+         newItems.push_back(
+               it->withLine(it->line() - oldEditEndLine + editEndLine));
+      }
+
+      for (std::vector<Checkpoint>::const_iterator it = endIt;
+           it != checkpoints_.end();
+           ++it)
+      {
+         newCheckpoints.push_back(
+               Checkpoint(it->line - oldEditEndLine + editEndLine,
+                          it->item - endIt->item + itemCount));
+      }
+   }
+
+   items_.swap(newItems);
+   checkpoints_.swap(newCheckpoints);
+   codeSize_ = code.size();
+   lineCount_ = lineCount;
+}
+
+void RSourceIndex::indexCode(const std::string& code)
+{
+   items_.clear();
+   checkpoints_.clear();
+   indexLines(code, 0, code.size(), 1, &items_, &checkpoints_);
+   codeSize_ = code.size();
+   lineCount_ = std::count(code.begin(), code.end(), '\n') + 1;
+}
+
+// index the lines of code in [begin, end) (begin is the start of firstLine)
+// and return whether they end at the top level, i.e. the code which
+// follows can be indexed independently of them
+bool RSourceIndex::indexLines(const std::string& code,
+                              std::size_t begin,
+                              std::size_t end,
+                              std::size_t firstLine,
+                              std::vector<RSourceItem>* pItems,
+                              std::vector<Checkpoint>* pCheckpoints) const
 {
    // convert code to wide
-   std::wstring wCode = string_utils::utf8ToWide(code, context);
+   std::wstring wCode = string_utils::utf8ToWide(
+                              std::string(code, begin, end - begin),
+                              context_);
 
    // determine where the linebreaks are and initialize an iterator
    // used for scanning them
@@ -207,12 +375,15 @@ RSourceIndex::RSourceIndex(const std::string& context,
       newlineLocs.push_back(nextNL++);
    std::vector<std::size_t>::const_iterator newlineIter = newlineLocs.begin();
    std::vector<std::size_t>::const_iterator endNewlines = newlineLocs.end();
+   std::vector<std::size_t>::const_iterator statementIter = newlineLocs.begin();
 
    // tokenize
    RTokens rTokens(wCode, RTokens::StripWhitespace | RTokens::StripComments);
 
    // scan for function, method, and class definitions (track indent level)
    int braceLevel = 0;
+   int nestLevel = 0;
+   bool unmatched = false;
    std::wstring function(L"function");
    std::wstring set(L"set");
    std::wstring setGeneric(L"setGeneric");
@@ -235,6 +406,33 @@ RSourceIndex::RSourceIndex(const std::string& context,
       // alias the token
       const RToken& token = rTokens.at(i);
 
+      // an unmatched % or ` would match text added anywhere after it so
+      // nothing which follows it can be indexed independently
+      if (token.type() == RToken::ERR)
+         unmatched = true;
+
+      // note lines which begin a top-level statement (the previous token
+      // must end on an earlier line so we never restart inside a string)
+      if (i > 0 && braceLevel == 0 && nestLevel == 0 && !unmatched)
+      {
+         const RToken& prevToken = rTokens.at(i-1);
+         statementIter = std::lower_bound(statementIter,
+                                          endNewlines,
+                                          prevToken.offset() +
+                                          prevToken.length());
+         if (statementIter != endNewlines &&
+             *statementIter < token.offset() &&
+             !continuesStatement(prevToken) &&
+             !continuesStatement(token))
+         {
+            std::size_t line = std::upper_bound(statementIter,
+                                                endNewlines,
+                                                token.offset()) -
+                               newlineLocs.begin() + firstLine;
+            pCheckpoints->push_back(Checkpoint(line, pItems->size()));
+         }
+      }
+
       // see if this is a begin or end brace and update the level
       if (token.type() == RToken::LBRACE)
       {
@@ -247,6 +445,12 @@ RSourceIndex::RSourceIndex(const std::string& context,
          braceLevel--;
          continue;
       }
+
+      else if (nestingChange(token) != 0)
+      {
+         nestLevel += nestingChange(token);
+         continue;
+      }
       // bail for non-identifiers
       else if (token.type() != RToken::ID)
       {
@@ -349,24 +553,37 @@ RSourceIndex::RSourceIndex(const std::string& context,
       newlineIter = std::upper_bound(newlineIter,
                                      endNewlines,
                                      tokenOffset);
-      std::size_t line = newlineIter - newlineLocs.begin() + 1;
+      std::size_t line = newlineIter - newlineLocs.begin() + firstLine;
 
       // compute column by comparing the offset to the PREVIOUS newline
       // (guard against no previous newline)
       std::size_t column;
-      if (line > 1)
+      if (newlineIter != newlineLocs.begin())
          column = tokenOffset - *(newlineIter - 1);
+      else if (line > 1)
+         column = tokenOffset + 1;
       else
          column = tokenOffset;
 
       // add to index
-      items_.push_back(RSourceItem(type,
+      pItems->push_back(RSourceItem(type,
                                    string_utils::wideToUtf8(name),
                                    signature,
                                    braceLevel,
                                    line,
                                    column));
    }
+
+   // the code ends at the top level if nothing is left open and the last
+   // token doesn't continue onto the next line
+   if (rTokens.empty())
+      return true;
+   const RToken& lastToken = rTokens.back();
+   return !unmatched &&
+          braceLevel == 0 &&
+          nestLevel == 0 &&
+          !continuesStatement(lastToken) &&
+          lastToken.offset() + lastToken.length() < wCode.size();
 }
 
 } // namespace r_util
@@ -13,24 +13,8 @@
  *
  */
 
-// A very low level assertion (line 595 of cpp_regex_traits.hpp) is firing
-// on WindowsXP when we create a boost::wregex within R session. This code
-// is part of boost attempting to detect the sort syntax, and the assertion
-// is that there are no nulls in a buffer after a call to locale->transform.
-// Within the same method there are workarounds for both borland c++ and
-// dinkumware c++ std library to strip embedded nulls, so it seems as if
-// there is some variation in whether nulls come out of the call to transforn.
-// Note also that boost has a macro titled BOOST_REGEX_NO_WIN32 which we are
-// not using, which means that boost regex does call into native windows APIs
-// for locale oriented functions (thus explaining a difference in runtime
-// behavior across platforms). Tokenization appears to continue to work
-// correctly in the presence of the assertion (with the annoying side effect
-// of logging an assertion every time the product starts up)
-
 #include <core/r_util/RTokenizer.hpp>
 
-#include <boost/regex.hpp>
-
 #include <iostream>
 
 #include <core/Error.hpp>
@@ -43,35 +27,49 @@ namespace r_util {
 
 namespace {
 
-class TokenPatterns
+// character classes are tested directly (rather than with regexes or
+// lookup tables) since nearly all R code is ASCII
+
+bool isDigit(wchar_t c)
+{
+   return c >= L'0' && c <= L'9';
+}
+
+bool isHexDigit(wchar_t c)
+{
+   return isDigit(c) || (c >= L'a' && c <= L'f') || (c >= L'A' && c <= L'F');
+}
+
+bool isAlnum(wchar_t c)
+{
+   if (c < 0x80)
+      return isDigit(c) || (c >= L'a' && c <= L'z') || (c >= L'A' && c <= L'Z');
+   else
+      return string_utils::isalnum(c);
+}
+
+bool isWhitespace(wchar_t c)
 {
-private:
-   friend TokenPatterns& tokenPatterns();
-   TokenPatterns()
-      : NUMBER(L"[0-9]*(\\.[0-9]*)?([eE][+-]?[0-9]*)?[Li]?"),
-        HEX_NUMBER(L"0x[0-9a-fA-F]*L?"),
-        USER_OPERATOR(L"%[^%]*%"),
-        QUOTED_IDENTIFIER(L"`[^`]*`"),
-        UNTIL_END_QUOTE(L"[\\\\\'\"]"),
-        WHITESPACE(L"[\\s\x00A0\x3000]+"),
-        COMMENT(L"#.*?$")
+   switch (c)
    {
+   case L' ': case L'\t': case L'\n': case L'\r': case L'\v': case L'\f':
+   case L'\x00A0': case L'\x3000':
+      return true;
+   default:
+      return false;
    }
+}
 
-public:
-   const boost::wregex NUMBER;
-   const boost::wregex HEX_NUMBER;
-   const boost::wregex USER_OPERATOR;
-   const boost::wregex QUOTED_IDENTIFIER;
-   const boost::wregex UNTIL_END_QUOTE;
-   const boost::wregex WHITESPACE;
-   const boost::wregex COMMENT;
-};
-
-TokenPatterns& tokenPatterns()
+bool isLineEnd(wchar_t c)
 {
-   static TokenPatterns instance;
-   return instance;
+   switch (c)
+   {
+   case L'\n': case L'\r': case L'\f':
+   case L'\x0085': case L'\x2028': case L'\x2029':
+      return true;
+   default:
+      return false;
+   }
 }
 
 } // anonymous namespace
@@ -136,15 +134,14 @@ RToken RTokenizer::nextToken()
 
   wchar_t cNext = peek(1) ;
 
-  if ((c >= L'0' && c <= L'9')
-        || (c == L'.' && cNext >= L'0' && cNext <= L'9'))
+  if (isDigit(c) || (c == L'.' && isDigit(cNext)))
   {
      RToken numberToken = matchNumber() ;
      if (numberToken.length() > 0)
         return numberToken ;
   }
 
-  if (string_utils::isalnum(c) || c == L'.')
+  if (isAlnum(c) || c == L'.')
   {
      // From Section 10.3.2, identifiers must not start with
      // a digit, nor may they start with a period followed by
@@ -168,8 +165,10 @@ RToken RTokenizer::nextToken()
 
 RToken RTokenizer::matchWhitespace()
 {
-   std::wstring whitespace = peek(tokenPatterns().WHITESPACE) ;
-   return consumeToken(RToken::WHITESPACE, whitespace.length()) ;
+   std::size_t length = 1;
+   while (isWhitespace(peek(length)))
+      length++;
+   return consumeToken(RToken::WHITESPACE, length) ;
 }
 
 RToken RTokenizer::matchStringLiteral()
@@ -179,11 +178,6 @@ RToken RTokenizer::matchStringLiteral()
 
    while (!eol())
    {
-      eatUntil(tokenPatterns().UNTIL_END_QUOTE);
-
-      if (eol())
-         break ;
-
       wchar_t c = eat() ;
       if (c == quot)
       {
@@ -217,18 +211,52 @@ RToken RTokenizer::matchStringLiteral()
 
 RToken RTokenizer::matchNumber()
 {
-   std::wstring num = peek(tokenPatterns().HEX_NUMBER) ;
-   if (num.empty())
-      num = peek(tokenPatterns().NUMBER) ;
+   std::size_t length = 0;
+
+   // hex: 0x[0-9a-fA-F]*L?
+   if (peek() == L'0' && peek(1) == L'x')
+   {
+      length = 2;
+      while (isHexDigit(peek(length)))
+         length++;
+      if (peek(length) == L'L')
+         length++;
+   }
+
+   // decimal: [0-9]*(\.[0-9]*)?([eE][+-]?[0-9]*)?[Li]?
+   else
+   {
+      while (isDigit(peek(length)))
+         length++;
+
+      if (peek(length) == L'.')
+      {
+         length++;
+         while (isDigit(peek(length)))
+            length++;
+      }
+
+      if (peek(length) == L'e' || peek(length) == L'E')
+      {
+         length++;
+         if (peek(length) == L'+' || peek(length) == L'-')
+            length++;
+         while (isDigit(peek(length)))
+            length++;
+      }
 
-   return consumeToken(RToken::NUMBER, num.length());
+      if (peek(length) == L'L' || peek(length) == L'i')
+         length++;
+   }
+
+   return consumeToken(RToken::NUMBER, length);
 }
 
 RToken RTokenizer::matchIdentifier()
 {
    std::wstring::const_iterator start = pos_ ;
    eat();
-   while (string_utils::isalnum(peek()) || peek() == L'.' || peek() == L'_')
+   while (isAlnum(peek()) || peek() == L'.' || peek() == L'_')
       eat();
    return RToken(RToken::ID,
                  start,
@@ -238,26 +266,28 @@ RToken RTokenizer::matchIdentifier()
 
 RToken RTokenizer::matchQuotedIdentifier()
 {
-   std::wstring iden = peek(tokenPatterns().QUOTED_IDENTIFIER) ;
-   if (iden.empty())
+   std::size_t length = lengthThrough(L'`');
+   if (length == 0)
       return consumeToken(RToken::ERR, 1);
    else
-      return consumeToken(RToken::ID, iden.length());
+      return consumeToken(RToken::ID, length);
 }
 
 RToken RTokenizer::matchComment()
 {
-   std::wstring comment = peek(tokenPatterns().COMMENT);
-   return consumeToken(RToken::COMMENT, comment.length());
+   std::size_t length = 1;
+   while (!eol(length) && !isLineEnd(peek(length)))
+      length++;
+   return consumeToken(RToken::COMMENT, length);
 }
 
 RToken RTokenizer::matchUserOperator()
 {
-   std::wstring oper = peek(tokenPatterns().USER_OPERATOR) ;
-   if (oper.empty())
+   std::size_t length = lengthThrough(L'%');
+   if (length == 0)
       return consumeToken(RToken::ERR, 1) ;
    else
-      return consumeToken(RToken::UOPER, oper.length()) ;
+      return consumeToken(RToken::UOPER, length) ;
 }
 
 
@@ -294,6 +324,11 @@ bool RTokenizer::eol()
    return pos_ >= data_.end();
 }
 
+bool RTokenizer::eol(std::size_t lookahead)
+{
+   return static_cast<std::size_t>(data_.end() - pos_) <= lookahead;
+}
+
 wchar_t RTokenizer::peek()
 {
    return peek(0) ;
@@ -314,34 +349,19 @@ wchar_t RTokenizer::eat()
    return result ;
 }
 
-std::wstring RTokenizer::peek(const boost::wregex& regex)
+// length of the text from the current character through the next
+// occurrence of delim (or 0 if there is no closing delim)
+std::size_t RTokenizer::lengthThrough(wchar_t delim)
 {
-   boost::wsmatch match;
-   std::wstring::const_iterator end = data_.end();
-   boost::match_flag_type flg = boost::match_default | boost::match_continuous;
-   if (boost::regex_search(pos_, end, match, regex, flg))
-   {
-      return match[0];
-   }
-   else
-   {
-      return std::wstring();
-   }
-}
+   if (eol())
+      return 0;
 
-void RTokenizer::eatUntil(const boost::wregex& regex)
-{
-   boost::wsmatch match;
    std::wstring::const_iterator end = data_.end();
-   if (boost::regex_search(pos_, end, match, regex))
-   {
-      pos_ = match[0].first;
-   }
+   std::wstring::const_iterator it = std::find(pos_ + 1, end, delim);
+   if (it == end)
+      return 0;
    else
-   {
-      // eat all on failure to match
-      pos_ = data_.end();
-   }
+      return (it - pos_) + 1;
 }
 
 
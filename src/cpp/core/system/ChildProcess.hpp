@@ -16,6 +16,8 @@
 #ifndef CORE_SYSTEM_CHILD_PROCESS_HPP
 #define CORE_SYSTEM_CHILD_PROCESS_HPP
 
+#include <set>
+
 #include <core/system/Process.hpp>
 
 #include <core/Error.hpp>
@@ -187,8 +189,11 @@ public:
       }
    }
 
-   // poll for input and exit status
-   void poll();
+   // poll for input and exit status. when the child's output is being
+   // watched by a ChildOutputMonitor then outputReady indicates whether
+   // there is anything to read (if not the pipes aren't touched and exit
+   // status is checked only occasionally)
+   void poll(bool outputReady = true);
 
    // has it exited?
    bool exited();
@@ -228,6 +233,33 @@ private:
    // platform specific impl
    struct AsyncImpl;
    boost::scoped_ptr<AsyncImpl> pAsyncImpl_;
+
+   friend class ChildOutputMonitor;
+};
+
+// Watches the output streams of running children (using epoll on linux)
+// so that a supervisor only needs to read from those with pending output
+class ChildOutputMonitor : boost::noncopyable
+{
+public:
+   ChildOutputMonitor();
+   virtual ~ChildOutputMonitor();
+
+   // start watching the output of a child which is running. returns false
+   // if its output can't be watched (e.g. not supported on this platform)
+   // in which case it should always be polled with outputReady == true.
+   // children are no longer watched once their output streams are closed
+   bool add(AsyncChildProcess* pChild);
+
+   // get the children with output ready to read (or which have closed
+   // their output). note that the set can contain pointers to children
+   // which have since exited so it should only be used for lookups
+   void readyChildren(std::set<AsyncChildProcess*>* pReady);
+
+private:
+   // platform specific impl
+   struct Impl;
+   boost::scoped_ptr<Impl> pImpl_;
 };
 
 } // namespace system
@@ -31,7 +31,16 @@
 #include <sys/wait.h>
 #include <sys/types.h>
 
+#ifdef __linux__
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
 #include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
@@ -53,6 +62,12 @@ const int READ = 0;
 const int WRITE = 1;
 const std::size_t READ_ERR = -1;
 
+// how often to check whether a child with no output activity has exited
+// (normally exit is detected by the child closing its output streams but
+// descendants of the child may inherit and hold those open)
+const boost::posix_time::time_duration kExitCheckInterval =
+                                       boost::posix_time::seconds(1);
+
 int resolveExitStatus(int status)
 {
    return WIFEXITED(status) ? WEXITSTATUS(status) : status;
@@ -130,6 +145,217 @@ Error readPipe(int pipeFd, std::string* pOutput, bool *pEOF = NULL)
    return Success();
 }
 
+#ifdef __linux__
+
+// Launching a child with fork copies the page tables of the parent, which
+// for a session holding a large R heap can take hundreds of milliseconds
+// (and can fail outright under strict overcommit). vfork instead shares
+// the parent's memory until the child calls exec so its cost doesn't
+// depend on the size of the parent. The catch is that the child must not
+// touch anything shared with the parent, so everything it needs is
+// prepared up front and it makes nothing but system calls (no logging or
+// allocation) -- failures are recorded in a VforkFailure for the parent
+// to log once it resumes. Note that onAfterFork functions can do anything
+// so they still require a real fork.
+
+struct VforkFailure
+{
+   VforkFailure() : call(NULL), errorNumber(0) {}
+   const char* call;
+   int errorNumber;
+};
+
+// record a failure (only the first one is kept)
+void recordVforkFailure(volatile VforkFailure* pFailure, const char* call)
+{
+   if (pFailure->call == NULL)
+   {
+      pFailure->call = call;
+      pFailure->errorNumber = errno;
+   }
+}
+
+// equivalent of closeNonStdFileDescriptors which is safe to call from a
+// vfork child: we read the open descriptors from /proc/self/fd directly
+// with getdents64 rather than trying to close every possible descriptor
+// (which is slow when the descriptor limit is high and we are blocking
+// the parent for the duration)
+struct LinuxDirent64
+{
+   ino64_t d_ino;
+   off64_t d_off;
+   unsigned short d_reclen;
+   unsigned char d_type;
+   char d_name[1];
+};
+
+void vforkCloseNonStdFileDescriptors(int maxFd)
+{
+   int dirFd = ::open("/proc/self/fd", O_RDONLY | O_DIRECTORY);
+   if (dirFd == -1)
+   {
+      for (int fd = STDERR_FILENO + 1; fd < maxFd; fd++)
+         ::close(fd);
+      return;
+   }
+
+   char buffer[4096];
+   while (true)
+   {
+      long bytes = ::syscall(SYS_getdents64, dirFd, buffer, sizeof(buffer));
+      if (bytes <= 0)
+         break;
+
+      for (long offset = 0; offset < bytes; )
+      {
+         LinuxDirent64* pEntry =
+                     reinterpret_cast<LinuxDirent64*>(buffer + offset);
+         offset += pEntry->d_reclen;
+
+         // parse the descriptor (skipping . and ..)
+         int fd = 0;
+         const char* pName = pEntry->d_name;
+         if (*pName < '0' || *pName > '9')
+            continue;
+         for (; *pName >= '0' && *pName <= '9'; pName++)
+            fd = (fd * 10) + (*pName - '0');
+
+         if (fd > STDERR_FILENO && fd != dirFd)
+            ::close(fd);
+      }
+   }
+
+   ::close(dirFd);
+}
+
+Error vforkAndExec(const std::string& exe,
+                   const std::vector<std::string>& args,
+                   const ProcessOptions& options,
+                   int* fdInput,
+                   int* fdOutput,
+                   int* fdError,
+                   pid_t* pPid)
+{
+   // build args (including the exe) and environment
+   std::vector<std::string> argv;
+   argv.push_back(exe);
+   argv.insert(argv.end(), args.begin(), args.end());
+   ProcessArgs processArgs(argv);
+   boost::scoped_ptr<ProcessArgs> pEnvironment;
+   if (options.environment)
+   {
+      std::vector<std::string> env;
+      const Options& environment = options.environment.get();
+      for (Options::const_iterator
+               it = environment.begin(); it != environment.end(); ++it)
+      {
+         env.push_back(it->first + "=" + it->second);
+      }
+      pEnvironment.reset(new ProcessArgs(env));
+   }
+
+   // resolve working dir and descriptor limit (used only if we can't
+   // read /proc/self/fd in the child)
+   std::string workingDir;
+   if (!options.workingDir.empty())
+      workingDir = options.workingDir.absolutePath();
+   int maxFd = 1024;
+   struct rlimit rl;
+   if (::getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_max != RLIM_INFINITY)
+      maxFd = static_cast<int>(rl.rlim_max);
+   int stdErrFd = options.redirectStdErrToStdOut ? fdOutput[WRITE]
+                                                 : fdError[WRITE];
+
+   // block all signals while the child shares our memory (so none of our
+   // handlers can run within it before it resets them)
+   sigset_t allSignals, noSignals, previousMask;
+   ::sigfillset(&allSignals);
+   ::sigemptyset(&noSignals);
+   ::pthread_sigmask(SIG_SETMASK, &allSignals, &previousMask);
+
+   volatile VforkFailure failure;
+   pid_t pid = ::vfork();
+
+   // child
+   if (pid == 0)
+   {
+      // handlers are per process (not shared) so reset any which aren't
+      // ignored to their defaults before unblocking signals
+      for (int sig = 1; sig < NSIG; sig++)
+      {
+         struct sigaction action;
+         if (::sigaction(sig, NULL, &action) == 0 &&
+             action.sa_handler != SIG_IGN &&
+             action.sa_handler != SIG_DFL)
+         {
+            action.sa_handler = SIG_DFL;
+            action.sa_flags = 0;
+            ::sigemptyset(&action.sa_mask);
+            ::sigaction(sig, &action, NULL);
+         }
+      }
+
+      // detach or obtain a new process group (see ChildProcess::run for
+      // details). as with the fork path failures here are recorded and we
+      // fail forward to the exec
+      if (options.detachSession)
+      {
+         if (::setsid() == -1)
+            recordVforkFailure(&failure, "setsid");
+      }
+      else if (options.terminateChildren)
+      {
+         if (::setpgid(0,0) == -1)
+            recordVforkFailure(&failure, "setpgid");
+      }
+
+      // clear the signal mask
+      ::sigprocmask(SIG_SETMASK, &noSignals, NULL);
+
+      // wire standard streams then close everything else (which
+      // includes the original pipe descriptors)
+      if (::dup2(fdInput[READ], STDIN_FILENO) == -1 ||
+          ::dup2(fdOutput[WRITE], STDOUT_FILENO) == -1 ||
+          ::dup2(stdErrFd, STDERR_FILENO) == -1)
+      {
+         recordVforkFailure(&failure, "dup2");
+      }
+      vforkCloseNonStdFileDescriptors(maxFd);
+
+      if (!workingDir.empty() && ::chdir(workingDir.c_str()) == -1)
+         recordVforkFailure(&failure, "chdir");
+
+      // execute
+      if (pEnvironment)
+         ::execve(exe.c_str(), processArgs.args(), pEnvironment->args());
+      else
+         ::execv(exe.c_str(), processArgs.args());
+
+      // if we get here then exec failed
+      recordVforkFailure(&failure, "exec");
+      ::_exit(EXIT_FAILURE);
+   }
+
+   // parent (resumes once the child has called exec or exited)
+   int vforkErrno = errno;
+   ::pthread_sigmask(SIG_SETMASK, &previousMask, NULL);
+   if (pid == -1)
+      return systemError(vforkErrno, ERROR_LOCATION);
+
+   if (failure.call != NULL)
+   {
+      Error error = systemError(failure.errorNumber, ERROR_LOCATION);
+      error.addProperty("call", const_cast<const char*>(failure.call));
+      error.addProperty("exe", exe);
+      LOG_ERROR(error);
+   }
+
+   *pPid = pid;
+   return Success();
+}
+
+#endif
+
 } // anonymous namespace
 
 
@@ -406,8 +632,15 @@ Error ChildProcess::run()
          return error;
       }
 
-      // fork
-      error = posixCall<pid_t>(::fork, ERROR_LOCATION, &pid);
+      // launch using vfork where we can (see vforkAndExec)
+#ifdef __linux__
+      if (!options_.onAfterFork)
+         error = vforkAndExec(exe_, args_, options_,
+                              fdInput, fdOutput, fdError,
+                              &pid);
+      else
+#endif
+         error = posixCall<pid_t>(::fork, ERROR_LOCATION, &pid);
       if (error)
       {
          closePipe(fdInput, ERROR_LOCATION);
@@ -656,6 +889,7 @@ struct AsyncChildProcess::AsyncImpl
    bool finishedStdout_;
    bool finishedStderr_;
    bool exited_;
+   boost::posix_time::ptime lastExitCheck_;
 };
 
 AsyncChildProcess::AsyncChildProcess(const std::string& exe,
@@ -696,7 +930,7 @@ Error AsyncChildProcess::terminate()
 }
 
 
-void AsyncChildProcess::poll()
+void AsyncChildProcess::poll(bool outputReady)
 {
    // call onStarted if we haven't yet
    if (!(pAsyncImpl_->calledOnStarted_))
@@ -729,7 +963,7 @@ void AsyncChildProcess::poll()
    }
 
    // check stdout and fire event if we got output
-   if (!pAsyncImpl_->finishedStdout_)
+   if (outputReady && !pAsyncImpl_->finishedStdout_)
    {
       bool eof;
       std::string out;
@@ -749,7 +983,7 @@ void AsyncChildProcess::poll()
    }
 
    // check stderr and fire event if we got output
-   if (!pAsyncImpl_->finishedStderr_)
+   if (outputReady && !pAsyncImpl_->finishedStderr_)
    {
       bool eof;
       std::string err;
@@ -769,6 +1003,19 @@ void AsyncChildProcess::poll()
       }
    }
 
+   // only check for exit if there was output activity (exiting closes the
+   // output streams), once output is finished, or every kExitCheckInterval
+   using namespace boost::posix_time;
+   ptime now = microsec_clock::universal_time();
+   bool finishedOutput = pAsyncImpl_->finishedStdout_ &&
+                         pAsyncImpl_->finishedStderr_;
+   if (!outputReady && !finishedOutput &&
+       !pAsyncImpl_->lastExitCheck_.is_not_a_date_time() &&
+       (now - pAsyncImpl_->lastExitCheck_) < kExitCheckInterval)
+   {
+      return;
+   }
+   pAsyncImpl_->lastExitCheck_ = now;
 
    // Check for exited. Note that this method specifies WNOHANG
    // so we don't block forever waiting for a process the exit. We may
@@ -816,6 +1063,121 @@ bool AsyncChildProcess::exited()
    return pAsyncImpl_->exited_;
 }
 
+struct ChildOutputMonitor::Impl
+{
+   Impl() : epollFd(-1) {}
+   int epollFd;
+};
+
+ChildOutputMonitor::ChildOutputMonitor()
+   : pImpl_(new Impl())
+{
+#ifdef __linux__
+   Error error = posixCall<int>(boost::bind(::epoll_create, 16),
+                                ERROR_LOCATION,
+                                &(pImpl_->epollFd));
+   if (error)
+   {
+      LOG_ERROR(error);
+      pImpl_->epollFd = -1;
+      return;
+   }
+
+   // don't leak the descriptor into children
+   int flags = ::fcntl(pImpl_->epollFd, F_GETFD);
+   if (flags != -1)
+      ::fcntl(pImpl_->epollFd, F_SETFD, flags | FD_CLOEXEC);
+#endif
+}
+
+ChildOutputMonitor::~ChildOutputMonitor()
+{
+   try
+   {
+      if (pImpl_->epollFd != -1)
+         safePosixCall<int>(boost::bind(::close, pImpl_->epollFd),
+                            ERROR_LOCATION);
+   }
+   catch(...)
+   {
+   }
+}
+
+bool ChildOutputMonitor::add(AsyncChildProcess* pChild)
+{
+#ifdef __linux__
+   if (pImpl_->epollFd == -1)
+      return false;
+
+   // stderr is -1 for pseudoterminals (all output is on the master)
+   int fds[] = { pChild->pImpl_->fdStdout, pChild->pImpl_->fdStderr };
+   for (std::size_t i = 0; i < sizeof(fds) / sizeof(int); i++)
+   {
+      if (fds[i] == -1)
+         continue;
+
+      // registrations are removed automatically when the child's pipes
+      // are closed after it exits
+      struct epoll_event event;
+      ::memset(&event, 0, sizeof(event));
+      event.events = EPOLLIN;
+      event.data.ptr = pChild;
+      Error error = posixCall<int>(boost::bind(::epoll_ctl,
+                                               pImpl_->epollFd,
+                                               EPOLL_CTL_ADD,
+                                               fds[i],
+                                               &event),
+                                   ERROR_LOCATION);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return false;
+      }
+   }
+
+   return true;
+#else
+   return false;
+#endif
+}
+
+void ChildOutputMonitor::readyChildren(std::set<AsyncChildProcess*>* pReady)
+{
+#ifdef __linux__
+   if (pImpl_->epollFd == -1)
+      return;
+
+   // registrations are level triggered so if there are more ready streams
+   // than fit in our buffer then successive waits rotate through them --
+   // keep going until we stop seeing children we haven't seen already
+   const int kMaxEvents = 64;
+   struct epoll_event events[kMaxEvents];
+   while (true)
+   {
+      int count = -1;
+      Error error = posixCall<int>(boost::bind(::epoll_wait,
+                                               pImpl_->epollFd,
+                                               events,
+                                               kMaxEvents,
+                                               0),
+                                   ERROR_LOCATION,
+                                   &count);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return;
+      }
+
+      std::size_t previousSize = pReady->size();
+      for (int i = 0; i < count; i++)
+         pReady->insert(static_cast<AsyncChildProcess*>(events[i].data.ptr));
+
+      if (count < kMaxEvents || pReady->size() == previousSize)
+         return;
+   }
+#endif
+}
+
 } // namespace system
 } // namespace core
 
@@ -19,6 +19,8 @@
 
 #include <boost/bind.hpp>
 #include <boost/foreach.hpp>
+#include <boost/format.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <core/Scope.hpp>
 #include <core/Error.hpp>
@@ -60,11 +62,66 @@ Error runCommand(const std::string& command,
 }
 
 
+namespace {
+
+// a supervised child along with timing information which is logged
+// (at debug level) when it exits
+struct SupervisedChild
+{
+   SupervisedChild(const std::string& name,
+                   boost::shared_ptr<AsyncChildProcess> pChild)
+      : name(name),
+        pChild(pChild),
+        outputMonitored(false),
+        started(boost::posix_time::microsec_clock::universal_time()),
+        polls(0),
+        readyPolls(0),
+        pollTime(boost::posix_time::microseconds(0)),
+        maxPollTime(boost::posix_time::microseconds(0))
+   {
+   }
+
+   std::string name;
+   boost::shared_ptr<AsyncChildProcess> pChild;
+   bool outputMonitored;
+
+   boost::posix_time::ptime started;
+   int polls;
+   int readyPolls;
+   boost::posix_time::time_duration pollTime;
+   boost::posix_time::time_duration maxPollTime;
+};
+
+bool childExited(boost::shared_ptr<SupervisedChild> pChild)
+{
+   return pChild->pChild->exited();
+}
+
+void logChildMetrics(const SupervisedChild& child)
+{
+   using namespace boost::posix_time;
+   time_duration elapsed = microsec_clock::universal_time() - child.started;
+   boost::format fmt("%1% exited after %2%ms (output ready on %3% of %4% "
+                     "polls, %5%ms polling, longest poll %6%ms)");
+   LOG_DEBUG_MESSAGE(boost::str(fmt % child.name
+                                    % elapsed.total_milliseconds()
+                                    % child.readyPolls
+                                    % child.polls
+                                    % child.pollTime.total_milliseconds()
+                                    % child.maxPollTime.total_milliseconds()));
+}
+
+} // anonymous namespace
+
 struct ProcessSupervisor::Impl
 {
    Impl() : isPolling(false) {}
    bool isPolling;
-   std::vector<boost::shared_ptr<AsyncChildProcess> > children;
+   std::vector<boost::shared_ptr<SupervisedChild> > children;
+
+   // watches children's output so we only read from those with output
+   // ready rather than every child on every poll
+   ChildOutputMonitor outputMonitor;
 };
 
 ProcessSupervisor::ProcessSupervisor()
@@ -78,17 +135,22 @@ ProcessSupervisor::~ProcessSupervisor()
 
 namespace {
 
-Error runChild(boost::shared_ptr<AsyncChildProcess> pChild,
-               std::vector<boost::shared_ptr<AsyncChildProcess> >* pChildren,
-               const ProcessCallbacks& callbacks)
+Error runChild(const std::string& name,
+               boost::shared_ptr<AsyncChildProcess> pChild,
+               const ProcessCallbacks& callbacks,
+               ChildOutputMonitor* pOutputMonitor,
+               std::vector<boost::shared_ptr<SupervisedChild> >* pChildren)
 {
    // run the child
    Error error = pChild->run(callbacks);
    if (error)
       return error;
 
-   // add to the list of children
-   pChildren->push_back(pChild);
+   // watch its output and add to the list of children
+   boost::shared_ptr<SupervisedChild> pSupervised(
+                                       new SupervisedChild(name, pChild));
+   pSupervised->outputMonitored = pOutputMonitor->add(pChild.get());
+   pChildren->push_back(pSupervised);
 
    // success
    return Success();
@@ -108,7 +170,11 @@ Error ProcessSupervisor::runProgram(const std::string& executable,
                                                        options));
 
    // run the child
-   return runChild(pChild, &(pImpl_->children), callbacks);
+   return runChild(executable,
+                   pChild,
+                   callbacks,
+                   &(pImpl_->outputMonitor),
+                   &(pImpl_->children));
 }
 
 Error ProcessSupervisor::runCommand(const std::string& command,
@@ -120,7 +186,11 @@ Error ProcessSupervisor::runCommand(const std::string& command,
                                  new AsyncChildProcess(command, options));
 
    // run the child
-   return runChild(pChild, &(pImpl_->children), callbacks);
+   return runChild(command,
+                   pChild,
+                   callbacks,
+                   &(pImpl_->outputMonitor),
+                   &(pImpl_->children));
 }
 
 namespace {
@@ -278,16 +348,39 @@ bool ProcessSupervisor::poll()
    pImpl_->isPolling = true;
    scope::SetOnExit<bool> setOnExit(&pImpl_->isPolling, false);
 
-   // call poll on all of our children
-   std::for_each(pImpl_->children.begin(),
-                 pImpl_->children.end(),
-                 boost::bind(&AsyncChildProcess::poll, _1));
+   // find out which children have output ready
+   std::set<AsyncChildProcess*> ready;
+   pImpl_->outputMonitor.readyChildren(&ready);
+
+   // call poll on all of our children (iterate over a copy since the
+   // callbacks may run additional children)
+   using namespace boost::posix_time;
+   std::vector<boost::shared_ptr<SupervisedChild> > children =
+                                                      pImpl_->children;
+   BOOST_FOREACH(boost::shared_ptr<SupervisedChild> pChild, children)
+   {
+      bool outputReady = !pChild->outputMonitored ||
+                         ready.count(pChild->pChild.get()) > 0;
+
+      ptime start = microsec_clock::universal_time();
+      pChild->pChild->poll(outputReady);
+      time_duration pollTime = microsec_clock::universal_time() - start;
+
+      pChild->polls++;
+      if (outputReady)
+         pChild->readyPolls++;
+      pChild->pollTime += pollTime;
+      if (pollTime > pChild->maxPollTime)
+         pChild->maxPollTime = pollTime;
+
+      if (pChild->pChild->exited())
+         logChildMetrics(*pChild);
+   }
 
    // remove any children who have exited from our list
-   pImpl_->children.erase(std::remove_if(
-                             pImpl_->children.begin(),
-                             pImpl_->children.end(),
-                             boost::bind(&AsyncChildProcess::exited, _1)),
+   pImpl_->children.erase(std::remove_if(pImpl_->children.begin(),
+                                         pImpl_->children.end(),
+                                         childExited),
                           pImpl_->children.end());
 
    // return status
@@ -297,10 +390,10 @@ bool ProcessSupervisor::poll()
 void ProcessSupervisor::terminateAll()
 {
    // call terminate on all of our children
-   BOOST_FOREACH(boost::shared_ptr<AsyncChildProcess> pChild,
+   BOOST_FOREACH(boost::shared_ptr<SupervisedChild> pChild,
                  pImpl_->children)
    {
-      Error error = pChild->terminate();
+      Error error = pChild->pChild->terminate();
       if (error)
          LOG_ERROR(error);
    }
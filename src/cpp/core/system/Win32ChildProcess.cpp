@@ -599,7 +599,7 @@ Error AsyncChildProcess::terminate()
 }
 
 
-void AsyncChildProcess::poll()
+void AsyncChildProcess::poll(bool outputReady)
 {
    // call onStarted if we haven't yet
    if (!(pAsyncImpl_->calledOnStarted_))
@@ -689,6 +689,29 @@ bool AsyncChildProcess::exited()
    return pImpl_->hProcess == NULL;
 }
 
+// output monitoring isn't supported on win32 (children are always polled)
+struct ChildOutputMonitor::Impl
+{
+};
+
+ChildOutputMonitor::ChildOutputMonitor()
+   : pImpl_(new Impl())
+{
+}
+
+ChildOutputMonitor::~ChildOutputMonitor()
+{
+}
+
+bool ChildOutputMonitor::add(AsyncChildProcess* pChild)
+{
+   return false;
+}
+
+void ChildOutputMonitor::readyChildren(std::set<AsyncChildProcess*>* pReady)
+{
+}
+
 } // namespace system
 } // namespace core
 
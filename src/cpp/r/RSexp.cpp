@@ -110,6 +110,54 @@ void listEnvironment(SEXP env,
    }
 }
 
+namespace {
+
+void addFrameBindings(SEXP frameSEXP,
+                      bool includeAll,
+                      std::vector<Binding>* pBindings)
+{
+   for ( ; frameSEXP != R_NilValue; frameSEXP = CDR(frameSEXP))
+   {
+      SEXP symbolSEXP = TAG(frameSEXP);
+      SEXP valueSEXP = CAR(frameSEXP);
+      if (valueSEXP == R_UnboundValue)
+         continue;
+
+      if (!includeAll && CHAR(PRINTNAME(symbolSEXP))[0] == '.')
+         continue;
+
+      pBindings->push_back(std::make_pair(symbolSEXP, valueSEXP));
+   }
+}
+
+} // anonymous namespace
+
+void listFrameBindings(SEXP env,
+                       bool includeAll,
+                       std::vector<Binding>* pBindings)
+{
+   // reset passed bindings
+   pBindings->clear();
+
+   // hashed environments (e.g. the global environment) keep their bindings
+   // in chains within the hash table, others in a single frame list
+   SEXP hashTableSEXP = HASHTAB(env);
+   if (hashTableSEXP != R_NilValue)
+   {
+      for (int i=0; i<Rf_length(hashTableSEXP); i++)
+         addFrameBindings(VECTOR_ELT(hashTableSEXP, i), includeAll, pBindings);
+   }
+   else
+   {
+      addFrameBindings(FRAME(env), includeAll, pBindings);
+   }
+}
+
+std::string symbolName(SEXP symbolSEXP)
+{
+   return std::string(CHAR(PRINTNAME(symbolSEXP)));
+}
+
 SEXP findVar(const std::string& name, const std::string& ns)
 {
    if (name.empty())
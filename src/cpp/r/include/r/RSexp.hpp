@@ -51,6 +51,17 @@ void listEnvironment(SEXP env,
                      bool includeAll,
                      Protect* pProtect,
                      std::vector<Variable>* pVariables);
+
+// bindings (symbol and value) within an environment's frame. unlike
+// listEnvironment this doesn't sort, allocate names, or force promises or
+// active bindings (for which the value is the binding function) so it is
+// suitable for cheaply detecting changes to large environments. note that
+// symbols are never garbage collected so can safely be used as keys
+typedef std::pair<SEXP,SEXP> Binding ;
+void listFrameBindings(SEXP env,
+                       bool includeAll,
+                       std::vector<Binding>* pBindings);
+std::string symbolName(SEXP symbolSEXP);
       
 // object info
 SEXP findVar(const std::string& name,
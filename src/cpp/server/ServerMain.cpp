@@ -118,6 +118,7 @@ Error httpServerInit()
 
    // initialize the http server
    Options& options = server::options();
+   s_pHttpServer->setIoServicePerThread(options.wwwIoServicePerThread());
    return s_pHttpServer->init(options.wwwAddress(), options.wwwPort());
 }
 
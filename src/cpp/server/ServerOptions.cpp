@@ -101,7 +101,10 @@ ProgramStatus Options::read(int argc, char * const argv[])
          "www files path")
       ("www-thread-pool-size",
          value<int>(&wwwThreadPoolSize_)->default_value(2),
-         "thread pool size");
+         "thread pool size")
+      ("www-io-service-per-thread",
+         value<bool>(&wwwIoServicePerThread_)->default_value(false),
+         "give each thread in the pool its own io service");
 
    // rsession
    options_description rsession("rsession");
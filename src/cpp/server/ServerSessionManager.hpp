@@ -54,9 +54,13 @@ public:
    // notificatio that a SIGCHLD was received
    void notifySIGCHLD();
 
+   // signal fired (on the thread which reaps children) when the session
+   // for a user exits
+   boost::signal<void(const std::string&)> onSessionExited;
+
 private:
-   void addActivePid(PidType pid);
-   void removeActivePid(PidType pid);
+   void addActivePid(PidType pid, const std::string& username);
+   std::string removeActivePid(PidType pid);
    std::vector<PidType> activePids();
 
 private:
@@ -65,9 +69,10 @@ private:
    typedef std::map<std::string,boost::posix_time::ptime> LaunchMap;
    LaunchMap pendingLaunches_;
 
-   // pids we have launched
+   // pids we have launched (and the users they were launched for)
    boost::mutex pidsMutex_;
-   std::vector<PidType> activePids_;
+   typedef std::map<PidType,std::string> PidMap;
+   PidMap activePids_;
 };
 
 // Lower-level global functions for launching sessions. These are used
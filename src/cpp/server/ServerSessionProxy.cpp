@@ -37,6 +37,7 @@
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
 #include <core/http/LocalStreamAsyncClient.hpp>
+#include <core/http/LocalStreamConnectionPool.hpp>
 #include <core/http/Util.hpp>
 #include <core/system/PosixSystem.hpp>
 #include <core/system/PosixUser.hpp>
@@ -59,6 +60,16 @@ namespace session_proxy {
    
 namespace {
 
+// idle connections to session local streams (reused across requests so
+// we don't pay for a connect/accept per request)
+boost::shared_ptr<http::LocalStreamConnectionPool> s_pConnectionPool;
+
+// close the idle connections to a session which has exited
+void onSessionExited(const std::string& username)
+{
+   s_pConnectionPool->evict(session::local_streams::streamPath(username));
+}
+
 void launchSessionRecovery(const std::string& username)
 {
    Error error = sessionManager().launchSession(username);
@@ -91,6 +102,60 @@ void handleProxyResponse(
 }
 
 
+void handleStreamWrite(
+      boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
+      const http::ReadContentFunction& readContent,
+      const Error& error)
+{
+   // if the write failed then stop streaming (dropping the read function
+   // closes the connection to the session)
+   if (error)
+   {
+      if (!http::isConnectionTerminatedError(error))
+      {
+         Error logError(error);
+         logError.addProperty("request-uri", ptrConnection->request().uri());
+         LOG_ERROR(logError);
+      }
+      return;
+   }
+
+   // otherwise read the next chunk of content
+   readContent();
+}
+
+void handleStreamHeaders(
+      boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
+      std::string username,
+      const http::Response& response,
+      const http::ReadContentFunction& readContent)
+{
+   // if there was a launch pending then remove it
+   sessionManager().removePendingLaunch(username);
+
+   // write the headers (and any content which arrived with them)
+   ptrConnection->response().assign(response);
+   ptrConnection->writeResponseHeaders(
+         boost::bind(handleStreamWrite, ptrConnection, readContent, _1));
+}
+
+void handleStreamContent(
+      boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
+      const std::string& content,
+      bool complete,
+      const http::ReadContentFunction& readContent)
+{
+   if (complete)
+   {
+      ptrConnection->close();
+      return;
+   }
+
+   ptrConnection->writeResponseContent(
+         content,
+         boost::bind(handleStreamWrite, ptrConnection, readContent, _1));
+}
+
 void logIfNotConnectionTerminated(const Error& error,
                                   const http::Request& request)
 {
@@ -181,19 +246,19 @@ void handleEventsError(
    ptrConnection->writeResponse();
 }
 
-void proxyRequest(
+boost::shared_ptr<http::LocalStreamAsyncClient> createProxyClient(
       const std::string& username,
       boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
-      const http::ErrorHandler& errorHandler,
-      const http::ConnectionRetryProfile& connectionRetryProfile =
-                                             http::ConnectionRetryProfile())
+      const http::ConnectionRetryProfile& connectionRetryProfile)
 {
    // calculate stream path
    FilePath streamPath = session::local_streams::streamPath(username);
 
    // create async client
    boost::shared_ptr<http::LocalStreamAsyncClient> pClient(
-    new http::LocalStreamAsyncClient(ptrConnection->ioService(), streamPath));
+    new http::LocalStreamAsyncClient(ptrConnection->ioService(),
+                                     streamPath,
+                                     s_pConnectionPool));
 
    // setup retry context
    if (!connectionRetryProfile.empty())
@@ -202,12 +267,43 @@ void proxyRequest(
    // assign request
    pClient->request().assign(ptrConnection->request());
 
+   return pClient;
+}
+
+void proxyRequest(
+      const std::string& username,
+      boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
+      const http::ErrorHandler& errorHandler,
+      const http::ConnectionRetryProfile& connectionRetryProfile =
+                                             http::ConnectionRetryProfile())
+{
+   boost::shared_ptr<http::LocalStreamAsyncClient> pClient =
+         createProxyClient(username, ptrConnection, connectionRetryProfile);
+
    // execute
    pClient->execute(
          boost::bind(handleProxyResponse, ptrConnection, username, _1),
          errorHandler);
 }
 
+// content (plots, help, file downloads, etc.) can be arbitrarily large so
+// rather than buffering it we forward it to the browser as it arrives
+void proxyStreamingRequest(
+      const std::string& username,
+      boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
+      const http::ErrorHandler& errorHandler,
+      const http::ConnectionRetryProfile& connectionRetryProfile)
+{
+   boost::shared_ptr<http::LocalStreamAsyncClient> pClient =
+         createProxyClient(username, ptrConnection, connectionRetryProfile);
+
+   // execute
+   pClient->executeStreaming(
+         boost::bind(handleStreamHeaders, ptrConnection, username, _1, _2),
+         boost::bind(handleStreamContent, ptrConnection, _1, _2, _3),
+         errorHandler);
+}
+
 // function used to periodically validate that the user is valid (has an
 // account on the system and belongs to the required group if specified)
 // we used to do this on every request but now do it on client_init and
@@ -242,6 +338,9 @@ bool validateUser(boost::shared_ptr<http::AsyncConnection> ptrConnection,
 
 Error initialize()
 { 
+   s_pConnectionPool.reset(new http::LocalStreamConnectionPool());
+   sessionManager().onSessionExited.connect(onSessionExited);
+
    return session::local_streams::createStreamsDir();
 }
 
@@ -269,7 +368,8 @@ void proxyContentRequest(
       const std::string& username,
       boost::shared_ptr<core::http::AsyncConnection> ptrConnection)
 {
-   proxyRequest(username,
+   proxyStreamingRequest(
+                username,
                 ptrConnection,
                 boost::bind(handleContentError, ptrConnection, username, _1),
                 sessionRetryProfile(username));
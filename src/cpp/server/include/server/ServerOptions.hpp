@@ -88,6 +88,11 @@ public:
       return wwwThreadPoolSize_;
    }
 
+   bool wwwIoServicePerThread() const
+   {
+      return wwwIoServicePerThread_;
+   }
+
    // auth
    bool authValidateUsers()
    {
@@ -156,6 +161,7 @@ private:
    std::string wwwPort_ ;
    std::string wwwLocalPath_ ;
    int wwwThreadPoolSize_;
+   bool wwwIoServicePerThread_;
    bool authValidateUsers_;
    std::string authRequiredUserGroup_;
    std::string authPamHelperPath_;
@@ -15,13 +15,14 @@
 
 #include "SessionClientEventQueue.hpp"
 
+#include <algorithm>
+
 #include <boost/foreach.hpp>
 
 
 #include <core/BoostThread.hpp>
 #include <core/Thread.hpp>
 #include <core/json/Json.hpp>
-#include <core/StringUtils.hpp>
 
 #include <r/session/RConsoleActions.hpp>
 
@@ -33,10 +34,23 @@ namespace {
 ClientEventQueue* s_pClientEventQueue = NULL;
 }
 
+bool coalesceLastWins(const ClientEvent&, const ClientEvent&)
+{
+   return true;
+}
+
 void initializeClientEventQueue()
 {
    BOOST_ASSERT(s_pClientEventQueue == NULL);
    s_pClientEventQueue = new ClientEventQueue();
+
+   // these events carry complete state so only the latest matters
+   using namespace client_events;
+   s_pClientEventQueue->setCoalesceFunction(kBusy, coalesceLastWins);
+   s_pClientEventQueue->setCoalesceFunction(kWorkspaceRefresh,
+                                            coalesceLastWins);
+   s_pClientEventQueue->setCoalesceFunction(kPlotsStateChanged,
+                                            coalesceLastWins);
 }
 
 ClientEventQueue& clientEventQueue()
@@ -47,43 +61,70 @@ ClientEventQueue& clientEventQueue()
 ClientEventQueue::ClientEventQueue()
    :  pMutex_(new boost::mutex()),
       pWaitForEventCondition_(new boost::condition()),
-      lastEventAddTime_(boost::posix_time::not_a_date_time)
+      lastEventAddTime_(boost::posix_time::not_a_date_time),
+      waitingThreads_(0)
 {
 }
 
+void ClientEventQueue::setCoalesceFunction(
+                              int type,
+                              const CoalesceFunction& coalesceFunction)
+{
+   LOCK_MUTEX(*pMutex_)
+   {
+      coalesceFunctions_[type] = coalesceFunction;
+   }
+   END_LOCK_MUTEX
+}
+
 void ClientEventQueue::add(const ClientEvent& event)
 { 
+   bool notify = false;
+
+   // If there's more console output than the client can even show, then
+   // we only keep the amount that the client can show. Too much output
+   // can overwhelm the client, causing it to become unresponsive.
+   int maxConsoleLines = 0;
+   if (event.type() == client_events::kConsoleWriteOutput)
+      maxConsoleLines = r::session::consoleActions().capacity() + 1;
+
    LOCK_MUTEX(*pMutex_)
    {
       // console output is batched up for compactness/efficiency.
       if (event.type() == client_events::kConsoleWriteOutput)
       {
          if (event.data().type() == json::StringType)
-            pendingConsoleOutput_ += event.data().get_str();
+            addPendingConsoleOutput(event.data().get_str(), maxConsoleLines);
       }
       else
       {
          // flush existing console output prior to adding an 
          // action of another type
          flushPendingConsoleOutput() ;
+
+         // remove any pending event this one supersedes
+         coalescePendingEvents(event);
          
          // add event to queue
          pendingEvents_.push_back(event) ;
       }
       
       lastEventAddTime_ = boost::posix_time::microsec_clock::universal_time();
+
+      notify = waitingThreads_ > 0;
    }
    END_LOCK_MUTEX
    
    // notify listeners that an event has been added
-   pWaitForEventCondition_->notify_all();
+   if (notify)
+      pWaitForEventCondition_->notify_all();
 }
    
 bool ClientEventQueue::hasEvents() 
 {
    LOCK_MUTEX(*pMutex_)
    {
-      return pendingEvents_.size() > 0 || pendingConsoleOutput_.length() > 0;
+      return pendingEvents_.size() > 0 || !pendingConsoleOutput_.empty();
    }
    END_LOCK_MUTEX
    
@@ -93,20 +134,23 @@ bool ClientEventQueue::hasEvents()
   
 void ClientEventQueue::remove(std::vector<ClientEvent>* pEvents)
 {
+   // take the pending events (swap rather than copy so that threads adding
+   // events don't wait on us copying the queue)
+   std::vector<ClientEvent> events;
    LOCK_MUTEX(*pMutex_)
    {
       // flush any pending output
       flushPendingConsoleOutput();
-      
-      // copy the events to the caller
-      pEvents->insert(pEvents->begin(), 
-                      pendingEvents_.begin(), 
-                      pendingEvents_.end());
-   
-      // clear pending events
-      pendingEvents_.clear();
+
+      events.swap(pendingEvents_);
    } 
    END_LOCK_MUTEX
+
+   // give the events to the caller
+   if (pEvents->empty())
+      pEvents->swap(events);
+   else
+      pEvents->insert(pEvents->begin(), events.begin(), events.end());
 }
    
 void ClientEventQueue::clear()
@@ -128,7 +172,19 @@ bool ClientEventQueue::waitForEvent(
    {
       unique_lock<mutex> lock(*pMutex_);
       system_time timeoutTime = get_system_time() + waitDuration;
-      return pWaitForEventCondition_->timed_wait(lock, timeoutTime);
+      waitingThreads_++;
+      bool notified = false;
+      try
+      {
+         notified = pWaitForEventCondition_->timed_wait(lock, timeoutTime);
+      }
+      catch(...)
+      {
+         waitingThreads_--;
+         throw;
+      }
+      waitingThreads_--;
+      return notified;
    }
    catch(const thread_resource_error& e) 
    { 
@@ -156,20 +212,81 @@ bool ClientEventQueue::eventAddedSince(const boost::posix_time::ptime& time)
 }
    
 
+void ClientEventQueue::coalescePendingEvents(const ClientEvent& event)
+{
+   // NOTE: private helper so no lock required (mutex is not recursive)
+
+   std::map<int,CoalesceFunction>::const_iterator it =
+                                    coalesceFunctions_.find(event.type());
+   if (it == coalesceFunctions_.end())
+      return;
+
+   // only the most recent pending event of this type is considered
+   // (any earlier ones were already judged against it when it was added)
+   for (std::vector<ClientEvent>::reverse_iterator
+           pendingIt = pendingEvents_.rbegin();
+        pendingIt != pendingEvents_.rend();
+        ++pendingIt)
+   {
+      if (pendingIt->type() == event.type())
+      {
+         if (it->second(*pendingIt, event))
+            pendingEvents_.erase(--(pendingIt.base()));
+         break;
+      }
+   }
+}
+
+void ClientEventQueue::addPendingConsoleOutput(const std::string& output,
+                                               int maxLines)
+{
+   // NOTE: private helper so no lock required (mutex is not recursive)
+
+   // sync capacity (dropping the oldest lines if it shrank)
+   std::size_t capacity = std::max(maxLines, 1);
+   if (pendingConsoleOutput_.capacity() != capacity)
+      pendingConsoleOutput_.rset_capacity(capacity);
+
+   std::string::size_type pos = 0;
+   while (pos < output.length())
+   {
+      // find the end of this line (including the newline)
+      std::string::size_type end = output.find('\n', pos);
+      end = (end == std::string::npos) ? output.length() : end + 1;
+
+      // continue the last line if it was incomplete, otherwise start a
+      // new one (which drops the oldest line if we are at capacity)
+      if (!pendingConsoleOutput_.empty() &&
+          *(pendingConsoleOutput_.back().rbegin()) != '\n')
+      {
+         pendingConsoleOutput_.back().append(output, pos, end - pos);
+      }
+      else
+      {
+         pendingConsoleOutput_.push_back(output.substr(pos, end - pos));
+      }
+
+      pos = end;
+   }
+}
+
 void ClientEventQueue::flushPendingConsoleOutput()
 {
    // NOTE: private helper so no lock required (mutex is not recursive) 
    
    if ( !pendingConsoleOutput_.empty() )
    {
-      // If there's more console output than the client can even show, then
-      // truncate it to the amount that the client can show. Too much output
-      // can overwhelm the client, causing it to become unresponsive.
-      int limit = r::session::consoleActions().capacity() + 1;
-      string_utils::trimLeadingLines(limit, &pendingConsoleOutput_);
+      std::string output;
+      for (boost::circular_buffer<std::string>::const_iterator
+              it = pendingConsoleOutput_.begin();
+           it != pendingConsoleOutput_.end();
+           ++it)
+      {
+         output.append(*it);
+      }
 
       pendingEvents_.push_back(ClientEvent(client_events::kConsoleWriteOutput, 
-                                           pendingConsoleOutput_)); 
+                                           output));
       pendingConsoleOutput_.clear() ;
    }
 }
@@ -16,11 +16,13 @@
 #ifndef SESSION_SESSION_CLIENT_EVENT_QUEUE_HPP
 #define SESSION_SESSION_CLIENT_EVENT_QUEUE_HPP
 
+#include <map>
 #include <string>
 #include <vector>
 
 #include <boost/function.hpp>
 #include <boost/utility.hpp>
+#include <boost/circular_buffer.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <core/BoostThread.hpp>
@@ -36,6 +38,15 @@ void initializeClientEventQueue();
 class ClientEventQueue;
 ClientEventQueue& clientEventQueue();
       
+// function which determines whether a pending event is superseded by a
+// newly added event of the same type (in which case the pending event is
+// discarded and the new event takes its place at the back of the queue)
+typedef boost::function<bool(const ClientEvent& pending,
+                             const ClientEvent& event)> CoalesceFunction;
+
+// coalesce function for events which carry complete state
+bool coalesceLastWins(const ClientEvent& pending, const ClientEvent& event);
+
 class ClientEventQueue : boost::noncopyable
 {   
 private:
@@ -47,6 +58,10 @@ public:
      
    // add an event
    void add(const ClientEvent& event);
+
+   // set the coalesce function for an event type (by default no events
+   // are coalesced)
+   void setCoalesceFunction(int type, const CoalesceFunction& coalesceFunction);
    
    // remove all available events
    void remove(std::vector<ClientEvent>* pEvents);
@@ -64,7 +79,9 @@ public:
    bool eventAddedSince(const boost::posix_time::ptime& time);
       
 private:   
+   void addPendingConsoleOutput(const std::string& output, int maxLines);
    void flushPendingConsoleOutput();
+   void coalescePendingEvents(const ClientEvent& event);
  
 private:
    // synchronization objects. heap based so they are never destructed
@@ -75,10 +92,17 @@ private:
    boost::mutex* pMutex_ ;
    boost::condition* pWaitForEventCondition_ ;
 
-   // instance data
-   std::string pendingConsoleOutput_ ;
+   // instance data. pending console output is kept as a ring of lines
+   // (the last of which may be incomplete) so that when output arrives
+   // faster than the client can take it the oldest lines are dropped as
+   // new ones arrive
+   boost::circular_buffer<std::string> pendingConsoleOutput_ ;
    std::vector<ClientEvent> pendingEvents_ ; 
    boost::posix_time::ptime lastEventAddTime_;
+   std::map<int,CoalesceFunction> coalesceFunctions_;
+
+   // number of threads in waitForEvent (no need to notify if zero)
+   int waitingThreads_;
    
 
 };
@@ -62,6 +62,8 @@
 #include <r/RExec.hpp>
 #include <r/ROptions.hpp>
 #include <r/RFunctionHook.hpp>
+#include <r/RRoutines.hpp>
+#include <r/RSexp.hpp>
 #include <r/RInterface.hpp>
 #include <r/session/RSession.hpp>
 #include <r/session/RClientState.hpp>
@@ -136,6 +138,19 @@ http::UriHandlerFunction s_defaultUriHandler;
 
 // json rpc methods
 core::json::JsonRpcAsyncMethods s_jsonRpcMethods;
+
+// json rpc methods which don't depend on R or other state owned by the
+// main thread. these are served by a pool of worker threads directly from
+// the http listener so they remain responsive while R is busy. they are
+// registered after the listener starts and validated against the active
+// client id (which changes on client_init) so access is synchronized
+boost::mutex s_threadSafeRpcMutex;
+core::json::JsonRpcMethods s_threadSafeRpcMethods;
+std::string s_threadSafeRpcClientId;
+
+// connections waiting to be served by the worker threads
+HttpConnectionQueue s_threadSafeRpcConnections;
+const int kThreadSafeRpcWorkers = 2;
    
 // R browseUrl handlers
 std::vector<module_context::RBrowseUrlHandler> s_rBrowseUrlHandlers;
@@ -316,6 +331,15 @@ FilePath getInitialWorkingDirectory()
 }
 
 
+void setThreadSafeRpcClientId(const std::string& clientId)
+{
+   LOCK_MUTEX(s_threadSafeRpcMutex)
+   {
+      s_threadSafeRpcClientId = clientId;
+   }
+   END_LOCK_MUTEX
+}
+
 void handleClientInit(const boost::function<void()>& initFunction,
                       boost::shared_ptr<HttpConnection> ptrConnection)
 {
@@ -324,6 +348,7 @@ void handleClientInit(const boost::function<void()>& initFunction,
    
    // calculate initialization parameters
    std::string clientId = session::persistentState().newActiveClientId();
+   setThreadSafeRpcClientId(clientId);
    bool resumed = s_rSessionResumed || s_sessionInitialized;
 
    // if we are resuming then we don't need to worry about events queued up
@@ -708,6 +733,118 @@ bool parseAndValidateJsonRpcConnection(
    return true;
 }
 
+bool lookupThreadSafeRpcMethod(const std::string& method,
+                               json::JsonRpcFunction* pFunction,
+                               std::string* pClientId)
+{
+   LOCK_MUTEX(s_threadSafeRpcMutex)
+   {
+      // nothing is served off the main thread until a client has connected
+      if (s_threadSafeRpcClientId.empty())
+         return false;
+
+      json::JsonRpcMethods::const_iterator it =
+                                       s_threadSafeRpcMethods.find(method);
+      if (it == s_threadSafeRpcMethods.end())
+         return false;
+
+      if (pFunction)
+         *pFunction = it->second;
+      if (pClientId)
+         *pClientId = s_threadSafeRpcClientId;
+      return true;
+   }
+   END_LOCK_MUTEX
+
+   return false;
+}
+
+void handleThreadSafeRpcConnection(
+                           boost::shared_ptr<HttpConnection> ptrConnection)
+{
+   // record the time just prior to execution of the event
+   // (so we can determine if any events were added during execution)
+   using namespace boost::posix_time;
+   ptime executeStartTime = microsec_clock::universal_time();
+
+   // requests we can't serve here (unparseable, from a stale client, or
+   // for a method other than the one in the uri) are handed back to the
+   // main thread so they receive exactly the response they otherwise would
+   json::JsonRpcRequest request;
+   json::JsonRpcFunction function;
+   std::string clientId;
+   Error error = json::parseJsonRpcRequest(ptrConnection->request().body(),
+                                           &request);
+   if (error ||
+       !lookupThreadSafeRpcMethod(request.method, &function, &clientId) ||
+       request.clientId != clientId)
+   {
+      httpConnectionListener().mainConnectionQueue().enqueConnection(
+                                                               ptrConnection);
+      return;
+   }
+
+   // check for old client version
+   if ( (request.version > 0) && (s_version > request.version) )
+   {
+      Error error(json::errc::InvalidClientVersion, ERROR_LOCATION);
+      ptrConnection->sendJsonRpcError(error);
+      return;
+   }
+
+   // execute the method
+   json::JsonRpcResponse response;
+   error = function(request, &response);
+   if (error)
+   {
+      ptrConnection->sendJsonRpcError(error);
+      return;
+   }
+
+   // after response functions and change detection run on the main thread
+   // so thread-safe methods can't make use of them
+   BOOST_ASSERT(!response.hasAfterResponse());
+
+   if (!clientEventQueue().eventAddedSince(executeStartTime))
+      response.setField(kEventsPending, "false");
+
+   ptrConnection->sendJsonRpcResponse(response);
+}
+
+void threadSafeRpcWorkerThread()
+{
+   while (true)
+   {
+      try
+      {
+         boost::shared_ptr<HttpConnection> ptrConnection =
+               s_threadSafeRpcConnections.dequeConnection(
+                                          boost::posix_time::seconds(30));
+         if (ptrConnection)
+            handleThreadSafeRpcConnection(ptrConnection);
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+}
+
+// called on the http listener thread for every connection
+bool enqueThreadSafeRpcConnection(
+                           boost::shared_ptr<HttpConnection> ptrConnection)
+{
+   if (!isJsonRpcRequest(ptrConnection))
+      return false;
+
+   // screen by the method name in the uri (the request body is validated
+   // by the worker which serves the connection)
+   std::string uri = ptrConnection->request().uri();
+   std::string method = uri.substr(std::string("/rpc/").length());
+   if (!lookupThreadSafeRpcMethod(method, NULL, NULL))
+      return false;
+
+   s_threadSafeRpcConnections.enqueConnection(ptrConnection);
+   return true;
+}
+
 void endHandleConnection(boost::shared_ptr<HttpConnection> ptrConnection,
                          ConnectionType connectionType,
                          http::Response* pResponse)
@@ -849,6 +986,172 @@ void setupForkHandlers()
 }
 #endif
 
+// priority classes for connections handled while R is busy. more urgent
+// classes are handled first and connections within a class are handled
+// in the order they arrived
+enum BusyConnectionPriority
+{
+   kBusyConnectionHold = -1,   // waitForMethod calls (left for R)
+   kBusyConnectionUrgent = 0,
+   kBusyConnectionNormal = 1,
+   kBusyConnectionBackground = 2,
+   kBusyConnectionPriorities = 3
+};
+
+int busyConnectionPriority(const std::string& uri)
+{
+   // waitForMethod calls are held (along with everything behind them) so
+   // that the waitForMethod logic can handle them in order
+   if (isWaitForMethodUri(uri))
+      return kBusyConnectionHold;
+
+   if (isMethod(uri, kInterrupt) ||
+       isMethod(uri, kConsoleInput) ||
+       isMethod(uri, kClientInit) ||
+       isMethod(uri, kQuitSession))
+   {
+      return kBusyConnectionUrgent;
+   }
+
+   // refreshes which the client issues on its own
+   static const char * const kBackgroundMethods[] = {
+      "list_files",
+      "git_all_status",
+      "git_full_status",
+      "svn_status",
+      "set_client_state",
+      NULL
+   };
+   for (int i = 0; kBackgroundMethods[i] != NULL; i++)
+   {
+      if (isMethod(uri, std::string("/") + kBackgroundMethods[i]))
+         return kBusyConnectionBackground;
+   }
+
+   return kBusyConnectionNormal;
+}
+
+// statistics on connections handled while R is busy
+struct BusyConnectionStats
+{
+   BusyConnectionStats()
+      : polls(0), budgetExhausted(0), maxQueueDepth(0)
+   {
+      for (int i = 0; i < kBusyConnectionPriorities; i++)
+      {
+         handled[i] = 0;
+         totalWait[i] = boost::posix_time::time_duration(0, 0, 0);
+         maxWait[i] = boost::posix_time::time_duration(0, 0, 0);
+      }
+   }
+
+   int polls;
+   int budgetExhausted;
+   std::size_t maxQueueDepth;
+   int handled[kBusyConnectionPriorities];
+   boost::posix_time::time_duration totalWait[kBusyConnectionPriorities];
+   boost::posix_time::time_duration maxWait[kBusyConnectionPriorities];
+};
+BusyConnectionStats s_busyConnectionStats;
+
+void handleBusyConnections()
+{
+   using namespace boost::posix_time;
+
+   HttpConnectionQueue& queue = httpConnectionListener().mainConnectionQueue();
+   std::size_t queueDepth = queue.size();
+   if (queueDepth == 0)
+      return;
+
+   BusyConnectionStats& stats = s_busyConnectionStats;
+   stats.polls++;
+   stats.maxQueueDepth = std::max(stats.maxQueueDepth, queueDepth);
+
+   // handle connections until we run out of them or exhaust our time
+   // budget (we always handle at least one so progress is guaranteed)
+   ptime deadline = microsec_clock::universal_time() +
+                    milliseconds(session::options().busyRequestBudgetMs());
+   while (true)
+   {
+      time_duration waitTime;
+      boost::shared_ptr<HttpConnection> ptrConnection =
+            queue.dequeConnection(busyConnectionPriority, &waitTime);
+      if (!ptrConnection)
+         break;
+
+      int priority = busyConnectionPriority(ptrConnection->request().uri());
+      stats.handled[priority]++;
+      stats.totalWait[priority] += waitTime;
+      stats.maxWait[priority] = std::max(stats.maxWait[priority], waitTime);
+
+      if ( isMethod(ptrConnection, kClientInit) )
+      {
+         // client_init means the user is attempting to reload the browser
+         // in the middle of a computation. process client_init and post
+         // a busy event as our initFunction
+         using namespace session::module_context;
+         ClientEvent busyEvent(client_events::kBusy, true);
+         handleClientInit(boost::bind(enqueClientEvent, busyEvent),
+                          ptrConnection);
+      }
+      else
+      {
+         handleConnection(ptrConnection, BackgroundConnection);
+      }
+
+      // R may have finished processing as a result of the connection (in
+      // which case waitForMethod takes over the queue)
+      if (!s_rProcessingInput)
+         break;
+
+      if (microsec_clock::universal_time() >= deadline)
+      {
+         if (queue.size() > 0)
+            stats.budgetExhausted++;
+         break;
+      }
+   }
+}
+
+SEXP rs_busyConnectionStats()
+{
+   const BusyConnectionStats& stats = s_busyConnectionStats;
+
+   json::Object statsJson;
+   statsJson["polls"] = stats.polls;
+   statsJson["budget_exhausted"] = stats.budgetExhausted;
+   statsJson["max_queue_depth"] = static_cast<int>(stats.maxQueueDepth);
+   statsJson["queue_depth"] = static_cast<int>(
+                     httpConnectionListener().mainConnectionQueue().size());
+
+   const char * const kPriorityNames[] = { "urgent", "normal", "background" };
+   for (int i = 0; i < kBusyConnectionPriorities; i++)
+   {
+      json::Object priorityJson;
+      priorityJson["handled"] = stats.handled[i];
+      priorityJson["mean_wait_ms"] = stats.handled[i] > 0 ?
+         static_cast<double>(stats.totalWait[i].total_milliseconds()) /
+                                                         stats.handled[i] :
+         0.0;
+      priorityJson["max_wait_ms"] =
+                  static_cast<double>(stats.maxWait[i].total_milliseconds());
+      statsJson[kPriorityNames[i]] = priorityJson;
+   }
+
+   r::sexp::Protect rProtect;
+   return r::sexp::create(statsJson, &rProtect);
+}
+
+Error registerBusyConnectionStats()
+{
+   R_CallMethodDef methodDef;
+   methodDef.name = "rs_busyConnectionStats";
+   methodDef.fun = (DL_FUNC) rs_busyConnectionStats;
+   methodDef.numArgs = 0;
+   r::routines::addCallMethod(methodDef);
+   return Success();
+}
+
 void polledEventHandler()
 {
    // if R is getting called after a fork this is likely multicore or
@@ -886,39 +1189,7 @@ void polledEventHandler()
    // check for a pending connections only while R is processing
    // (otherwise we'll handle them directly in waitForMethod)
    if (s_rProcessingInput)
-   {
-      // check the uri of the next connection
-      std::string nextConnectionUri =
-       httpConnectionListener().mainConnectionQueue().peekNextConnectionUri();
-
-      // if the uri is empty or if it one of our special waitForMethod calls
-      // then bails so that the waitForMethod logic can handle it
-      if (nextConnectionUri.empty() || isWaitForMethodUri(nextConnectionUri))
-         return;
-
-      // attempt to deque a connection and handle it. for now we just handle
-      // a single connection at a time (we'll be called back again if processing
-      // continues)
-      boost::shared_ptr<HttpConnection> ptrConnection =
-            httpConnectionListener().mainConnectionQueue().dequeConnection();
-      if (ptrConnection)
-      {
-         if ( isMethod(ptrConnection, kClientInit) )
-         {
-            // client_init means the user is attempting to reload the browser
-            // in the middle of a computation. process client_init and post
-            // a busy event as our initFunction
-            using namespace session::module_context;
-            ClientEvent busyEvent(client_events::kBusy, true);
-            handleClientInit(boost::bind(enqueClientEvent, busyEvent),
-                             ptrConnection);
-         }
-         else
-         {
-            handleConnection(ptrConnection, BackgroundConnection);
-         }
-      }
-   }
+      handleBusyConnections();
 }
 
 bool suspendSession(bool force)
@@ -1255,6 +1526,13 @@ Error ping(const core::json::JsonRpcRequest& request,
 Error startHttpConnectionListener()
 {
    initializeHttpConnectionListener();
+
+   // serve thread-safe rpc methods from a pool of worker threads
+   httpConnectionListener().setBackgroundConnectionHandler(
+                                             enqueThreadSafeRpcConnection);
+   for (int i = 0; i < kThreadSafeRpcWorkers; i++)
+      core::thread::safeLaunchThread(threadSafeRpcWorkerThread);
+
    return httpConnectionListener().start();
 }
 
@@ -1367,6 +1645,9 @@ Error rInit(const r::session::RInitInfo& rInitInfo)
       (bind(registerRpcMethod, "suspend_for_restart", suspendForRestart))
       (bind(registerRpcMethod, "ping", ping))
 
+      // statistics on requests handled while R is busy
+      (registerBusyConnectionStats)
+
       // signal handlers
       (registerSignalHandlers)
 
@@ -2305,6 +2586,24 @@ Error registerRpcMethod(const std::string& name,
    return Success();
 }
 
+Error registerThreadSafeRpcMethod(const std::string& name,
+                                  const core::json::JsonRpcFunction& function)
+{
+   // register normally as well (the main thread serves any requests which
+   // the worker threads hand back to it)
+   Error error = registerRpcMethod(name, function);
+   if (error)
+      return error;
+
+   LOCK_MUTEX(s_threadSafeRpcMutex)
+   {
+      s_threadSafeRpcMethods.insert(std::make_pair(name, function));
+   }
+   END_LOCK_MUTEX
+
+   return Success();
+}
+
 namespace {
 
 bool continueChildProcess(core::system::ProcessOperations&)
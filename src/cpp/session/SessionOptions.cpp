@@ -155,7 +155,10 @@ core::ProgramStatus Options::read(int argc, char * const argv[])
          "automatically create public folder")
       ("session-rprofile-on-resume-default",
           value<bool>(&rProfileOnResumeDefault_)->default_value(false),
-          "default user setting for running Rprofile on resume");
+          "default user setting for running Rprofile on resume")
+      ("session-busy-request-budget-ms",
+          value<int>(&busyRequestBudgetMs_)->default_value(25),
+          "time spent handling queued requests per poll while R is busy (ms)");
 
    // r options
    bool rShellEscape; // no longer works but don't want to break any
@@ -17,6 +17,7 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include <algorithm>
 
 #include <boost/bind.hpp>
@@ -203,6 +204,21 @@ void SourceDocument::setContents(const std::string& contents)
    hash_ = hash::crc32Hash(contents_);
 }
 
+// replace a range of the contents (updating the hash from the change
+// rather than rehashing all of the contents)
+void SourceDocument::replaceContents(std::size_t offset,
+                                     std::size_t length,
+                                     const std::string& replacement)
+{
+   boost::uint32_t crc = safe_convert::stringTo<boost::uint32_t>(hash_, 0);
+   hash_ = safe_convert::numberToString(hash::crc32Splice(crc,
+                                                          contents_,
+                                                          offset,
+                                                          length,
+                                                          replacement));
+   contents_.replace(offset, length, replacement);
+}
+
 // set contents from file
 Error SourceDocument::setPathAndContents(const std::string& path,
                                          bool allowSubstChars)
@@ -405,14 +421,126 @@ namespace {
 
 FilePath s_sourceDBPath;
 
-} // anonymous namespace
+// incremental changes to a document (e.g. autosaves) are appended to a
+// journal alongside its snapshot rather than rewriting the snapshot. each
+// entry is a json object on its own line recording the byte range which
+// was replaced, the replacement, and the document's other (non-contents)
+// fields after the change. entries are preceded by a newline so that an
+// entry torn by a crash can't run into the one appended after it
+const char * const kJournalExtension = ".journal";
 
-FilePath path()
+// the journal is compacted into the snapshot once it grows larger than
+// the document itself (or this floor)
+const uintmax_t kMinJournalCompactionSize = 64 * 1024;
+
+FilePath journalPath(const std::string& id)
 {
-   return s_sourceDBPath;
+   return source_database::path().complete(id + kJournalExtension);
 }
-   
-Error get(const std::string& id, boost::shared_ptr<SourceDocument> pDoc)
+
+// log the first journal entry which doesn't apply to the document (the
+// entries which follow it won't apply either)
+void logJournalMismatch(const std::string& id, bool* pLogged)
+{
+   if (*pLogged)
+      return;
+
+   LOG_WARNING_MESSAGE("Skipped source database journal entry for " + id +
+                       " which doesn't match the document (later entries "
+                       "will be skipped too)");
+   *pLogged = true;
+}
+
+void replayJournal(const std::string& id, json::Object* pDocJson)
+{
+   FilePath filePath = journalPath(id);
+   if (!filePath.exists())
+      return;
+
+   std::string journal;
+   Error error = readStringFromFile(filePath, &journal);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   json::Object& docJson = *pDocJson;
+   std::string contents = docJson["contents"].get_str();
+   boost::uint32_t crc = hash::crc32Checksum(contents);
+
+   bool loggedMismatch = false;
+   std::size_t pos = 0;
+   while (pos < journal.size())
+   {
+      std::size_t end = journal.find('\n', pos);
+      if (end == std::string::npos)
+         end = journal.size();
+      std::string line = journal.substr(pos, end - pos);
+      pos = end + 1;
+      if (line.empty())
+         continue;
+
+      // entries which are torn are skipped (the entries appended after a
+      // torn entry were based on the contents without it). entries which
+      // are out of range or don't produce the hash they recorded are also
+      // skipped, but the entries after them were based on contents which
+      // included them so those will fail the same checks -- the document
+      // is left as of the last entry which applied
+      json::Value entryValue;
+      if (!json::parse(line, &entryValue) ||
+          !json::isType<json::Object>(entryValue))
+      {
+         LOG_WARNING_MESSAGE("Skipped unreadable source database journal "
+                             "entry for " + id);
+         continue;
+      }
+
+      try
+      {
+         json::Object& entry = entryValue.get_obj();
+         std::size_t offset = entry["offset"].get_int();
+         std::size_t length = entry["length"].get_int();
+         json::Object& fields = entry["doc"].get_obj();
+         if (offset + length > contents.size())
+         {
+            logJournalMismatch(id, &loggedMismatch);
+            continue;
+         }
+
+         const std::string& replacement = entry["replacement"].get_str();
+         boost::uint32_t updatedCrc = hash::crc32Splice(crc,
+                                                        contents,
+                                                        offset,
+                                                        length,
+                                                        replacement);
+         if (safe_convert::numberToString(updatedCrc) !=
+             fields["hash"].get_str())
+         {
+            logJournalMismatch(id, &loggedMismatch);
+            continue;
+         }
+
+         contents.replace(offset, length, replacement);
+         crc = updatedCrc;
+         for (json::Object::const_iterator it = fields.begin();
+              it != fields.end();
+              ++it)
+         {
+            docJson[it->first] = it->second;
+         }
+      }
+      catch(const std::exception& e)
+      {
+         LOG_WARNING_MESSAGE("Skipped invalid source database journal "
+                             "entry for " + id + ": " + e.what());
+      }
+   }
+
+   docJson["contents"] = contents;
+}
+
+Error readDocument(const std::string& id, json::Object* pDocJson)
 {
    FilePath filePath = source_database::path().complete(id);
    if (filePath.exists())
@@ -432,9 +560,16 @@ Error get(const std::string& id, boost::shared_ptr<SourceDocument> pDoc)
                             ERROR_LOCATION);
       }
       
-      // initialize doc from json
-      json::Object jsonDoc = value.get_obj();
-      return pDoc->readFromJson(&jsonDoc);
+      // apply changes made since the snapshot
+      if (!json::isType<json::Object>(value))
+      {
+         return systemError(boost::system::errc::invalid_argument,
+                            ERROR_LOCATION);
+      }
+      *pDocJson = value.get_obj();
+      if (json::isType<std::string>((*pDocJson)["contents"]))
+         replayJournal(id, pDocJson);
+      return Success();
    }
    else
    {
@@ -443,8 +578,154 @@ Error get(const std::string& id, boost::shared_ptr<SourceDocument> pDoc)
    }
 }
 
+// documents are held in memory for the duration of the session (where
+// they are the source of truth). writes update the in-memory copy and are
+// flushed to the database shortly afterwards
+struct CachedDocument
+{
+   CachedDocument() : needsSnapshot(false) {}
+
+   json::Object docJson;
+
+   // pending writes: either a full snapshot or journal entries
+   bool needsSnapshot;
+   std::string pendingChanges;
+};
+
+typedef std::map<std::string, CachedDocument> DocumentCache;
+DocumentCache s_documentCache;
+bool s_flushScheduled = false;
+
+void cacheDocument(const SourceDocument& doc, json::Object* pFields)
+{
+   // record all but the contents in the passed fields
+   doc.writeToJson(pFields);
+   pFields->erase("contents");
+
+   json::Object& docJson = s_documentCache[doc.id()].docJson;
+   docJson = *pFields;
+   docJson["contents"] = doc.contents();
+}
+
+Error writeSnapshot(const std::string& id, const json::Object& docJson)
+{
+   std::ostringstream ostr ;
+   json::writeFormatted(docJson, ostr);
+   Error error = writeStringToFile(source_database::path().complete(id),
+                                   ostr.str());
+   if (error)
+      return error;
+
+   // the snapshot now reflects all changes
+   error = journalPath(id).removeIfExists();
+   if (error)
+      LOG_ERROR(error);
+
+   // write properties to durable storage (if there is a path)
+   json::Object::const_iterator pathIt = docJson.find("path");
+   json::Object::const_iterator propsIt = docJson.find("properties");
+   if (pathIt != docJson.end() && json::isType<std::string>(pathIt->second) &&
+       propsIt != docJson.end() && json::isType<json::Object>(propsIt->second))
+   {
+      error = putProperties(pathIt->second.get_str(),
+                            propsIt->second.get_obj());
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   return Success();
+}
+
+Error flushDocument(const std::string& id, CachedDocument* pCached)
+{
+   Error error;
+   if (pCached->needsSnapshot)
+   {
+      error = writeSnapshot(id, pCached->docJson);
+   }
+   else if (!pCached->pendingChanges.empty())
+   {
+      // compact into the snapshot once the journal has grown larger than
+      // the document itself
+      FilePath filePath = journalPath(id);
+      uintmax_t journalSize = filePath.exists() ? filePath.size() : 0;
+      json::Object::const_iterator it = pCached->docJson.find("contents");
+      uintmax_t docSize = it != pCached->docJson.end() ?
+                                             it->second.get_str().size() : 0;
+      if (journalSize + pCached->pendingChanges.size() >
+          std::max(kMinJournalCompactionSize, docSize))
+      {
+         error = writeSnapshot(id, pCached->docJson);
+      }
+      else
+      {
+         error = appendToFile(filePath, pCached->pendingChanges);
+      }
+   }
+
+   pCached->needsSnapshot = false;
+   pCached->pendingChanges.clear();
+   return error;
+}
+
+void flush()
+{
+   s_flushScheduled = false;
+
+   for (DocumentCache::iterator it = s_documentCache.begin();
+        it != s_documentCache.end();
+        ++it)
+   {
+      Error error = flushDocument(it->first, &(it->second));
+      if (error)
+         LOG_ERROR(error);
+   }
+}
+
+void scheduleFlush()
+{
+   if (!s_flushScheduled)
+   {
+      s_flushScheduled = true;
+      module_context::scheduleDelayedWork(
+                              boost::posix_time::milliseconds(500),
+                              flush,
+                              false);
+   }
+}
+
+} // anonymous namespace
+
+FilePath path()
+{
+   return s_sourceDBPath;
+}
+   
+Error get(const std::string& id, boost::shared_ptr<SourceDocument> pDoc)
+{
+   // read the document into the cache if necessary
+   DocumentCache::iterator it = s_documentCache.find(id);
+   if (it == s_documentCache.end())
+   {
+      json::Object docJson;
+      Error error = readDocument(id, &docJson);
+      if (error)
+         return error;
+
+      it = s_documentCache.insert(std::make_pair(id, CachedDocument())).first;
+      it->second.docJson = docJson;
+   }
+
+   // initialize doc from json
+   json::Object docJson = it->second.docJson;
+   return pDoc->readFromJson(&docJson);
+}
+
 Error getDurableProperties(const std::string& path, json::Object* pProperties)
 {
+   // properties are written along with their document
+   flush();
+
    return getProperties(path, pProperties);
 }
 
@@ -456,6 +737,8 @@ bool isSourceDocument(const FilePath& filePath)
       return false;
    else if (filePath.filename() == "lock_file")
       return false;
+   else if (filePath.extension() == kJournalExtension)
+      return false;
    else
       return true;
 }
@@ -530,6 +813,10 @@ bool isSafeSourceDocument(const FilePath& docDbPath,
 
 Error list(std::vector<boost::shared_ptr<SourceDocument> >* pDocs)
 {
+   // ensure every document is in the database (the documents themselves
+   // are read from the cache)
+   flush();
+
    std::vector<FilePath> files ;
    Error error = source_database::path().children(&files);
    if (error)
@@ -558,30 +845,61 @@ Error list(std::vector<boost::shared_ptr<SourceDocument> >* pDocs)
    
 Error put(boost::shared_ptr<SourceDocument> pDoc)
 {   
-   // write to file
-   FilePath filePath = source_database::path().complete(pDoc->id());
-   Error error = pDoc->writeToFile(filePath);
-   if (error)
-      return error ;
+   json::Object fields;
+   cacheDocument(*pDoc, &fields);
 
-   // write properties to durable storage (if there is a path)
-   if (!pDoc->path().empty())
+   CachedDocument& cached = s_documentCache[pDoc->id()];
+   cached.needsSnapshot = true;
+   cached.pendingChanges.clear();
+   scheduleFlush();
+
+   return Success();
+}
+   
+Error putChange(boost::shared_ptr<SourceDocument> pDoc,
+                std::size_t offset,
+                std::size_t length,
+                const std::string& replacement)
+{
+   json::Object fields;
+   cacheDocument(*pDoc, &fields);
+
+   // record the change along with the rest of the document's fields
+   // (unnecessary if a snapshot is already pending)
+   CachedDocument& cached = s_documentCache[pDoc->id()];
+   if (!cached.needsSnapshot)
    {
-      error = putProperties(pDoc->path(), pDoc->properties());
-      if (error)
-         LOG_ERROR(error);
+      json::Object entry;
+      entry["offset"] = static_cast<int>(offset);
+      entry["length"] = static_cast<int>(length);
+      entry["replacement"] = replacement;
+      entry["doc"] = fields;
+
+      std::ostringstream ostr;
+      ostr << std::endl;
+      json::write(entry, ostr);
+      cached.pendingChanges.append(ostr.str());
    }
+   scheduleFlush();
 
    return Success();
 }
-   
+
 Error remove(const std::string& id)
 {
+   s_documentCache.erase(id);
+
+   Error error = journalPath(id).removeIfExists();
+   if (error)
+      LOG_ERROR(error);
+
    return source_database::path().complete(id).removeIfExists();
 }
    
 Error removeAll()
 {
+   s_documentCache.clear();
+
    std::vector<FilePath> files ;
    Error error = source_database::path().children(&files);
    if (error)
@@ -601,6 +919,9 @@ namespace {
 
 void onShutdown(bool)
 {
+   // write any pending changes
+   flush();
+
    Error error = supervisor::detachFromSourceDatabase();
    if (error)
       LOG_ERROR(error);
@@ -17,13 +17,18 @@
 #define SESSION_HTTP_CONNECTION_IMPL_HPP
 
 
+#include <vector>
+
 #include <boost/array.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include <boost/utility.hpp>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/write.hpp>
 #include <boost/asio/placeholders.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
@@ -37,6 +42,7 @@
 #include <core/json/JsonRpc.hpp>
 
 #include <session/SessionHttpConnection.hpp>
+#include <session/SessionOptions.hpp>
 
 namespace session {
 
@@ -45,6 +51,23 @@ std::string rstudioRequestIdFromRequest(const core::http::Request& request)
    return request.headerValue("X-RS-RID");
 }
 
+// largest request body to keep. file uploads are limited by
+// limit-file-upload-size-mb (plus room for the rest of the multipart form)
+// so that an oversized upload is discarded as it arrives rather than read
+// into memory
+inline std::size_t maxRequestBodySize(const core::http::Request& request)
+{
+   const std::size_t kMaxFormOverhead = 64 * 1024;
+
+   int mbLimit = session::options().limitFileUploadSizeMb();
+   if (mbLimit <= 0 ||
+       !boost::algorithm::starts_with(request.uri(), "/upload"))
+      return 0;
+
+   return (static_cast<std::size_t>(mbLimit) * 1024 * 1024) +
+          kMaxFormOverhead;
+}
+
 template <typename ProtocolType>
 class HttpConnectionImpl :
    public HttpConnection,
@@ -58,9 +81,30 @@ public:
 
 public:
    HttpConnectionImpl(boost::asio::io_service& ioService,
-                      const Handler& handler)
-      : socket_(ioService), handler_(handler)
+                      const Handler& handler,
+                      bool allowKeepAlive = false)
+      : ioService_(ioService),
+        ptrSocket_(new typename ProtocolType::socket(ioService)),
+        handler_(handler),
+        allowKeepAlive_(allowKeepAlive),
+        socketReleased_(false)
    {
+      requestParser_.setMaxBodySize(maxRequestBodySize);
+   }
+
+private:
+   // constructor used to continue reading requests from a kept-alive socket
+   HttpConnectionImpl(
+         boost::asio::io_service& ioService,
+         const boost::shared_ptr<typename ProtocolType::socket>& ptrSocket,
+         const Handler& handler)
+      : ioService_(ioService),
+        ptrSocket_(ptrSocket),
+        handler_(handler),
+        allowKeepAlive_(true),
+        socketReleased_(false)
+   {
+      requestParser_.setMaxBodySize(maxRequestBodySize);
    }
 
    virtual ~HttpConnectionImpl()
@@ -82,12 +126,54 @@ public:
 
    virtual void sendResponse(const core::http::Response &response)
    {
+      // file bodies are streamed from disk after the headers (open the
+      // file up front so we can still respond with an error if need be)
+      boost::scoped_ptr<core::http::BodyFileReader> pBodyFileReader;
+      if (response.hasBodyFile())
+      {
+         pBodyFileReader.reset(new core::http::BodyFileReader(response));
+         core::Error error = pBodyFileReader->open();
+         if (error)
+         {
+            LOG_ERROR(error);
+            core::http::Response errorResponse;
+            errorResponse.setError(error);
+            sendResponse(errorResponse);
+            return;
+         }
+      }
+
+      // keep the connection open if the client asked us to and the
+      // response is delimited by its Content-Length
+      bool keepAlive = isKeepAlive(response);
+
       try
       {
          // write the response
-         boost::asio::write(socket_,
+         boost::asio::write(*ptrSocket_,
                             response.toBuffers(
-                                  core::http::Header::connectionClose()));
+                               keepAlive ?
+                                 core::http::Header("Connection", "keep-alive") :
+                                 core::http::Header::connectionClose()));
+
+         // write the file body in chunks
+         if (pBodyFileReader)
+         {
+            std::vector<char> buffer;
+            while (!pBodyFileReader->finished())
+            {
+               core::Error error = pBodyFileReader->readChunk(&buffer);
+               if (error)
+               {
+                  // the headers are already out so all we can do is
+                  // truncate the response by closing the connection
+                  LOG_ERROR(error);
+                  keepAlive = false;
+                  break;
+               }
+               boost::asio::write(*ptrSocket_, boost::asio::buffer(buffer));
+            }
+         }
       }
       catch(const boost::system::system_error& e)
       {
@@ -98,13 +184,20 @@ public:
          // log the error if it wasn't connection terminated
          if (!core::http::isConnectionTerminatedError(error))
             LOG_ERROR(error);
+
+         // can't reuse the connection
+         keepAlive = false;
       }
       CATCH_UNEXPECTED_EXCEPTION
 
-      // always close connection
+      // read the next request if we are keeping the connection alive,
+      // otherwise close it
       try
       {
-         close();
+         if (keepAlive)
+            readNextRequest();
+         else
+            close();
       }
       CATCH_UNEXPECTED_EXCEPTION
    }
@@ -143,8 +236,13 @@ public:
    // need to be closed in other circumstances
    virtual void close()
    {
+      // if the socket was handed off to read the next request on a kept
+      // alive connection then it is no longer ours to close
+      if (socketReleased_)
+         return;
+
       // always close connection
-      core::Error error = core::http::closeSocket(socket_);
+      core::Error error = core::http::closeSocket(*ptrSocket_);
       if (error)
          LOG_ERROR(error);
    }
@@ -160,11 +258,38 @@ public:
    }
 
    // get the socket
-   typename ProtocolType::socket& socket() { return socket_; }
+   typename ProtocolType::socket& socket() { return *ptrSocket_; }
 
 
 private:
 
+   bool isKeepAlive(const core::http::Response& response) const
+   {
+      return allowKeepAlive_ &&
+             boost::algorithm::iequals(request_.headerValue("Connection"),
+                                       "keep-alive") &&
+             response.containsHeader("Content-Length") &&
+             !boost::algorithm::iequals(response.headerValue("Connection"),
+                                        "close");
+   }
+
+   void readNextRequest()
+   {
+      // the handler (and anyone it passed us to) may still be holding a
+      // reference to this connection and its request, so rather than
+      // resetting ourselves we hand the socket off to a new connection
+      boost::shared_ptr<HttpConnectionImpl<ProtocolType> > ptrNextConnection(
+               new HttpConnectionImpl<ProtocolType>(ioService_,
+                                                    ptrSocket_,
+                                                    handler_));
+      socketReleased_ = true;
+
+      // start reading on the io_service thread
+      ioService_.post(boost::bind(
+                         &HttpConnectionImpl<ProtocolType>::startReading,
+                         ptrNextConnection));
+   }
+
    // async request reading interface
    void readSome()
    {
@@ -174,7 +299,7 @@ private:
       // (unless the handler chooses to retain a copy of it e.g. to perform
       // processing in a background thread)
 
-      socket_.async_read_some(
+      ptrSocket_->async_read_some(
          boost::asio::buffer(buffer_),
          boost::bind(
                &HttpConnectionImpl<ProtocolType>::handleRead,
@@ -196,11 +321,23 @@ private:
                                         buffer_.data(),
                                         buffer_.data() + bytesTransferred);
 
-            // error - return bad request
+            // error - return bad request (or, for an upload which was too
+            // large, the same error the upload handler returns for one)
             if (status == core::http::RequestParser::error)
             {
                core::http::Response response;
-               response.setStatusCode(core::http::status::BadRequest);
+               if (requestParser_.bodyTooLarge())
+               {
+                  response.setContentType("text/html");
+                  core::json::setJsonRpcError(
+                        core::systemError(boost::system::errc::file_too_large,
+                                          ERROR_LOCATION),
+                        &response);
+               }
+               else
+               {
+                  response.setStatusCode(core::http::status::BadRequest);
+               }
                sendResponse(response);
 
                // no more async operations w/ shared_from_this() initiated so this
@@ -246,12 +383,15 @@ private:
    }
 
 private:
-   typename ProtocolType::socket socket_;
+   boost::asio::io_service& ioService_;
+   boost::shared_ptr<typename ProtocolType::socket> ptrSocket_;
    boost::array<char, 8192> buffer_ ;
    core::http::RequestParser requestParser_ ;
    core::http::Request request_;
    std::string requestId_;
    Handler handler_;
+   bool allowKeepAlive_;
+   bool socketReleased_;
 };
 
 } // namespace session
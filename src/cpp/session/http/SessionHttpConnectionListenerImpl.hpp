@@ -170,6 +170,12 @@ public:
       return eventsConnectionQueue_;
    }
 
+   virtual void setBackgroundConnectionHandler(
+                                 const BackgroundConnectionHandler& handler)
+   {
+      backgroundConnectionHandler_ = handler;
+   }
+
 protected:
 
    virtual bool authenticate(boost::shared_ptr<HttpConnection>)
@@ -177,6 +183,12 @@ protected:
       return true;
    }
 
+   // should connections be kept open when a client requests keep-alive
+   virtual bool allowKeepAlive() const
+   {
+      return false;
+   }
+
 private:
    // required subclass hooks
    virtual core::Error initializeAcceptor(
@@ -198,7 +210,8 @@ private:
             boost::bind(
                  &HttpConnectionListenerImpl<ProtocolType>::enqueConnection,
                  this,
-                 _1))
+                 _1),
+            allowKeepAlive())
       );
 
       // wait for next connection
@@ -274,6 +287,14 @@ private:
       if (checkForAbort(ptrHttpConnection))
          return;
 
+      // give the background handler a chance to serve the connection
+      // without involving the foreground thread
+      if (backgroundConnectionHandler_ &&
+          backgroundConnectionHandler_(ptrHttpConnection))
+      {
+         return;
+      }
+
       // place the connection on the correct queue
       if (isGetEvents(ptrHttpConnection))
          eventsConnectionQueue_.enqueConnection(ptrHttpConnection);
@@ -387,6 +408,9 @@ private:
    HttpConnectionQueue mainConnectionQueue_;
    HttpConnectionQueue eventsConnectionQueue_;
 
+   // optional handler for connections served off the foreground thread
+   BackgroundConnectionHandler backgroundConnectionHandler_;
+
    // listener thread
    boost::thread listenerThread_ ;
 
@@ -31,7 +31,10 @@ void HttpConnectionQueue::enqueConnection(
    LOCK_MUTEX(*pMutex_)
    {
       // enque
-      queue_.push(ptrConnection);
+      QueuedConnection queued;
+      queued.ptrConnection = ptrConnection;
+      queued.enqueueTime = boost::posix_time::microsec_clock::universal_time();
+      queue_.push_back(queued);
    }
    END_LOCK_MUTEX
 
@@ -46,8 +49,8 @@ boost::shared_ptr<HttpConnection> HttpConnectionQueue::doDequeConnection()
       if (!queue_.empty())
       {
          // remove it
-         boost::shared_ptr<HttpConnection> next = queue_.front();
-         queue_.pop();
+         boost::shared_ptr<HttpConnection> next = queue_.front().ptrConnection;
+         queue_.pop_front();
 
          // return it
          return next;
@@ -87,12 +90,66 @@ boost::shared_ptr<HttpConnection> HttpConnectionQueue::dequeConnection(
       return boost::shared_ptr<HttpConnection>();
 }
 
+boost::shared_ptr<HttpConnection> HttpConnectionQueue::dequeConnection(
+                           const PriorityFunction& priorityFunction,
+                           boost::posix_time::time_duration* pWaitTime)
+{
+   LOCK_MUTEX(*pMutex_)
+   {
+      // find the most urgent connection ahead of any which are held
+      std::deque<QueuedConnection>::iterator next = queue_.end();
+      int nextPriority = 0;
+      for (std::deque<QueuedConnection>::iterator it = queue_.begin();
+           it != queue_.end();
+           ++it)
+      {
+         int priority = priorityFunction(it->ptrConnection->request().uri());
+         if (priority < 0)
+            break;
+
+         if (next == queue_.end() || priority < nextPriority)
+         {
+            next = it;
+            nextPriority = priority;
+         }
+      }
+
+      if (next == queue_.end())
+         return boost::shared_ptr<HttpConnection>();
+
+      // remove it
+      boost::shared_ptr<HttpConnection> ptrConnection = next->ptrConnection;
+      *pWaitTime = boost::posix_time::microsec_clock::universal_time() -
+                   next->enqueueTime;
+      queue_.erase(next);
+
+      // return it
+      return ptrConnection;
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy
+   return boost::shared_ptr<HttpConnection>();
+}
+
+std::size_t HttpConnectionQueue::size()
+{
+   LOCK_MUTEX(*pMutex_)
+   {
+      return queue_.size();
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy
+   return 0;
+}
+
 std::string HttpConnectionQueue::peekNextConnectionUri()
 {
    LOCK_MUTEX(*pMutex_)
    {
       if (!queue_.empty())
-         return queue_.front()->request().uri();
+         return queue_.front().ptrConnection->request().uri();
       else
          return std::string();
    }
@@ -109,6 +166,12 @@ bool HttpConnectionQueue::waitForConnection(
    try
    {
       unique_lock<mutex> lock(*pMutex_);
+
+      // a connection may have been enqueued since our caller last checked
+      // (in which case its notification has already been sent)
+      if (!queue_.empty())
+         return true;
+
       system_time timeoutTime = get_system_time() + waitDuration;
       return pWaitCondition_->timed_wait(lock, timeoutTime);
    }
@@ -49,6 +49,14 @@ public:
       }
    }
 
+protected:
+
+   // the rserver proxy keeps a pool of connections open to us
+   virtual bool allowKeepAlive() const
+   {
+      return true;
+   }
+
 private:
 
    virtual Error initializeAcceptor(
@@ -68,6 +68,9 @@
 
 */
 
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
 #include "SessionHttpConnectionQueue.hpp"
 
 namespace core {
@@ -96,6 +99,15 @@ public:
    // connection queues
 	virtual HttpConnectionQueue& mainConnectionQueue() = 0;
 	virtual HttpConnectionQueue& eventsConnectionQueue() = 0;
+
+   // handler which is offered each connection on the listener thread before
+   // it is queued (returns true if it has taken over the connection). this
+   // allows requests which don't need the foreground R thread to be served
+   // while it is busy. must be set prior to calling start()
+   typedef boost::function<bool(boost::shared_ptr<HttpConnection>)>
+                                                   BackgroundConnectionHandler;
+   virtual void setBackgroundConnectionHandler(
+                           const BackgroundConnectionHandler& handler) = 0;
 };
 
 } // namespace session
@@ -16,9 +16,10 @@
 #ifndef SESSION_HTTP_CONNECTION_QUEUE_HPP
 #define SESSION_HTTP_CONNECTION_QUEUE_HPP
 
-#include <queue>
+#include <deque>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
 
 #include <boost/utility.hpp>
 
@@ -48,8 +49,20 @@ public:
    boost::shared_ptr<HttpConnection> dequeConnection(
                const boost::posix_time::time_duration& waitDuration);
 
+   // deque the connection with the most urgent priority (the lowest value
+   // returned by priorityFunction for its uri, ties going to the connection
+   // which arrived first). a negative priority holds the connection (and
+   // all those behind it) in the queue. returns the time the connection
+   // spent waiting in the queue in pWaitTime
+   typedef boost::function<int(const std::string&)> PriorityFunction;
+   boost::shared_ptr<HttpConnection> dequeConnection(
+               const PriorityFunction& priorityFunction,
+               boost::posix_time::time_duration* pWaitTime);
+
    std::string peekNextConnectionUri();
 
+   std::size_t size();
+
 private:
    boost::shared_ptr<HttpConnection> doDequeConnection();
    bool waitForConnection(const boost::posix_time::time_duration& waitDuration);
@@ -64,7 +77,12 @@ private:
    boost::condition* pWaitCondition_ ;
 
    // instance data
-   std::queue<boost::shared_ptr<HttpConnection> > queue_;
+   struct QueuedConnection
+   {
+      boost::shared_ptr<HttpConnection> ptrConnection;
+      boost::posix_time::ptime enqueueTime;
+   };
+   std::deque<QueuedConnection> queue_;
 };
 
 } // namespace session
@@ -134,6 +134,14 @@ core::Error registerAsyncRpcMethod(
 core::Error registerRpcMethod(const std::string& name,
                               const core::json::JsonRpcFunction& function);
 
+// register an rpc method which may be executed on a background thread
+// (concurrently with R and other rpc methods). the method must not call R,
+// must synchronize access to any state it shares with the main thread,
+// and can't make use of JsonRpcResponse::setAfterResponse
+core::Error registerThreadSafeRpcMethod(
+                              const std::string& name,
+                              const core::json::JsonRpcFunction& function);
+
 
 core::Error executeAsync(const core::json::JsonRpcFunction& function,
                          const core::json::JsonRpcRequest& request,
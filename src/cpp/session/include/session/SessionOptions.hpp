@@ -122,6 +122,8 @@ public:
 
    bool rProfileOnResumeDefault() const { return rProfileOnResumeDefault_; }
 
+   int busyRequestBudgetMs() const { return busyRequestBudgetMs_; }
+
    unsigned int minimumUserId() const { return 100; }
    
    core::FilePath coreRSourcePath() const 
@@ -312,6 +314,7 @@ private:
    int timeoutMinutes_;
    bool createPublicFolder_;
    bool rProfileOnResumeDefault_;
+   int busyRequestBudgetMs_;
 
    // r
    std::string coreRSourcePath_;
@@ -60,6 +60,11 @@ public:
    // set contents from string
    void setContents(const std::string& contents);
 
+   // replace [offset, offset+length) of the contents (in bytes)
+   void replaceContents(std::size_t offset,
+                        std::size_t length,
+                        const std::string& replacement);
+
    // set contents from file
    core::Error setPathAndContents(const std::string& path,
                                   bool allowSubstChars = true);
@@ -136,6 +141,14 @@ core::Error getDurableProperties(const std::string& path,
                                  core::json::Object* pProperties);
 core::Error list(std::vector<boost::shared_ptr<SourceDocument> >* pDocs);
 core::Error put(boost::shared_ptr<SourceDocument> pDoc);
+
+// record a change to the document's contents (the replacement of the
+// bytes [offset, offset + length) of its prior contents) without rewriting
+// the entire document
+core::Error putChange(boost::shared_ptr<SourceDocument> pDoc,
+                      std::size_t offset,
+                      std::size_t length,
+                      const std::string& replacement);
 core::Error remove(const std::string& id);
 core::Error removeAll();
 
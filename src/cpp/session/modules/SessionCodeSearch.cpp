@@ -18,12 +18,16 @@
 #include <iostream>
 #include <vector>
 #include <set>
+#include <map>
+#include <algorithm>
 
 #include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
 #include <boost/regex.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 
 #include <core/Error.hpp>
@@ -31,6 +35,8 @@
 #include <core/FilePath.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/SafeConvert.hpp>
+#include <core/Thread.hpp>
+#include <core/BoostThread.hpp>
 
 #include <core/r_util/RSourceIndex.hpp>
 
@@ -94,12 +100,425 @@ bool enforceMaxResults(std::size_t maxResults,
    }
 }
 
+// index of names (e.g. file names or symbols) along with an associated value
+// for efficient case-insensitive searching. prefix searches are satisfied
+// from a sorted map of names and substring searches from trigram postings
+// (the lists of ids of names which contain each trigram). removed names
+// are only marked dead (so postings don't need to be edited) and the owner
+// rebuilds the index once they dominate.
+template <typename T>
+class NameIndex : boost::noncopyable
+{
+public:
+   NameIndex()
+      : liveCount_(0)
+   {
+   }
+
+   // COPYING: prohibited
+
+   std::size_t add(const std::string& name, const T& value)
+   {
+      std::size_t id = names_.size();
+      names_.push_back(string_utils::toLower(name));
+      values_.push_back(value);
+      live_.push_back(true);
+      liveCount_++;
+
+      const std::string& lowerName = names_.back();
+      prefixes_.insert(std::make_pair(lowerName, id));
+      std::vector<boost::uint32_t> trigrams;
+      nameTrigrams(lowerName, &trigrams);
+      BOOST_FOREACH(boost::uint32_t trigram, trigrams)
+      {
+         // ids are allocated in increasing order so postings stay sorted
+         std::vector<std::size_t>& postings = trigrams_[trigram];
+         if (postings.empty() || postings.back() != id)
+            postings.push_back(id);
+      }
+
+      return id;
+   }
+
+   void remove(std::size_t id)
+   {
+      if (id >= live_.size() || !live_[id])
+         return;
+
+      live_[id] = false;
+      liveCount_--;
+
+      typedef std::multimap<std::string,std::size_t>::iterator iterator;
+      std::pair<iterator,iterator> range = prefixes_.equal_range(names_[id]);
+      for (iterator it = range.first; it != range.second; ++it)
+      {
+         if (it->second == id)
+         {
+            prefixes_.erase(it);
+            break;
+         }
+      }
+   }
+
+   // is most of the index dead? (if so the owner should rebuild it)
+   bool needsRebuild() const
+   {
+      std::size_t dead = names_.size() - liveCount_;
+      return dead >= 1024 && dead >= liveCount_;
+   }
+
+   void clear()
+   {
+      names_.clear();
+      values_.clear();
+      live_.clear();
+      liveCount_ = 0;
+      prefixes_.clear();
+      trigrams_.clear();
+   }
+
+   const std::string& lowerName(std::size_t id) const { return names_[id]; }
+   const T& value(std::size_t id) const { return values_[id]; }
+
+   // find the ids of all live names matching the term (wildcard terms
+   // containing '*' are also supported)
+   void find(const std::string& term,
+             bool prefixOnly,
+             std::vector<std::size_t>* pIds) const
+   {
+      std::string lowerTerm = string_utils::toLower(term);
+
+      // wildcard: narrow by the literal text before the first '*' (or the
+      // longest literal fragment) and then verify using the regex
+      if (lowerTerm.find('*') != std::string::npos)
+      {
+         boost::regex pattern = regex_utils::wildcardPatternToRegex(lowerTerm);
+
+         std::vector<std::size_t> candidates;
+         std::string literal = lowerTerm.substr(0, lowerTerm.find('*'));
+         if (prefixOnly)
+            findPrefix(literal, &candidates);
+         else
+            findContains(longestLiteral(lowerTerm), &candidates);
+
+         BOOST_FOREACH(std::size_t id, candidates)
+         {
+            if (regex_utils::textMatches(names_[id], pattern, prefixOnly, true))
+               pIds->push_back(id);
+         }
+      }
+      else if (prefixOnly)
+      {
+         findPrefix(lowerTerm, pIds);
+      }
+      else
+      {
+         findContains(lowerTerm, pIds);
+      }
+   }
+
+private:
+
+   static boost::uint32_t trigramAt(const std::string& text, std::size_t pos)
+   {
+      return (static_cast<boost::uint32_t>(
+                     static_cast<unsigned char>(text[pos])) << 16) |
+             (static_cast<boost::uint32_t>(
+                     static_cast<unsigned char>(text[pos+1])) << 8) |
+              static_cast<boost::uint32_t>(
+                     static_cast<unsigned char>(text[pos+2]));
+   }
+
+   static void nameTrigrams(const std::string& text,
+                            std::vector<boost::uint32_t>* pTrigrams)
+   {
+      for (std::size_t i = 0; i + 3 <= text.length(); i++)
+         pTrigrams->push_back(trigramAt(text, i));
+      std::sort(pTrigrams->begin(), pTrigrams->end());
+      pTrigrams->erase(std::unique(pTrigrams->begin(), pTrigrams->end()),
+                       pTrigrams->end());
+   }
+
+   static std::string longestLiteral(const std::string& wildcardTerm)
+   {
+      std::string longest;
+      std::string::size_type pos = 0;
+      while (pos <= wildcardTerm.length())
+      {
+         std::string::size_type end = wildcardTerm.find('*', pos);
+         if (end == std::string::npos)
+            end = wildcardTerm.length();
+         if ((end - pos) > longest.length())
+            longest = wildcardTerm.substr(pos, end - pos);
+         pos = end + 1;
+      }
+      return longest;
+   }
+
+   void findPrefix(const std::string& lowerPrefix,
+                   std::vector<std::size_t>* pIds) const
+   {
+      typedef std::multimap<std::string,std::size_t>::const_iterator iterator;
+      for (iterator it = prefixes_.lower_bound(lowerPrefix);
+           it != prefixes_.end() &&
+              it->first.compare(0, lowerPrefix.length(), lowerPrefix) == 0;
+           ++it)
+      {
+         pIds->push_back(it->second);
+      }
+   }
+
+   void findContains(const std::string& lowerTerm,
+                     std::vector<std::size_t>* pIds) const
+   {
+      // terms too short to have a trigram require a scan
+      if (lowerTerm.length() < 3)
+      {
+         for (std::size_t id = 0; id < names_.size(); id++)
+         {
+            if (live_[id] && names_[id].find(lowerTerm) != std::string::npos)
+               pIds->push_back(id);
+         }
+         return;
+      }
+
+      // intersect the postings for each of the term's trigrams (starting
+      // with the shortest so the working set is as small as possible)
+      std::vector<boost::uint32_t> trigrams;
+      nameTrigrams(lowerTerm, &trigrams);
+      std::vector<const std::vector<std::size_t>*> postings;
+      BOOST_FOREACH(boost::uint32_t trigram, trigrams)
+      {
+         typename Trigrams::const_iterator it = trigrams_.find(trigram);
+         if (it == trigrams_.end())
+            return;
+         postings.push_back(&(it->second));
+      }
+      std::sort(postings.begin(), postings.end(), &NameIndex::shorterPostings);
+
+      std::vector<std::size_t> candidates(*postings[0]);
+      for (std::size_t i = 1; i < postings.size() && !candidates.empty(); i++)
+      {
+         std::vector<std::size_t> intersection;
+         std::set_intersection(candidates.begin(), candidates.end(),
+                               postings[i]->begin(), postings[i]->end(),
+                               std::back_inserter(intersection));
+         candidates.swap(intersection);
+      }
+
+      // verify candidates (trigrams can match out of order)
+      BOOST_FOREACH(std::size_t id, candidates)
+      {
+         if (live_[id] && names_[id].find(lowerTerm) != std::string::npos)
+            pIds->push_back(id);
+      }
+   }
+
+   static bool shorterPostings(const std::vector<std::size_t>* pA,
+                               const std::vector<std::size_t>* pB)
+   {
+      return pA->size() < pB->size();
+   }
+
+private:
+   typedef boost::unordered_map<boost::uint32_t, std::vector<std::size_t> >
+                                                                  Trigrams;
+   std::vector<std::string> names_;
+   std::vector<T> values_;
+   std::vector<bool> live_;
+   std::size_t liveCount_;
+   std::multimap<std::string,std::size_t> prefixes_;
+   Trigrams trigrams_;
+};
+
+// rank matches of a term: exact matches first, then prefix matches, then
+// shorter names, then alphabetically
+template <typename T>
+class RankByName
+{
+public:
+   RankByName(const NameIndex<T>& index, const std::string& term)
+      : index_(index), term_(string_utils::toLower(term))
+   {
+   }
+
+   bool operator()(std::size_t id1, std::size_t id2) const
+   {
+      const std::string& name1 = index_.lowerName(id1);
+      const std::string& name2 = index_.lowerName(id2);
+      int score1 = score(name1);
+      int score2 = score(name2);
+      if (score1 != score2)
+         return score1 < score2;
+      else if (name1.length() != name2.length())
+         return name1.length() < name2.length();
+      else
+         return name1 < name2;
+   }
+
+private:
+   int score(const std::string& name) const
+   {
+      if (name == term_)
+         return 0;
+      else if (boost::algorithm::starts_with(name, term_))
+         return 1;
+      else
+         return 2;
+   }
+
+private:
+   const NameIndex<T>& index_;
+   std::string term_;
+};
+
+// sort the top maxResults ids (those beyond are left unordered)
+template <typename T>
+void rankMatches(const NameIndex<T>& index,
+                 const std::string& term,
+                 std::size_t maxResults,
+                 std::vector<std::size_t>* pIds)
+{
+   std::size_t count = std::min(maxResults, pIds->size());
+   std::partial_sort(pIds->begin(),
+                     pIds->begin() + count,
+                     pIds->end(),
+                     RankByName<T>(index, term));
+}
+
+// request to index a source file on a worker thread. the encoding and
+// context are resolved on the main thread (they depend on session state).
+// files which need to be decoded by R are read by the worker and then
+// resubmitted along with their decoded code.
+struct IndexRequest
+{
+   IndexRequest() : generation(0), decoded(false) {}
+   FileInfo fileInfo;
+   std::string encoding;
+   std::string context;
+   unsigned generation;
+   bool decoded;
+   std::string code;
+};
+
+struct IndexResult
+{
+   IndexResult() : generation(0), needsDecoding(false) {}
+   FileInfo fileInfo;
+   unsigned generation;
+   boost::shared_ptr<r_util::RSourceIndex> pIndex;
+   Error error;
+
+   // encoded contents which the main thread must decode and resubmit
+   bool needsDecoding;
+   std::string encoding;
+   std::string encodedCode;
+};
+
+typedef core::thread::ThreadsafeQueue<IndexRequest> IndexRequestQueue;
+typedef core::thread::ThreadsafeQueue<IndexResult> IndexResultQueue;
+
+// set on shutdown to stop the index workers
+boost::mutex s_indexWorkersMutex;
+bool s_indexWorkersStopped = false;
+
+bool indexWorkersStopped()
+{
+   LOCK_MUTEX(s_indexWorkersMutex)
+   {
+      return s_indexWorkersStopped;
+   }
+   END_LOCK_MUTEX
+
+   return true;
+}
+
+void stopIndexWorkers()
+{
+   LOCK_MUTEX(s_indexWorkersMutex)
+   {
+      s_indexWorkersStopped = true;
+   }
+   END_LOCK_MUTEX
+}
+
+// r::util::iconvstr only calls into R (which can't be done from the index
+// workers) when the encoding is something other than UTF-8
+bool isUtf8Encoding(const std::string& encoding)
+{
+   return encoding.empty() || encoding == "UTF-8";
+}
+
+void indexWorkerThread(boost::shared_ptr<IndexRequestQueue> pRequests,
+                       boost::shared_ptr<IndexResultQueue> pResults)
+{
+   while (!indexWorkersStopped())
+   {
+      IndexRequest request;
+      if (!pRequests->deque(&request, boost::posix_time::seconds(1)))
+         continue;
+
+      IndexResult result;
+      result.fileInfo = request.fileInfo;
+      result.generation = request.generation;
+
+      try
+      {
+         // read the file (unless it has already been read and decoded)
+         std::string code;
+         if (request.decoded)
+         {
+            code = request.code;
+         }
+         else
+         {
+            FilePath filePath(request.fileInfo.absolutePath());
+            std::string encodedCode;
+            result.error = readStringFromFile(filePath,
+                                              &encodedCode,
+                                              options().sourceLineEnding());
+            if (!result.error && isUtf8Encoding(request.encoding))
+            {
+               result.error = module_context::convertToUtf8(encodedCode,
+                                                            request.encoding,
+                                                            true,
+                                                            &code);
+            }
+            else if (!result.error)
+            {
+               result.needsDecoding = true;
+               result.encoding = request.encoding;
+               result.encodedCode = encodedCode;
+            }
+         }
+
+         // index it
+         if (!result.error && !result.needsDecoding)
+         {
+            result.pIndex.reset(new r_util::RSourceIndex(request.context,
+                                                         code));
+         }
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+
+      // always post a result so the main thread can account for it
+      pResults->enque(result);
+   }
+}
+
 
 class SourceFileIndex : boost::noncopyable
 {
 public:
    SourceFileIndex()
-      : indexing_(false)
+      : indexing_(false),
+        publishing_(false),
+        pRequests_(new IndexRequestQueue()),
+        pResults_(new IndexResultQueue()),
+        workersStarted_(false),
+        nextGeneration_(0),
+        outstanding_(0),
+        filesIndexed_(0)
    {
    }
 
@@ -114,6 +533,7 @@ public:
    {
       // add all source files to the indexing queue
       using namespace core::system;
+      beginIndexing();
       for ( ; begin != end; ++begin)
       {
          if (isSourceFile(*begin))
@@ -145,6 +565,7 @@ public:
          return;
 
       // add to the queue
+      beginIndexing();
       indexingQueue_.push(event);
 
       // schedule indexing if necessary. don't index anything immediately
@@ -166,36 +587,36 @@ public:
                            const std::set<std::string>& excludeContexts,
                            r_util::RSourceItem* pFunctionItem)
    {
-      std::vector<r_util::RSourceItem> sourceItems;
-      BOOST_FOREACH(const Entry& entry, entries_)
+      // find all symbols with this name (prefix search on the full name
+      // then exact comparison) and take the first by context
+      std::vector<std::size_t> ids;
+      symbols_.find(functionName, true, &ids);
+
+      const r_util::RSourceItem* pFound = NULL;
+      BOOST_FOREACH(std::size_t id, ids)
       {
-         // bail if there is no index
-         if (!entry.hasIndex())
-            continue;
+         const r_util::RSourceItem& item = symbols_.value(id);
 
          // bail if this is an exluded context
-         if (excludeContexts.find(entry.pIndex->context()) !=
-             excludeContexts.end())
-         {
+         if (excludeContexts.find(item.context()) != excludeContexts.end())
             continue;
-         }
-
-         // scan the next index
-         sourceItems.clear();
-         entry.pIndex->search(
-                  boost::bind(isGlobalFunctionNamed, _1, functionName),
-                  std::back_inserter(sourceItems));
 
-         // return if we got a hit
-         if (sourceItems.size() > 0)
+         if (isGlobalFunctionNamed(item, functionName) &&
+             (pFound == NULL || item.context() < pFound->context()))
          {
-            *pFunctionItem = sourceItems[0];
-            return true;
+            pFound = &item;
          }
       }
 
-      // none found
-      return false;
+      if (pFound != NULL)
+      {
+         *pFunctionItem = *pFound;
+         return true;
+      }
+      else
+      {
+         return false;
+      }
    }
 
    void searchSource(const std::string& term,
@@ -204,31 +625,24 @@ public:
                      const std::set<std::string>& excludeContexts,
                      std::vector<r_util::RSourceItem>* pItems)
    {
-      BOOST_FOREACH(const Entry& entry, entries_)
+      // find matching symbols which aren't in an excluded context
+      std::vector<std::size_t> ids;
+      symbols_.find(term, prefixOnly, &ids);
+      std::vector<std::size_t> includedIds;
+      BOOST_FOREACH(std::size_t id, ids)
       {
-         // skip if it has no index
-         if (!entry.hasIndex())
-            continue;
-
-         // bail if this is an exluded context
-         if (excludeContexts.find(entry.pIndex->context()) !=
-             excludeContexts.end())
-         {
-            continue;
-         }
-
-         // scan the next index
-         entry.pIndex->search(term,
-                              prefixOnly,
-                              false,
-                              std::back_inserter(*pItems));
+         const std::string& context = symbols_.value(id).context();
+         if (excludeContexts.find(context) == excludeContexts.end())
+            includedIds.push_back(id);
+      }
 
-         // return if we are past maxResults
-         if (pItems->size() >= maxResults)
-         {
-            pItems->resize(maxResults);
-            return;
-         }
+      // return the best maxResults
+      rankMatches(symbols_, term, maxResults, &includedIds);
+      for (std::size_t i = 0;
+           i < includedIds.size() && pItems->size() < maxResults;
+           i++)
+      {
+         pItems->push_back(symbols_.value(includedIds[i]));
       }
    }
 
@@ -239,47 +653,18 @@ public:
                     json::Array* pPaths,
                     bool* pMoreAvailable)
    {
-      // default to no more available
-      *pMoreAvailable = false;
-
-      // create wildcard pattern if the search has a '*'
-      boost::regex pattern = regexFromTerm(term);
-
-      // iterate over the files
-      BOOST_FOREACH(const Entry& entry, entries_)
+      // find and rank matching file names
+      std::vector<std::size_t> ids;
+      fileNames_.find(term, prefixOnly, &ids);
+      rankMatches(fileNames_, term, maxResults, &ids);
+
+      // return the best maxResults
+      *pMoreAvailable = ids.size() > maxResults;
+      for (std::size_t i = 0; i < ids.size() && i < maxResults; i++)
       {
-         // get file and name
-         FilePath filePath(entry.fileInfo.absolutePath());
-         std::string name = filePath.filename();
-
-         // compare for match (wildcard or standard)
-         bool matches = false;
-         if (!pattern.empty())
-         {
-            matches = regex_utils::textMatches(name,
-                                               pattern,
-                                               prefixOnly,
-                                               false);
-         }
-         else
-         {
-            if (prefixOnly)
-               matches = boost::algorithm::istarts_with(name, term);
-            else
-               matches = boost::algorithm::icontains(name, term);
-         }
-
-         // add the file if we found a match
-         if (matches)
-         {
-            // name and aliased path
-            pNames->push_back(filePath.filename());
-            pPaths->push_back(module_context::createAliasedPath(filePath));
-
-            // return if we are past max results
-            if (enforceMaxResults(maxResults, pNames, pPaths, pMoreAvailable))
-               return;
-         }
+         FilePath filePath(fileNames_.value(ids[i]).absolutePath());
+         pNames->push_back(filePath.filename());
+         pPaths->push_back(module_context::createAliasedPath(filePath));
       }
    }
 
@@ -288,6 +673,11 @@ public:
       indexing_ = false;
       indexingQueue_ = std::queue<core::system::FileChangeEvent>();
       entries_.clear();
+      clearNameIndexes();
+
+      // results still in flight will be discarded when they arrive
+      pendingGenerations_.clear();
+      indexStartTime_ = boost::posix_time::not_a_date_time;
    }
 
 private:
@@ -318,6 +708,13 @@ private:
       }
    };
 
+   // ids of an entry's file name and symbols within the name indexes
+   struct EntryIds
+   {
+      std::size_t fileNameId;
+      std::vector<std::size_t> symbolIds;
+   };
+
 private:
 
    bool dequeAndIndex()
@@ -354,34 +751,160 @@ private:
 
       // return status
       indexing_ = !indexingQueue_.empty();
+      if (!indexing_)
+         checkFullyIndexed();
       return indexing_;
    }
 
    void updateIndexEntry(const FileInfo& fileInfo)
    {
-      // index the source if necessary
-      boost::shared_ptr<r_util::RSourceIndex> pIndex;
+      // R source files are read and indexed on worker threads (the entry
+      // is added when the result is published back to this thread)
       if (isIndexableSourceFile(fileInfo))
       {
-         // read the file
          FilePath filePath(fileInfo.absolutePath());
-         std::string code;
-         Error error = module_context::readAndDecodeFile(
-                                 filePath,
-                                 projects::projectContext().defaultEncoding(),
+         IndexRequest request;
+         request.fileInfo = fileInfo;
+         request.encoding = projects::projectContext().defaultEncoding();
+         request.context = module_context::createAliasedPath(filePath);
+         request.generation = ++nextGeneration_;
+         pendingGenerations_[fileInfo.absolutePath()] = request.generation;
+         submitIndexRequest(request);
+      }
+      else
+      {
+         pendingGenerations_.erase(fileInfo.absolutePath());
+         addIndexEntry(fileInfo, boost::shared_ptr<r_util::RSourceIndex>());
+      }
+   }
+
+   void submitIndexRequest(const IndexRequest& request)
+   {
+      // start the workers the first time through
+      if (!workersStarted_)
+      {
+         workersStarted_ = true;
+         unsigned workers = std::max(1U, std::min(4U,
+                                 boost::thread::hardware_concurrency()));
+         for (unsigned i = 0; i < workers; i++)
+         {
+            core::thread::safeLaunchThread(
+                  boost::bind(indexWorkerThread, pRequests_, pResults_));
+         }
+      }
+
+      pRequests_->enque(request);
+      outstanding_++;
+
+      // publish results back to the main thread in periodic batches
+      if (!publishing_)
+      {
+         publishing_ = true;
+
+         module_context::schedulePeriodicWork(
+                     boost::posix_time::milliseconds(20),
+                     boost::bind(&SourceFileIndex::publishIndexResults, this),
+                     false /* allow indexing even when non-idle */,
+                     false);
+      }
+   }
+
+   bool publishIndexResults()
+   {
+      // apply the results which are ready (bounded so that a large
+      // backlog doesn't tie up the main thread)
+      const int kMaxResultsPerBatch = 250;
+      IndexResult result;
+      for (int i = 0; i < kMaxResultsPerBatch && pResults_->deque(&result); i++)
+      {
+         outstanding_--;
+
+         // skip results which have been superseded (by a later change to
+         // the file, its removal, or the index being cleared)
+         std::map<std::string,unsigned>::iterator it =
+                        pendingGenerations_.find(result.fileInfo.absolutePath());
+         if (it == pendingGenerations_.end() ||
+             it->second != result.generation)
+         {
+            continue;
+         }
+
+         // decode files which aren't UTF-8 here and send them back to the
+         // workers to be indexed
+         if (result.needsDecoding)
+         {
+            IndexRequest request;
+            request.fileInfo = result.fileInfo;
+            request.encoding = result.encoding;
+            request.context = module_context::createAliasedPath(
+                              FilePath(result.fileInfo.absolutePath()));
+            request.generation = result.generation;
+            request.decoded = true;
+            result.error = module_context::convertToUtf8(
+                                 result.encodedCode,
+                                 result.encoding,
                                  true,
-                                 &code);
-         if (error)
+                                 &request.code);
+            if (!result.error)
+            {
+               submitIndexRequest(request);
+               continue;
+            }
+         }
+         pendingGenerations_.erase(it);
+
+         if (result.error)
          {
-            error.addProperty("src-file", filePath.absolutePath());
-            LOG_ERROR(error);
-            return;
+            result.error.addProperty("src-file",
+                                     result.fileInfo.absolutePath());
+            LOG_ERROR(result.error);
+            continue;
          }
 
-         // add index entry
-         std::string context = module_context::createAliasedPath(filePath);
-         pIndex.reset(new r_util::RSourceIndex(context, code));
+         addIndexEntry(result.fileInfo, result.pIndex);
+      }
+
+      checkFullyIndexed();
+
+      publishing_ = outstanding_ > 0;
+      return publishing_;
+   }
+
+   void beginIndexing()
+   {
+      if (indexStartTime_.is_not_a_date_time())
+      {
+         indexStartTime_ = boost::posix_time::microsec_clock::universal_time();
+         filesIndexed_ = 0;
+      }
+   }
+
+   void checkFullyIndexed()
+   {
+      if (!indexingQueue_.empty() || outstanding_ > 0 ||
+          indexStartTime_.is_not_a_date_time())
+      {
+         return;
+      }
+
+      // record the time to fully index (logged for large batches e.g. when
+      // a project is opened)
+      boost::posix_time::time_duration elapsed =
+            boost::posix_time::microsec_clock::universal_time() -
+            indexStartTime_;
+      indexStartTime_ = boost::posix_time::not_a_date_time;
+      if (filesIndexed_ >= 100)
+      {
+         LOG_INFO_MESSAGE(boost::str(
+            boost::format("Source file index: %1% files indexed in %2%ms")
+                  % filesIndexed_ % elapsed.total_milliseconds()));
       }
+   }
+
+   void addIndexEntry(const FileInfo& fileInfo,
+                      boost::shared_ptr<r_util::RSourceIndex> pIndex)
+   {
+      filesIndexed_++;
 
       // attempt to add the entry
       Entry entry(fileInfo, pIndex);
@@ -390,6 +913,9 @@ private:
       // insert failed, remove then re-add
       if (result.second == false)
       {
+         // remove the names of the previous entry
+         removeEntryNames(*result.first);
+
          // was the first item, erase and re-insert without a hint
          if (result.first == entries_.begin())
          {
@@ -408,17 +934,87 @@ private:
             entries_.insert(hintIter, entry);
          }
       }
+
+      // add names for the entry
+      addEntryNames(entry);
+      rebuildNameIndexesIfNecessary();
    }
 
    void removeIndexEntry(const FileInfo& fileInfo)
    {
+      // discard any indexing of the file still in flight
+      pendingGenerations_.erase(fileInfo.absolutePath());
+
       // create a fake entry with a null source index to pass to find
       Entry entry(fileInfo, boost::shared_ptr<r_util::RSourceIndex>());
 
       // do the find (will use Entry::operator< for equivilance test)
       std::set<Entry>::iterator it = entries_.find(entry);
       if (it != entries_.end())
+      {
+         removeEntryNames(*it);
          entries_.erase(it);
+         rebuildNameIndexesIfNecessary();
+      }
+   }
+
+   void addEntryNames(const Entry& entry)
+   {
+      EntryIds ids;
+      FilePath filePath(entry.fileInfo.absolutePath());
+      ids.fileNameId = fileNames_.add(filePath.filename(), entry.fileInfo);
+
+      if (entry.hasIndex())
+      {
+         std::vector<r_util::RSourceItem> items;
+         entry.pIndex->search(boost::bind(&SourceFileIndex::anyItem, _1),
+                              std::back_inserter(items));
+         BOOST_FOREACH(const r_util::RSourceItem& item, items)
+         {
+            ids.symbolIds.push_back(symbols_.add(item.name(), item));
+         }
+      }
+
+      entryIds_[entry.fileInfo.absolutePath()] = ids;
+   }
+
+   void removeEntryNames(const Entry& entry)
+   {
+      std::map<std::string,EntryIds>::iterator it =
+                                 entryIds_.find(entry.fileInfo.absolutePath());
+      if (it == entryIds_.end())
+         return;
+
+      fileNames_.remove(it->second.fileNameId);
+      BOOST_FOREACH(std::size_t id, it->second.symbolIds)
+      {
+         symbols_.remove(id);
+      }
+      entryIds_.erase(it);
+   }
+
+   void rebuildNameIndexesIfNecessary()
+   {
+      if (fileNames_.needsRebuild() || symbols_.needsRebuild())
+      {
+         clearNameIndexes();
+         BOOST_FOREACH(const Entry& entry, entries_)
+         {
+            addEntryNames(entry);
+         }
+      }
+   }
+
+   void clearNameIndexes()
+   {
+      fileNames_.clear();
+      symbols_.clear();
+      entryIds_.clear();
+   }
+
+   static bool anyItem(const r_util::RSourceItem&)
+   {
+      return true;
    }
 
    static bool isSourceFile(const FileInfo& fileInfo)
@@ -466,9 +1062,31 @@ private:
    // index entries
    std::set<Entry> entries_;
 
+   // name indexes (file names and symbols) for searching the entries
+   NameIndex<FileInfo> fileNames_;
+   NameIndex<r_util::RSourceItem> symbols_;
+   std::map<std::string,EntryIds> entryIds_;
+
    // indexing queue
    bool indexing_;
    std::queue<core::system::FileChangeEvent> indexingQueue_;
+
+   // worker threads and the queues used to communicate with them (shared
+   // with the workers so they remain valid for their lifetime)
+   bool publishing_;
+   boost::shared_ptr<IndexRequestQueue> pRequests_;
+   boost::shared_ptr<IndexResultQueue> pResults_;
+   bool workersStarted_;
+
+   // generation of the latest request for each file being indexed (results
+   // for earlier generations have been superseded)
+   unsigned nextGeneration_;
+   std::map<std::string,unsigned> pendingGenerations_;
+   std::size_t outstanding_;
+
+   // time to fully indexed tracking
+   boost::posix_time::ptime indexStartTime_;
+   std::size_t filesIndexed_;
 };
 
 // global source file index
@@ -1408,6 +2026,11 @@ void onFileMonitorDisabled()
    s_projectIndex.clear();
 }
 
+void onShutdown(bool terminatedNormally)
+{
+   stopIndexWorkers();
+}
+
    
 } // anonymous namespace
    
@@ -1422,6 +2045,9 @@ Error initialize()
    projects::projectContext().subscribeToFileMonitor("R source file indexing",
                                                      cb);
 
+   // stop the index workers on shutdown
+   module_context::events().onShutdown.connect(onShutdown);
+
    using boost::bind;
    using namespace module_context;
    ExecBlock initBlock ;
@@ -30,6 +30,7 @@
 #include <core/http/Util.hpp>
 #include <core/http/Response.hpp>
 #include <core/http/Request.hpp>
+#include <core/http/FileCache.hpp>
 
 #include <core/json/JsonRpc.hpp>
 
@@ -157,21 +158,11 @@ void handleContentRequest(const http::Request& request, http::Response* pRespons
    if (boost::algorithm::starts_with(contentFilePath.mimeContentType(), "text/"))
    {
       // If the content looks like valid UTF-8, assume it is. Otherwise, assume
-      // it's the system encoding.
-      std::string contents;
-      error = core::readStringFromFile(contentFilePath, &contents);
-      if (!error)
-      {
-         for (std::string::iterator pos = contents.begin(); pos != contents.end(); )
-         {
-            error = string_utils::utf8Advance(pos, 1, contents.end(), &pos);
-            if (error)
-            {
-               isUtf8 = false;
-               break;
-            }
-         }
-      }
+      // it's the system encoding. (the file cache has already read the file
+      // for setFile so this is normally a lookup)
+      error = http::isUtf8File(contentFilePath, &isUtf8);
+      if (error)
+         LOG_ERROR(error);
    }
 
    // reset content-type with charset
@@ -17,16 +17,26 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <list>
 #include <sstream>
 
 #include <boost/bind.hpp>
-#include <boost/format.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <boost/algorithm/string/replace.hpp>
 
 #include <core/Log.hpp>
 #include <core/Error.hpp>
 #include <core/Exec.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/StringUtils.hpp>
+#include <core/SafeConvert.hpp>
+#include <core/json/Json.hpp>
+#include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
+#include <core/system/System.hpp>
+#include <core/text/TemplateFilter.hpp>
 
 #define R_INTERNAL_FUNCTIONS
 #include <r/RInternal.hpp>
@@ -38,6 +48,7 @@
 #include <r/RRoutines.hpp>
 
 #include <session/SessionModuleContext.hpp>
+#include <session/SessionOptions.hpp>
 
 #include "SessionContentUrls.hpp"
 
@@ -48,34 +59,178 @@ namespace modules {
 namespace data {
 
 namespace {   
-     
-void appendTag(std::string* pHTML,
-               const std::string& text,
-               const std::string& tag,
-               const std::string& className = std::string())
+
+// maximum number of columns and rows served in a single window
+const int kColumnWindow = 100;
+const int kRowWindow = 1000;
+
+// rows included with the page itself (before it knows its own height)
+const int kInitialRows = 100;
+
+// number of data viewers whose data we keep a handle to
+const std::size_t kMaxDataViewers = 25;
+
+class DataViewer : boost::noncopyable
 {
-   std::string classAttrib;
-   if (!className.empty())
-      classAttrib = " class=\"" + className + "\"";
-
-   boost::format fmt("<%1%%2%>%3%</%1%>");
-   pHTML->append(boost::str(fmt % tag %
-                                  classAttrib %
-                                  string_utils::textToHtml(text)));
+public:
+   DataViewer(SEXP dataSEXP, const std::vector<std::string>& columnNames)
+      : data_(dataSEXP), columnNames_(columnNames), rowCount_(0)
+   {
+      // get column lengths and then calculate # of rows based on the
+      // maximum # of elements in single column (technically R can pass
+      // columns which have a disparate # of rows to this method)
+      for (std::size_t i=0; i<columnNames_.size(); i++)
+      {
+         int columnLength = r::sexp::length(VECTOR_ELT(dataSEXP, i));
+         columnLengths_.push_back(columnLength);
+         rowCount_ = std::max(columnLength, rowCount_);
+      }
+   }
+
+   int rowCount() const { return rowCount_; }
+   int columnCount() const { return columnNames_.size(); }
+
+   // format a window of the data (clamped to the extent of the data)
+   // into a json object. only the cells within the window are formatted.
+   Error formatWindow(int rowOffset,
+                      int rowCount,
+                      int colOffset,
+                      int colCount,
+                      json::Object* pWindow) const
+   {
+      rowOffset = std::max(0, std::min(rowOffset, rowCount_));
+      rowCount = std::max(0, std::min(std::min(rowCount, kRowWindow),
+                                      rowCount_ - rowOffset));
+      colOffset = std::max(0, std::min(colOffset, columnCount()));
+      colCount = std::max(0, std::min(std::min(colCount, kColumnWindow),
+                                      columnCount() - colOffset));
+
+      r::sexp::Protect rProtect;
+      json::Array columns;
+      for (int col=colOffset; col<(colOffset + colCount); col++)
+      {
+         // format the portion of the column within the window
+         json::Array values;
+         int available = std::min(rowCount, columnLengths_[col] - rowOffset);
+         if (available > 0)
+         {
+            SEXP formattedSEXP;
+            r::exec::RFunction formatFx(".rs.formatDataColumn");
+            formatFx.addParam(VECTOR_ELT(data_.get(), col));
+            formatFx.addParam(rowOffset + 1);
+            formatFx.addParam(available);
+            Error error = formatFx.call(&formattedSEXP, &rProtect);
+            if (error)
+               return error;
+
+            if (TYPEOF(formattedSEXP) == STRSXP)
+            {
+               int length = std::min(available, Rf_length(formattedSEXP));
+               for (int row=0; row<length; row++)
+               {
+                  SEXP stringSEXP = STRING_ELT(formattedSEXP, row);
+                  if (stringSEXP != NA_STRING)
+                     values.push_back(std::string(Rf_translateChar(stringSEXP)));
+                  else
+                     values.push_back(std::string());
+               }
+            }
+         }
+
+         json::Object column;
+         column["name"] = columnNames_[col];
+         column["values"] = values;
+         columns.push_back(column);
+      }
+
+      json::Object& window = *pWindow;
+      window["rowOffset"] = rowOffset;
+      window["rowCount"] = rowCount;
+      window["colOffset"] = colOffset;
+      window["columns"] = columns;
+      return Success();
+   }
+
+private:
+   r::sexp::PreservedSEXP data_;
+   std::vector<std::string> columnNames_;
+   std::vector<int> columnLengths_;
+   int rowCount_;
+};
+
+// data viewers by id along with the order in which they were last used
+// (least recent first). when there are too many the least recently used
+// is removed (releasing its data)
+typedef std::map<std::string, boost::shared_ptr<DataViewer> > DataViewers;
+DataViewers s_dataViewers;
+std::list<std::string> s_dataViewerIds;
+
+void touchDataViewer(const std::string& id)
+{
+   s_dataViewerIds.remove(id);
+   s_dataViewerIds.push_back(id);
 }
 
-void appendTD(std::string* pHTML,
-              const std::string& text,
-              const std::string& className = std::string())
+std::string addDataViewer(boost::shared_ptr<DataViewer> pViewer)
 {
-   appendTag(pHTML, text, "td", className);
+   std::string id = core::system::generateUuid(false);
+   s_dataViewers[id] = pViewer;
+   touchDataViewer(id);
+
+   while (s_dataViewerIds.size() > kMaxDataViewers)
+   {
+      s_dataViewers.erase(s_dataViewerIds.front());
+      s_dataViewerIds.pop_front();
+   }
+
+   return id;
 }
 
-void appendTH(std::string* pHTML, const std::string& text)
+std::string windowAsScriptLiteral(const json::Object& window)
 {
-   appendTag(pHTML, text, "th");
+   std::ostringstream ostr;
+   json::write(window, ostr);
+
+   // don't let the data terminate the enclosing script element
+   std::string literal = ostr.str();
+   boost::algorithm::replace_all(literal, "</", "<\\/");
+   return literal;
 }
 
+void handleGridDataRequest(const http::Request& request,
+                           http::Response* pResponse)
+{
+   // find the viewer
+   std::string id = request.queryParamValue("id");
+   DataViewers::const_iterator it = s_dataViewers.find(id);
+   if (it == s_dataViewers.end())
+   {
+      pResponse->setError(http::status::NotFound,
+                          "Data viewer " + id + " not found");
+      return;
+   }
+   touchDataViewer(id);
+
+   // format the requested window
+   json::Object window;
+   Error error = it->second->formatWindow(
+                        request.queryParamValue("row_offset", 0),
+                        request.queryParamValue("row_count", kInitialRows),
+                        request.queryParamValue("col_offset", 0),
+                        request.queryParamValue("col_count", kColumnWindow),
+                        &window);
+   if (error)
+   {
+      pResponse->setError(error);
+      return;
+   }
+
+   std::ostringstream ostr;
+   json::write(window, ostr);
+   pResponse->setNoCacheHeaders();
+   pResponse->setContentType("application/json");
+   pResponse->setBody(ostr.str());
+}
 
 SEXP rs_viewData(SEXP dataSEXP, SEXP captionSEXP)
 {    
@@ -98,13 +253,6 @@ SEXP rs_viewData(SEXP dataSEXP, SEXP captionSEXP)
                               "invalid data argument (names not specified)");
       }
 
-      // get column count
-      int columnCount = r::sexp::length(dataSEXP);
-
-      // calculate columns to display
-      const int kMaxColumns = 100;
-      int displayedColumns = std::min(columnCount, kMaxColumns);
-
       // extract caption and column names
       std::string caption = r::sexp::asString(captionSEXP);
       std::vector<std::string> columnNames;
@@ -113,121 +261,54 @@ SEXP rs_viewData(SEXP dataSEXP, SEXP captionSEXP)
          throw r::exec::RErrorException("invalid names: " +
                                         error.code().message());
 
-      // truncate columns names to displayedColumns
-      columnNames.resize(displayedColumns);
-
-      // get column lenghts and then calculate # of rows based on the maximum #
-      // of elements in single column (technically R can pass columns which have
-      // a disparate # of rows to this method)
-      int rowCount = 0;
-      std::vector<int> columnLengths;
-      for (int i=0; i<displayedColumns; i++)
-      {
-          // get the column and record its length (updating rowCount)
-          SEXP columnSEXP = VECTOR_ELT(dataSEXP, i);
-          int columnLength = r::sexp::length(columnSEXP);
-          columnLengths.push_back(columnLength);
-          rowCount = std::max(columnLength, rowCount);
-      }
-
-      // calculate rows to display
-      const int kMaxRows = 1000;
-      int displayedRows = std::min(rowCount, kMaxRows);
-
-      // format the data for presentation
-      r::sexp::Protect rProtect;
-      SEXP formattedDataSEXP = Rf_allocVector(VECSXP, displayedColumns);
-      rProtect.add(formattedDataSEXP);
-      for (int i=0; i<displayedColumns; i++)
-      {
-         SEXP columnSEXP = VECTOR_ELT(dataSEXP, i);
-         SEXP formattedColumnSEXP;
-         r::exec::RFunction formatFx(".rs.formatDataColumn");
-         formatFx.addParam(columnSEXP);
-         formatFx.addParam(displayedRows);
-         Error error = formatFx.call(&formattedColumnSEXP, &rProtect);
-         if (error)
-            throw r::exec::RErrorException(error.summary());
-         SET_VECTOR_ELT(formattedDataSEXP, i, formattedColumnSEXP);
-       }
-
-      // write html header
-      boost::format headerFmt(
-         "<html>\n"
-         "  <head>\n"
-         "     <title>%1%</title>\n"
-         "     <meta charset=\"utf-8\"/>\n"
-         "     <link rel=\"stylesheet\" type=\"text/css\" href=\"css/data.css\"/>\n"
-         "  </head>\n"
-         "  <body>\n");
-      std::string html = boost::str(headerFmt % caption);
-
-      // output begin table & header
-      html += "<table>\n";
-      html += "<thead><tr>\n";
-      html += "<td id=\"origin\">&nbsp;</td>"; // above row numbers
-      std::for_each(columnNames.begin(),
-                    columnNames.end(),
-                    boost::bind(appendTH, &html, _1));
-      html += "\n</tr></thead>\n";
-
-      html += "<tbody>\n";
-      // output rows
-      for (int row=0; row<displayedRows; row++)
-      {
-         html += "<tr>\n";
-
-         // row number
-         appendTD(&html, safe_convert::numberToString(row+1), "rn");
-
-         // output a data element from each column where this row is available
-         for (int col=0; col<Rf_length(formattedDataSEXP); col++)
-         {
-            if (columnLengths[col] > row)
-            {
-               SEXP columnSEXP = VECTOR_ELT(formattedDataSEXP, col);
-               SEXP stringSEXP = STRING_ELT(columnSEXP, row);
-               if (stringSEXP != NULL &&
-                   stringSEXP != NA_STRING &&
-                   r::sexp::length(stringSEXP) > 0)
-               {
-                  std::string text(Rf_translateChar(stringSEXP));
-                  appendTD(&html, text);
-               }
-               else
-               {
-                  html += "<td>&nbsp;</td>";
-               }
-            }
-            else
-            {
-               html += "<td>&nbsp;</td>";
-            }
-         }
-
-         html += "\n</tr>\n";
-      }
-      html += "</tbody>\n";
-
-      // append table footer
-      html += "\n</table>\n";
-
-      // append document footer
-      html += "</body></html>\n";
+      // create a viewer which keeps a handle to the data (rows and columns
+      // are formatted on demand as the client scrolls them into view)
+      boost::shared_ptr<DataViewer> pViewer(new DataViewer(dataSEXP,
+                                                           columnNames));
+      std::string viewerId = addDataViewer(pViewer);
 
+      // format the initial window so the page can show it immediately
+      json::Object initialWindow;
+      error = pViewer->formatWindow(0, kInitialRows, 0, kColumnWindow,
+                                    &initialWindow);
+      if (error)
+         throw r::exec::RErrorException(error.summary());
+
+      // generate the page
+      std::map<std::string,std::string> vars;
+      vars["title"] = caption;
+      vars["viewer_id"] = viewerId;
+      vars["row_count"] = safe_convert::numberToString(pViewer->rowCount());
+      vars["column_count"] = safe_convert::numberToString(
+                                                   pViewer->columnCount());
+      vars["column_window"] = safe_convert::numberToString(kColumnWindow);
+      vars["row_window"] = safe_convert::numberToString(kRowWindow);
+      vars["initial_window"] = windowAsScriptLiteral(initialWindow);
+      text::TemplateFilter filter(vars);
+
+      std::string html;
+      FilePath templatePath =
+            session::options().rResourcesPath().complete("data_viewer.html");
+      error = core::readStringFromFile(templatePath,
+                                       filter,
+                                       &html,
+                                       string_utils::LineEndingPosix);
+      if (error)
+         throw r::exec::RErrorException(error.summary());
 
       // compute variables based on presence of row.names
-      int variables = columnCount;
+      int variables = pViewer->columnCount();
       if (columnNames.size() > 0 && columnNames[0] == "row.names")
          variables--;
 
-      // fire show data event
+      // fire show data event (all observations and variables can be
+      // reached by scrolling and paging the viewer)
       json::Object dataItem;
       dataItem["caption"] = caption;
-      dataItem["totalObservations"] = rowCount;
-      dataItem["displayedObservations"] = displayedRows;
+      dataItem["totalObservations"] = pViewer->rowCount();
+      dataItem["displayedObservations"] = pViewer->rowCount();
       dataItem["variables"] = variables;
-      dataItem["displayedVariables"] = displayedColumns;
+      dataItem["displayedVariables"] = pViewer->columnCount();
       dataItem["contentUrl"] = content_urls::provision(caption, html, ".htm");
       ClientEvent event(client_events::kShowData, dataItem);
       module_context::enqueClientEvent(event);
@@ -262,6 +343,7 @@ Error initialize()
    using namespace session::module_context;
    ExecBlock initBlock ;
    initBlock.addFunctions()
+      (bind(registerUriHandler, "/grid_data", handleGridDataRequest))
       (bind(sourceModuleRFile, "SessionData.R"));
    
    return initBlock.execute();
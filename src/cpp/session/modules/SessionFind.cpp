@@ -16,16 +16,27 @@
 #include "SessionFind.hpp"
 
 #include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
 
 #include <boost/algorithm/string.hpp>
 #include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/regex.hpp>
 #include <boost/enable_shared_from_this.hpp>
 
 #include <core/Exec.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/RegexUtils.hpp>
 #include <core/StringUtils.hpp>
-#include <core/system/Environment.hpp>
-#include <core/system/Process.hpp>
-#include <core/system/ShellUtils.hpp>
+#include <core/Thread.hpp>
+#include <core/BoostThread.hpp>
+#include <core/system/System.hpp>
+#include <core/system/FileScanner.hpp>
 
 #include <r/RUtil.hpp>
 
@@ -44,6 +55,16 @@ namespace {
 // This must be the same as MAX_COUNT in FindOutputPane.java
 const size_t MAX_COUNT = 1000;
 
+// files are read and searched a chunk at a time (so memory use doesn't
+// depend on the size of the files being searched). lines which grow
+// beyond kMaxLineLength cause the rest of the file to be skipped
+const std::size_t kSearchChunkSize = 256 * 1024;
+const std::size_t kMaxLineLength = 4 * 1024 * 1024;
+
+// bytes of each matching line (after leading whitespace) which are kept
+// for display; lines are truncated to 300 bytes once decoded to UTF-8
+const std::size_t kMaxLineDisplayBytes = 1024;
+
 // Reflects the current set of Find results that are being
 // displayed, in case they need to be re-fetched (i.e. browser
 // refresh)
@@ -192,20 +213,283 @@ FindInFilesState& findResults()
    return *s_pFindResults;
 }
 
-class GrepOperation : public boost::enable_shared_from_this<GrepOperation>
+// byte range of a match within a line
+typedef std::pair<std::size_t,std::size_t> MatchRange;
+
+// a line of a file (as byte offsets into its contents) which matched
+struct MatchedLine
+{
+   MatchedLine(int lineNum, std::size_t begin, std::size_t end)
+      : lineNum(lineNum), begin(begin), end(end)
+   {
+   }
+
+   int lineNum;
+   std::size_t begin;
+   std::size_t end;
+   std::vector<MatchRange> matches;
+};
+
+std::string asciiToLower(const char* pStr, std::size_t length)
+{
+   std::string lower(pStr, length);
+   for (std::string::iterator it = lower.begin(); it != lower.end(); ++it)
+   {
+      if (*it >= 'A' && *it <= 'Z')
+         *it = *it - 'A' + 'a';
+   }
+   return lower;
+}
+
+bool isAscii(const std::string& str)
+{
+   for (std::string::const_iterator it = str.begin(); it != str.end(); ++it)
+   {
+      if (static_cast<unsigned char>(*it) >= 0x80)
+         return false;
+   }
+   return true;
+}
+
+// matches a pattern within the (encoded) contents of files. literal
+// patterns are located with memchr/memcmp over the whole chunk so lines
+// which don't match are never examined individually. regex patterns (in
+// perl syntax, see regex_utils::grepPatternToRegex) are applied line by
+// line. case insensitive literals are folded as ASCII so they should only
+// contain ASCII characters (others are matched as regexes).
+class FindMatcher
 {
 public:
-   static boost::shared_ptr<GrepOperation> create(const std::string& encoding,
-                                                  const FilePath& tempFile)
+   // throws boost::regex_error if the pattern is an invalid regex
+   FindMatcher(const std::string& pattern, bool asRegex, bool ignoreCase)
+      : asRegex_(asRegex), ignoreCase_(ignoreCase)
+   {
+      if (asRegex_)
+      {
+         boost::regex::flag_type flags = boost::regex::perl;
+         if (ignoreCase_)
+            flags |= boost::regex::icase;
+         regex_ = boost::regex(pattern, flags);
+      }
+      else
+      {
+         literal_ = ignoreCase_ ?
+                     asciiToLower(pattern.data(), pattern.length()) :
+                     pattern;
+      }
+   }
+
+   // COPYING: via compiler (boost::regex is safe for concurrent matching)
+
+   // find lines within text made up of whole lines (line numbers and
+   // offsets are relative to the start of the text)
+   void findLines(const char* pText,
+                  std::size_t length,
+                  std::size_t maxLines,
+                  std::vector<MatchedLine>* pLines) const
    {
-      return boost::shared_ptr<GrepOperation>(new GrepOperation(encoding,
-                                                                tempFile));
+      if (!asRegex_ && !literal_.empty())
+         findLiteralLines(pText, length, maxLines, pLines);
+      else
+         findEachLine(pText, length, maxLines, pLines);
    }
 
 private:
-   GrepOperation(const std::string& encoding,
-                 const FilePath& tempFile)
-      : firstDecodeError_(true), encoding_(encoding), tempFile_(tempFile)
+
+   void findLiteralLines(const char* pContents,
+                         std::size_t length,
+                         std::size_t maxLines,
+                         std::vector<MatchedLine>* pLines) const
+   {
+      // case insensitive literals are matched against a lowered copy (the
+      // offsets are the same as in the original)
+      std::string lowered;
+      if (ignoreCase_)
+         lowered = asciiToLower(pContents, length);
+      const char* pText = ignoreCase_ ? lowered.data() : pContents;
+
+      int lineNum = 1;
+      std::size_t countedPos = 0;
+      std::size_t pos = 0;
+      while (pos < length && pLines->size() < maxLines)
+      {
+         std::size_t hit = findLiteral(pText, pos, length);
+         if (hit == std::string::npos)
+            break;
+
+         // find the bounds of the line (pos is always at a line start)
+         std::size_t lineBegin = hit;
+         while (lineBegin > pos && pText[lineBegin - 1] != '\n')
+            lineBegin--;
+         const void* pNewline = ::memchr(pText + hit, '\n', length - hit);
+         std::size_t lineEnd = pNewline ?
+               static_cast<const char*>(pNewline) - pText : length;
+
+         // compute the line number
+         lineNum += std::count(pText + countedPos, pText + lineBegin, '\n');
+         countedPos = lineBegin;
+
+         // record all of the matches on the line
+         MatchedLine line(lineNum, lineBegin, lineEnd);
+         while (hit != std::string::npos)
+         {
+            line.matches.push_back(std::make_pair(hit - lineBegin,
+                                                  hit - lineBegin +
+                                                     literal_.length()));
+            hit = findLiteral(pText, hit + literal_.length(), lineEnd);
+         }
+         pLines->push_back(line);
+
+         pos = lineEnd + 1;
+      }
+   }
+
+   std::size_t findLiteral(const char* pText,
+                           std::size_t from,
+                           std::size_t limit) const
+   {
+      const std::size_t n = literal_.length();
+      while (from + n <= limit)
+      {
+         const void* pFirst = ::memchr(pText + from,
+                                       literal_[0],
+                                       limit - n + 1 - from);
+         if (pFirst == NULL)
+            return std::string::npos;
+
+         std::size_t candidate = static_cast<const char*>(pFirst) - pText;
+         if (::memcmp(pText + candidate + 1, literal_.data() + 1, n - 1) == 0)
+            return candidate;
+
+         from = candidate + 1;
+      }
+      return std::string::npos;
+   }
+
+   void findEachLine(const char* pText,
+                     std::size_t length,
+                     std::size_t maxLines,
+                     std::vector<MatchedLine>* pLines) const
+   {
+
+      int lineNum = 1;
+      std::size_t lineBegin = 0;
+      while (lineBegin < length && pLines->size() < maxLines)
+      {
+         const void* pNewline = ::memchr(pText + lineBegin,
+                                         '\n',
+                                         length - lineBegin);
+         std::size_t lineEnd = pNewline ?
+               static_cast<const char*>(pNewline) - pText : length;
+
+         MatchedLine line(lineNum, lineBegin, lineEnd);
+         if (matchLine(pText + lineBegin, pText + lineEnd, &line.matches))
+            pLines->push_back(line);
+
+         lineBegin = lineEnd + 1;
+         lineNum++;
+      }
+   }
+
+   bool matchLine(const char* begin,
+                  const char* end,
+                  std::vector<MatchRange>* pMatches) const
+   {
+      // an empty literal matches every line
+      if (!asRegex_)
+         return true;
+
+      bool matched = false;
+      boost::match_flag_type flags = boost::match_default |
+                                     boost::match_not_dot_newline;
+      boost::cmatch match;
+      const char* start = begin;
+      while (start <= end && boost::regex_search(start, end, match, regex_, flags))
+      {
+         matched = true;
+         if (match.length(0) > 0)
+         {
+            pMatches->push_back(std::make_pair(match[0].first - begin,
+                                               match[0].second - begin));
+            start = match[0].second;
+         }
+         else
+         {
+            start = match[0].first + 1;
+         }
+         flags |= boost::match_prev_avail;
+      }
+      return matched;
+   }
+
+private:
+   bool asRegex_;
+   bool ignoreCase_;
+   std::string literal_;
+   boost::regex regex_;
+};
+
+// a matching line of a file (still in the file's encoding) and the byte
+// ranges of the matches within it
+struct FoundLine
+{
+   int lineNum;
+   std::string contents;
+   std::vector<MatchRange> matches;
+};
+
+// results for a single file
+struct FileResults
+{
+   std::string path;
+   std::vector<FoundLine> lines;
+};
+
+bool isRegularFile(const std::string& path)
+{
+#ifndef _WIN32
+   struct stat st;
+   return ::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+#else
+   return true;
+#endif
+}
+
+// Searches the files within a directory on a pool of threads: one walks
+// the directory (feeding files to the others as it goes) and the rest
+// search them. Results are published back to the main thread periodically,
+// where they are decoded and sent to the client as kFindResult events.
+class FindOperation : public boost::enable_shared_from_this<FindOperation>
+{
+public:
+   static boost::shared_ptr<FindOperation> create(
+                                    const FilePath& rootPath,
+                                    const FindMatcher& matcher,
+                                    const std::vector<boost::regex>& includes,
+                                    const std::string& encoding)
+   {
+      return boost::shared_ptr<FindOperation>(new FindOperation(rootPath,
+                                                                matcher,
+                                                                includes,
+                                                                encoding));
+   }
+
+private:
+   FindOperation(const FilePath& rootPath,
+                 const FindMatcher& matcher,
+                 const std::vector<boost::regex>& includes,
+                 const std::string& encoding)
+      : rootPath_(rootPath),
+        matcher_(matcher),
+        includes_(includes),
+        encoding_(encoding),
+        files_(true),
+        results_(true),
+        searchThreads_(std::max(1U, std::min(4U,
+                                   boost::thread::hardware_concurrency()))),
+        activeThreads_(0),
+        stopped_(false),
+        firstDecodeError_(true)
    {
       handle_ = core::system::generateUuid(false);
    }
@@ -216,28 +500,233 @@ public:
       return handle_;
    }
 
-   core::system::ProcessCallbacks createProcessCallbacks()
+   void start()
    {
-      core::system::ProcessCallbacks callbacks;
-      callbacks.onContinue = boost::bind(&GrepOperation::onContinue,
-                                         shared_from_this(),
-                                         _1);
-      callbacks.onStdout = boost::bind(&GrepOperation::onStdout,
-                                       shared_from_this(),
-                                       _1, _2);
-      callbacks.onStderr = boost::bind(&GrepOperation::onStderr,
-                                       shared_from_this(),
-                                       _1, _2);
-      callbacks.onExit = boost::bind(&GrepOperation::onExit,
-                                     shared_from_this(),
-                                     _1);
-      return callbacks;
+      // launch the directory scanner and searchers (each holds a reference
+      // to the operation for as long as it is running)
+      activeThreads_ = searchThreads_ + 1;
+      core::thread::safeLaunchThread(
+            boost::bind(&FindOperation::scanThread, shared_from_this()));
+      for (unsigned i = 0; i < searchThreads_; i++)
+      {
+         core::thread::safeLaunchThread(
+               boost::bind(&FindOperation::searchThread, shared_from_this()));
+      }
+
+      // publish results in periodic batches
+      module_context::schedulePeriodicWork(
+               boost::posix_time::milliseconds(20),
+               boost::bind(&FindOperation::publishResults, shared_from_this()),
+               false,
+               false);
    }
 
 private:
-   bool onContinue(const core::system::ProcessOperations& ops) const
+
+   bool isStopped()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         return stopped_;
+      }
+      END_LOCK_MUTEX
+
+      return true;
+   }
+
+   void stop()
    {
-      return findResults().isRunning() && findResults().handle() == handle();
+      LOCK_MUTEX(mutex_)
+      {
+         stopped_ = true;
+      }
+      END_LOCK_MUTEX
+   }
+
+   void onThreadExit()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         activeThreads_--;
+      }
+      END_LOCK_MUTEX
+   }
+
+   bool threadsActive()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         return activeThreads_ > 0;
+      }
+      END_LOCK_MUTEX
+
+      return false;
+   }
+
+   void scanThread()
+   {
+      try
+      {
+         // files are passed to the searchers from the filter (rather than
+         // accumulated in the tree) so searching starts right away
+         core::system::FileScannerOptions options;
+         options.recursive = true;
+         options.filter = boost::bind(&FindOperation::onScanFile, this, _1);
+         tree<FileInfo> scanTree;
+         Error error = core::system::scanFiles(FileInfo(rootPath_),
+                                               options,
+                                               &scanTree);
+         if (error)
+            LOG_ERROR(error);
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+
+      // let each of the searchers know there are no more files
+      for (unsigned i = 0; i < searchThreads_; i++)
+         files_.enque(std::string());
+
+      onThreadExit();
+   }
+
+   bool onScanFile(const FileInfo& fileInfo)
+   {
+      if (isStopped())
+         return false;
+
+      std::string name = FilePath(fileInfo.absolutePath()).filename();
+      if (fileInfo.isDirectory())
+         return name != ".Rproj.user" && name != ".git" && name != ".svn";
+
+      // don't follow links (consistent with grep -r)
+      if (fileInfo.isSymlink())
+         return false;
+
+      bool included = includes_.empty();
+      BOOST_FOREACH(const boost::regex& include, includes_)
+      {
+         if (boost::regex_match(name, include))
+         {
+            included = true;
+            break;
+         }
+      }
+      if (included)
+         files_.enque(fileInfo.absolutePath());
+
+      return false;
+   }
+
+   void searchThread()
+   {
+      std::string path;
+      while (!isStopped())
+      {
+         if (!files_.deque(&path, boost::posix_time::milliseconds(500)))
+            continue;
+
+         // an empty path indicates there are no more files
+         if (path.empty())
+            break;
+
+         try
+         {
+            searchFile(path);
+         }
+         CATCH_UNEXPECTED_EXCEPTION
+      }
+
+      onThreadExit();
+   }
+
+   void searchFile(const std::string& path)
+   {
+      // skip devices, fifos, etc.
+      if (!isRegularFile(path))
+         return;
+
+      boost::shared_ptr<std::istream> pIfs;
+      Error error = FilePath(path).open_r(&pIfs);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return;
+      }
+
+      FileResults results;
+      results.path = path;
+
+      // the text still to be searched is the partial line left over from
+      // the previous chunk followed by the next chunk
+      std::vector<char> chunk(kSearchChunkSize);
+      std::string text;
+      int lineNum = 1;
+      bool endOfFile = false;
+      while (!endOfFile && results.lines.size() <= MAX_COUNT)
+      {
+         pIfs->read(&chunk[0], chunk.size());
+         std::size_t count = static_cast<std::size_t>(pIfs->gcount());
+         if (pIfs->bad())
+         {
+            error = systemError(boost::system::errc::io_error,
+                                ERROR_LOCATION);
+            error.addProperty("path", path);
+            LOG_ERROR(error);
+            return;
+         }
+         endOfFile = pIfs->eof();
+
+         // skip binary files
+         if (::memchr(&chunk[0], '\0', count) != NULL)
+            return;
+
+         text.append(&chunk[0], count);
+
+         // search the complete lines (at the end of the file that's all
+         // of the remaining text)
+         std::size_t length = text.length();
+         if (!endOfFile)
+         {
+            std::size_t lastNewline = text.rfind('\n');
+            if (lastNewline == std::string::npos)
+            {
+               if (text.length() > kMaxLineLength)
+                  break;
+               continue;
+            }
+            length = lastNewline + 1;
+         }
+
+         // find matching lines (no more than could ever be shown)
+         std::vector<MatchedLine> lines;
+         matcher_.findLines(text.data(),
+                            length,
+                            MAX_COUNT + 1 - results.lines.size(),
+                            &lines);
+         BOOST_FOREACH(const MatchedLine& line, lines)
+         {
+            // keep just the part of the line which can be displayed
+            std::size_t displayBegin = line.begin;
+            while (displayBegin < line.end &&
+                   std::isspace(static_cast<unsigned char>(text[displayBegin])))
+            {
+               displayBegin++;
+            }
+            std::size_t displayEnd = std::min(line.end,
+                                       displayBegin + kMaxLineDisplayBytes);
+
+            FoundLine found;
+            found.lineNum = lineNum + line.lineNum - 1;
+            found.contents.assign(text, line.begin, displayEnd - line.begin);
+            found.matches = line.matches;
+            results.lines.push_back(found);
+         }
+
+         lineNum += std::count(text.data(), text.data() + length, '\n');
+         text.erase(0, length);
+      }
+
+      if (!results.lines.empty())
+         results_.enque(results);
    }
 
    std::string decode(const std::string& encoded)
@@ -249,7 +738,7 @@ private:
       Error error = r::util::iconvstr(encoded, encoding_, "UTF-8", true,
                                       &decoded);
 
-      // Log error, but only once per grep operation
+      // Log error, but only once per find operation
       if (error && firstDecodeError_)
       {
          firstDecodeError_ = false;
@@ -259,41 +748,35 @@ private:
       return decoded;
    }
 
-   void processContents(std::string* pContent,
-                        json::Array* pMatchOn,
-                        json::Array* pMatchOff)
+   // decode the (whitespace trimmed) line and compute the character
+   // offsets at which each match begins and ends (this is done on the main
+   // thread since decoding uses R's iconv)
+   void formatLine(const FoundLine& line,
+                   std::string* pContents,
+                   json::Array* pMatchOn,
+                   json::Array* pMatchOff)
    {
-      using namespace boost;
+      const char* pLine = line.contents.data();
+      const std::size_t length = line.contents.length();
+      const std::vector<MatchRange>& matches = line.matches;
+      std::size_t begin = 0;
+      std::size_t end = length;
+      while (begin < end && std::isspace(static_cast<unsigned char>(pLine[begin])))
+         begin++;
+      while (end > begin && std::isspace(static_cast<unsigned char>(pLine[end-1])))
+         end--;
 
       std::string decodedLine;
-
-      std::string::iterator inputPos = pContent->begin();
-
-      smatch match;
-      while (regex_search(std::string(inputPos, pContent->end()), match,
-                          regex("\x1B\\[(\\d\\d)?m(\x1B\\[K)?")))
+      std::size_t pos = begin;
+      BOOST_FOREACH(const MatchRange& match, matches)
       {
-         std::string match1 = match[1];
-
-         decodedLine.append(decode(
-               std::string(inputPos, inputPos + match.position())));
-
-         inputPos += match.position() + match.length();
-
-         size_t charSize;
-         Error error = string_utils::utf8Distance(decodedLine.begin(),
-                                                  decodedLine.end(),
-                                                  &charSize);
-         if (error)
-            charSize = decodedLine.size();
-
-         if (match1 == "01")
-            pMatchOn->push_back(static_cast<int>(charSize));
-         else
-            pMatchOff->push_back(static_cast<int>(charSize));
+         appendBoundary(pLine, match.first, begin, end,
+                        &pos, &decodedLine, pMatchOn);
+         appendBoundary(pLine, match.second, begin, end,
+                        &pos, &decodedLine, pMatchOff);
       }
-      if (inputPos != pContent->end())
-         decodedLine.append(decode(std::string(inputPos, pContent->end())));
+      if (pos < end)
+         decodedLine.append(decode(std::string(pLine + pos, pLine + end)));
 
       if (decodedLine.size() > 300)
       {
@@ -301,10 +784,32 @@ private:
          decodedLine.append("...");
       }
 
-      *pContent = decodedLine;
+      *pContents = decodedLine;
    }
 
-   void onStdout(const core::system::ProcessOperations& ops, const std::string& data)
+   void appendBoundary(const char* pLine,
+                       std::size_t boundary,
+                       std::size_t begin,
+                       std::size_t end,
+                       std::size_t* pPos,
+                       std::string* pDecodedLine,
+                       json::Array* pOffsets)
+   {
+      boundary = std::max(*pPos, std::min(std::max(boundary, begin), end));
+      pDecodedLine->append(decode(std::string(pLine + *pPos,
+                                              pLine + boundary)));
+      *pPos = boundary;
+
+      size_t charSize;
+      Error error = string_utils::utf8Distance(pDecodedLine->begin(),
+                                               pDecodedLine->end(),
+                                               &charSize);
+      if (error)
+         charSize = pDecodedLine->size();
+      pOffsets->push_back(static_cast<int>(charSize));
+   }
+
+   bool publishResults()
    {
       json::Array files;
       json::Array lineNums;
@@ -312,40 +817,30 @@ private:
       json::Array matchOns;
       json::Array matchOffs;
 
+      // stop if the find has been stopped or superseded
+      bool active = findResults().isRunning() &&
+                    findResults().handle() == handle();
+
       int recordsToProcess = MAX_COUNT + 1 - findResults().resultCount();
       if (recordsToProcess < 0)
          recordsToProcess = 0;
 
-      stdOutBuf_.append(data);
-      size_t nextLineStart = 0;
-      size_t pos = -1;
-      while (recordsToProcess &&
-             std::string::npos != (pos = stdOutBuf_.find('\n', pos + 1)))
+      FileResults results;
+      while (active && recordsToProcess > 0 && results_.deque(&results))
       {
-         std::string line = stdOutBuf_.substr(nextLineStart, pos - nextLineStart);
-         nextLineStart = pos + 1;
+         std::string file = module_context::createAliasedPath(
+                  FilePath(string_utils::systemToUtf8(results.path)));
 
-         boost::smatch match;
-         if (boost::regex_match(line, match, boost::regex("^((?:[a-zA-Z]:)?[^:]+):(\\d+):(.*)")))
+         for (std::size_t i = 0;
+              i < results.lines.size() && recordsToProcess > 0;
+              i++)
          {
-            std::string file = module_context::createAliasedPath(
-                  FilePath(string_utils::systemToUtf8(match[1])));
-
-            if (file.find("/.Rproj.user/") != std::string::npos)
-               continue;
-            if (file.find("/.git/") != std::string::npos)
-               continue;
-            if (file.find("/.svn/") != std::string::npos)
-               continue;
-
-            int lineNum = safe_convert::stringTo<int>(std::string(match[2]), -1);
-            std::string lineContents = match[3];
-            boost::algorithm::trim(lineContents);
+            std::string lineContents;
             json::Array matchOn, matchOff;
-            processContents(&lineContents, &matchOn, &matchOff);
+            formatLine(results.lines[i], &lineContents, &matchOn, &matchOff);
 
             files.push_back(file);
-            lineNums.push_back(lineNum);
+            lineNums.push_back(results.lines[i].lineNum);
             contents.push_back(lineContents);
             matchOns.push_back(matchOn);
             matchOffs.push_back(matchOff);
@@ -354,11 +849,6 @@ private:
          }
       }
 
-      if (nextLineStart)
-      {
-         stdOutBuf_.erase(0, nextLineStart);
-      }
-
       if (files.size() > 0)
       {
          json::Object result;
@@ -382,29 +872,41 @@ private:
                   ClientEvent(client_events::kFindResult, result));
       }
 
-      if (recordsToProcess <= 0)
+      // we are done if we were stopped, hit the maximum, or the searchers
+      // have all finished and their results have been published (note the
+      // threads must be checked before the results queue)
+      bool finished = !active ||
+                      recordsToProcess <= 0 ||
+                      (!threadsActive() && results_.isEmpty());
+      if (finished)
+      {
+         stop();
          findResults().onFindEnd(handle());
-   }
+         module_context::enqueClientEvent(
+               ClientEvent(client_events::kFindOperationEnded, handle()));
+      }
 
-   void onStderr(const core::system::ProcessOperations& ops, const std::string& data)
-   {
-      LOG_ERROR_MESSAGE("grep: " + data);
+      return !finished;
    }
 
-   void onExit(int exitCode)
-   {
-      findResults().onFindEnd(handle());
-      module_context::enqueClientEvent(
-            ClientEvent(client_events::kFindOperationEnded, handle()));
-      if (!tempFile_.empty())
-         tempFile_.removeIfExists();
-   }
+   FilePath rootPath_;
+   const FindMatcher matcher_;
+   const std::vector<boost::regex> includes_;
+   const std::string encoding_;
+   std::string handle_;
+
+   // files to search and the results of searching them
+   core::thread::ThreadsafeQueue<std::string> files_;
+   core::thread::ThreadsafeQueue<FileResults> results_;
 
+   // thread state (protected by mutex_)
+   const unsigned searchThreads_;
+   boost::mutex mutex_;
+   unsigned activeThreads_;
+   bool stopped_;
+
+   // main thread state
    bool firstDecodeError_;
-   std::string encoding_;
-   FilePath tempFile_;
-   std::string stdOutBuf_;
-   std::string handle_;
 };
 
 } // namespace
@@ -426,31 +928,32 @@ core::Error beginFind(const json::JsonRpcRequest& request,
    if (error)
       return error;
 
-   core::system::ProcessOptions options;
-
-   core::system::Options childEnv;
-   core::system::environment(&childEnv);
-   core::system::setenv(&childEnv, "GREP_COLOR", "01");
-   core::system::setenv(&childEnv, "GREP_COLORS", "ne:fn=:ln=:se=:mt=01");
-#ifdef _WIN32
-   FilePath gnuGrepPath = session::options().gnugrepPath();
-   core::system::addToPath(
-            &childEnv,
-            string_utils::utf8ToSystem(gnuGrepPath.absolutePath()));
-#endif
-   options.environment = childEnv;
+   // only the first line of the pattern is used
+   std::string pattern = searchString;
+   std::string::size_type newlinePos = pattern.find_first_of("\r\n");
+   if (newlinePos != std::string::npos)
+      pattern.erase(newlinePos);
+
+   // regexes are written in grep's basic syntax (searches used to run grep).
+   // case insensitive literals which include non-ASCII characters are also
+   // matched as regexes so that those characters match in either case
+   bool matchAsRegex = asRegex;
+   if (asRegex)
+   {
+      pattern = regex_utils::grepPatternToRegex(pattern, ignoreCase);
+   }
+   else if (ignoreCase && !isAscii(pattern))
+   {
+      pattern = regex_utils::literalToRegex(pattern, ignoreCase);
+      matchAsRegex = true;
+   }
 
-   // Put the grep pattern in a file
-   FilePath tempFile = module_context::tempFile("rs_grep", "txt");
-   boost::shared_ptr<std::ostream> pStream;
-   error = tempFile.open_w(&pStream);
-   if (error)
-      return error;
+   // files are searched in their encoding so encode the pattern to match
    std::string encoding = projects::projectContext().hasProject() ?
                           projects::projectContext().defaultEncoding() :
                           userSettings().defaultEncoding();
    std::string encodedString;
-   error = r::util::iconvstr(searchString,
+   error = r::util::iconvstr(pattern,
                              "UTF-8",
                              encoding,
                              false,
@@ -458,59 +961,45 @@ core::Error beginFind(const json::JsonRpcRequest& request,
    if (error)
    {
       LOG_ERROR(error);
-      encodedString = searchString;
+      encodedString = pattern;
    }
 
-   *pStream << encodedString << std::endl;
-   pStream.reset(); // release file handle
-
-   boost::shared_ptr<GrepOperation> ptrGrepOp = GrepOperation::create(encoding,
-                                                                      tempFile);
-   core::system::ProcessCallbacks callbacks =
-                                       ptrGrepOp->createProcessCallbacks();
-
-#ifdef _WIN32
-   shell_utils::ShellCommand cmd(gnuGrepPath.complete("grep"));
-#else
-   shell_utils::ShellCommand cmd("grep");
-#endif
-   cmd << "-rHn" << "--binary-files=without-match" << "--color=always";
-#ifndef _WIN32
-   cmd << "--devices=skip";
-#endif
-
-   if (ignoreCase)
-      cmd << "-i";
-
-   // Use -f to pass pattern via file, so we don't have to worry about
-   // escaping double quotes, etc.
-   cmd << "-f";
-   cmd << tempFile;
-   if (!asRegex)
-      cmd << "-F";
-
+   // file patterns to include
+   std::vector<boost::regex> includes;
    BOOST_FOREACH(json::Value filePattern, filePatterns)
    {
-      cmd << "--include=" + filePattern.get_str();
+      includes.push_back(
+            regex_utils::wildcardPatternToRegex(filePattern.get_str()));
    }
 
-   cmd << shell_utils::EscapeFilesOnly << "--" << shell_utils::EscapeAll;
-   cmd << module_context::resolveAliasedPath(directory);
+   // create the operation (this compiles the pattern)
+   boost::shared_ptr<FindOperation> ptrFindOp;
+   try
+   {
+      ptrFindOp = FindOperation::create(
+                        module_context::resolveAliasedPath(directory),
+                        FindMatcher(encodedString, matchAsRegex, ignoreCase),
+                        includes,
+                        encoding);
+   }
+   catch(const boost::regex_error& e)
+   {
+      Error error(json::errc::ParamInvalid, ERROR_LOCATION);
+      error.addProperty("pattern", searchString);
+      error.addProperty("message", e.what());
+      return error;
+   }
 
    // Clear existing results
    findResults().clear();
 
-   error = module_context::processSupervisor().runCommand(cmd,
-                                                          options,
-                                                          callbacks);
-   if (error)
-      return error;
+   ptrFindOp->start();
 
-   findResults().onFindBegin(ptrGrepOp->handle(),
+   findResults().onFindBegin(ptrFindOp->handle(),
                              searchString,
                              directory,
                              asRegex);
-   pResponse->setResult(ptrGrepOp->handle());
+   pResponse->setResult(ptrFindOp->handle());
 
    return Success();
 }
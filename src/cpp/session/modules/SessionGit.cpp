@@ -22,6 +22,8 @@
 #include <shlwapi.h>
 #endif
 
+#include <list>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/algorithm/string/split.hpp>
@@ -32,6 +34,7 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/optional.hpp>
 #include <boost/regex.hpp>
+#include <boost/unordered_map.hpp>
 #include <core/BoostLamda.hpp>
 
 #include <core/json/JsonRpc.hpp>
@@ -43,8 +46,10 @@
 #include <core/Exec.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/GitGraph.hpp>
+#include <core/Hash.hpp>
 #include <core/Scope.hpp>
 #include <core/StringUtils.hpp>
+#include <core/Thread.hpp>
 
 
 #include <r/RExec.hpp>
@@ -88,9 +93,63 @@ const uint64_t GIT_1_7_2 = ((uint64_t)1 << 48) |
                            ((uint64_t)7 << 32) |
                            ((uint64_t)2 << 16);
 
+// the environment, working directory and home path which git processes
+// are run with. git_history and git_history_count are served from rpc
+// worker threads, which can't read the process environment (R changes it
+// with Sys.setenv) or the project context, so they use the snapshot of
+// these taken the last time the main thread captured them
+struct ProcessContext
+{
+   core::system::Options environment;
+   FilePath workingDir;
+   FilePath homePath;
+};
+
+boost::thread::id s_mainThreadId;
+boost::mutex s_processContextMutex;
+ProcessContext s_processContext;
+
+void captureProcessContext(ProcessContext* pContext)
+{
+   core::system::environment(&pContext->environment);
+   pContext->workingDir = projects::projectContext().directory();
+   pContext->homePath = module_context::userHomePath();
+
+   LOCK_MUTEX(s_processContextMutex)
+   {
+      s_processContext = *pContext;
+   }
+   END_LOCK_MUTEX
+}
+
+void onDetectChanges(module_context::ChangeSource source)
+{
+   ProcessContext context;
+   captureProcessContext(&context);
+}
+
+ProcessContext processContext()
+{
+   ProcessContext context;
+   if (boost::this_thread::get_id() == s_mainThreadId)
+   {
+      captureProcessContext(&context);
+   }
+   else
+   {
+      LOCK_MUTEX(s_processContextMutex)
+      {
+         context = s_processContext;
+      }
+      END_LOCK_MUTEX
+   }
+   return context;
+}
+
 core::system::ProcessOptions procOptions()
 {
    core::system::ProcessOptions options;
+   ProcessContext context = processContext();
 
    // detach the session so there is no terminal
 #ifndef _WIN32
@@ -98,8 +157,7 @@ core::system::ProcessOptions procOptions()
 #endif
 
    // get current environment for modification prior to passing to child
-   core::system::Options childEnv;
-   core::system::environment(&childEnv);
+   core::system::Options childEnv = context.environment;
 
    // add git bin dir to PATH if necessary
    std::string nonPathGitBinDir = git::nonPathGitBinDir();
@@ -110,7 +168,7 @@ core::system::ProcessOptions procOptions()
    FilePath postbackDir = session::options().rpostbackPath().parent();
    core::system::addToPath(&childEnv, postbackDir.absolutePath());
 
-   options.workingDir = projects::projectContext().directory();
+   options.workingDir = context.workingDir;
 
    // on windows set HOME to USERPROFILE
 #ifdef _WIN32
@@ -260,6 +318,359 @@ bool isUntracked(const source_control::StatusResult& statusResult,
    return statusResult.getStatus(filePath).status() == "??";
 }
 
+// Commit history cache
+//
+// Rather than running git log (and rev-list for the graph) over the entire
+// history for every page, count, and search of the history pane we keep
+// the history reachable from a rev in memory along with its graph. It is
+// keyed by the commit the rev resolves to; when that moves forward only
+// the new commits are read from git, otherwise the history is rebuilt.
+// Histories are also persisted to the scratch path (as a journal of
+// segments, each holding the commits added for a new tip) so that a new
+// session only has to read the commits made since the last one.
+
+struct CachedCommit
+{
+   CachedCommit() : date(0) {}
+
+   std::string id;
+   std::vector<std::string> parents;
+   std::string author;
+   boost::int64_t date;
+   std::string description;
+   std::string graph;
+};
+
+struct CommitHistory
+{
+   CommitHistory() : searchIndexed(false) {}
+
+   // the commit the history is reachable from
+   std::string tip;
+
+   // in date order (newest first)
+   std::vector<CachedCommit> commits;
+
+   // lowercased author, description, and id of each commit and the
+   // index of each commit by id (both built on demand)
+   bool searchIndexed;
+   std::vector<std::string> searchIndex;
+   boost::unordered_map<std::string, std::size_t> commitIndexes;
+
+   // recent results of filtering (keyed by file filter and search text)
+   std::list<std::pair<std::string, std::vector<std::size_t> > > matches;
+};
+
+// histories for recently requested repos/revs (most recent first). the
+// history rpcs are served from worker threads so these (along with the
+// cache files which back them) are guarded by s_commitHistoriesMutex
+const std::size_t kMaxCommitHistories = 4;
+std::list<std::pair<std::string, boost::shared_ptr<CommitHistory> > >
+                                                         s_commitHistories;
+boost::mutex s_commitHistoriesMutex;
+
+const std::size_t kMaxCommitHistoryMatches = 8;
+const char * const kCommitCacheVersion = "rstudio-git-history 1";
+
+boost::int64_t convertGitRawDate(const std::string& time,
+                                 const std::string& timeZone)
+{
+   boost::int64_t secs = safe_convert::stringTo<boost::int64_t>(time, 0);
+
+   int offset = safe_convert::stringTo<int>(timeZone, 0);
+
+   // Positive timezone offset means we have to SUBTRACT
+   // the offset to get UTC time, and vice versa
+   int factor = offset > 0 ? -1 : 1;
+
+   offset = abs(offset);
+   int hours = offset / 100;
+   int minutes = offset % 100;
+
+   secs += factor * (hours * 60*60);
+   secs += factor * (minutes * 60);
+
+   return secs;
+}
+
+void computeCommitGraph(std::vector<CachedCommit>* pCommits)
+{
+   gitgraph::GitGraph graph;
+   BOOST_FOREACH(CachedCommit& commit, *pCommits)
+   {
+      commit.graph = graph.addCommit(commit.id, commit.parents).string();
+   }
+}
+
+void buildSearchIndex(CommitHistory* pHistory)
+{
+   if (pHistory->searchIndexed)
+      return;
+
+   pHistory->searchIndex.resize(pHistory->commits.size());
+   for (std::size_t i = 0; i < pHistory->commits.size(); i++)
+   {
+      const CachedCommit& commit = pHistory->commits[i];
+      std::string& text = pHistory->searchIndex[i];
+      text.reserve(commit.author.size() + commit.description.size() +
+                   commit.id.size() + 2);
+      text.append(commit.author).append("\n");
+      text.append(commit.description).append("\n");
+      text.append(commit.id);
+      boost::algorithm::to_lower(text);
+
+      pHistory->commitIndexes[commit.id] = i;
+   }
+   pHistory->searchIndexed = true;
+}
+
+// parse git log --pretty=raw output
+void parseRawLog(const std::string& output,
+                 std::vector<CachedCommit>* pCommits)
+{
+   bool inMessage = false;
+   std::string::size_type pos = 0;
+   while (pos < output.size())
+   {
+      std::string::size_type end = output.find('\n', pos);
+      if (end == std::string::npos)
+         end = output.size();
+      std::string line = output.substr(pos, end - pos);
+      pos = end + 1;
+
+      if (boost::algorithm::starts_with(line, "commit "))
+      {
+         pCommits->push_back(CachedCommit());
+         pCommits->back().id = line.substr(7);
+         inMessage = false;
+         continue;
+      }
+      if (pCommits->empty())
+         continue;
+
+      CachedCommit& commit = pCommits->back();
+      if (inMessage)
+      {
+         // message lines are indented by four spaces
+         if (line.size() < 4)
+            continue;
+         if (!commit.description.empty())
+            commit.description.append("\n");
+         commit.description.append(line, 4, std::string::npos);
+      }
+      else if (line.empty())
+      {
+         // blank line separates headers from the message
+         inMessage = true;
+      }
+      else if (boost::algorithm::starts_with(line, "parent "))
+      {
+         commit.parents.push_back(line.substr(7));
+      }
+      else if (boost::algorithm::starts_with(line, "author ") ||
+               boost::algorithm::starts_with(line, "committer "))
+      {
+         // <name> <email> <time> <timezone>
+         std::string::size_type tzPos = line.rfind(' ');
+         std::string::size_type timePos = tzPos == std::string::npos ?
+                        std::string::npos : line.rfind(' ', tzPos - 1);
+         std::string::size_type keyEnd = line.find(' ');
+         if (timePos == std::string::npos || timePos <= keyEnd)
+            continue;
+
+         if (line[0] == 'a')
+         {
+            commit.author = line.substr(keyEnd + 1, timePos - keyEnd - 1);
+         }
+         else
+         {
+            commit.date = convertGitRawDate(
+                              line.substr(timePos + 1, tzPos - timePos - 1),
+                              line.substr(tzPos + 1));
+         }
+      }
+   }
+}
+
+std::string escapeCacheField(const std::string& field)
+{
+   std::string escaped;
+   escaped.reserve(field.size());
+   BOOST_FOREACH(char ch, field)
+   {
+      switch (ch)
+      {
+         case '\\': escaped.append("\\\\"); break;
+         case '\t': escaped.append("\\t"); break;
+         case '\n': escaped.append("\\n"); break;
+         case '\r': escaped.append("\\r"); break;
+         default: escaped.push_back(ch); break;
+      }
+   }
+   return escaped;
+}
+
+std::string unescapeCacheField(const std::string& field)
+{
+   std::string unescaped;
+   unescaped.reserve(field.size());
+   for (std::size_t i = 0; i < field.size(); i++)
+   {
+      if (field[i] == '\\' && i + 1 < field.size())
+      {
+         char ch = field[++i];
+         if (ch == 't')
+            unescaped.push_back('\t');
+         else if (ch == 'n')
+            unescaped.push_back('\n');
+         else if (ch == 'r')
+            unescaped.push_back('\r');
+         else
+            unescaped.push_back(ch);
+      }
+      else
+      {
+         unescaped.push_back(field[i]);
+      }
+   }
+   return unescaped;
+}
+
+FilePath commitCachePath(const FilePath& root, const std::string& rev)
+{
+   std::string key = root.absolutePath() + "\n" + rev;
+   return module_context::scopedScratchPath()
+         .childPath("git-history/" + core::hash::crc32Hash(key));
+}
+
+// read a persisted history. each segment of the journal holds the
+// commits which precede those in the segments before it
+Error readCommitCache(const FilePath& cachePath, CommitHistory* pHistory)
+{
+   std::vector<std::string> lines;
+   Error error = core::readStringVectorFromFile(cachePath, &lines, false);
+   if (error)
+      return error;
+
+   std::vector<std::vector<CachedCommit> > segments;
+   std::string tip;
+   bool valid = !lines.empty() && lines[0] == kCommitCacheVersion;
+   for (std::size_t i = 1; valid && i < lines.size(); )
+   {
+      if (lines[i].empty())
+      {
+         i++;
+         continue;
+      }
+
+      // segment header
+      std::vector<std::string> header;
+      boost::algorithm::split(header, lines[i++],
+                              boost::algorithm::is_any_of("\t"));
+      std::size_t count = header.size() == 3 ?
+                  safe_convert::stringTo<std::size_t>(header[2], -1) : -1;
+      if (header[0] != "tip" || count > lines.size() - i)
+      {
+         valid = false;
+         break;
+      }
+      tip = header[1];
+
+      // commits
+      segments.push_back(std::vector<CachedCommit>());
+      std::vector<CachedCommit>& segment = segments.back();
+      segment.reserve(count);
+      for (std::size_t n = 0; n < count; n++, i++)
+      {
+         std::vector<std::string> fields;
+         boost::algorithm::split(fields, lines[i],
+                                 boost::algorithm::is_any_of("\t"));
+         if (fields.size() != 5)
+         {
+            valid = false;
+            break;
+         }
+
+         CachedCommit commit;
+         commit.id = fields[0];
+         if (!fields[1].empty())
+            boost::algorithm::split(commit.parents, fields[1],
+                                    boost::algorithm::is_any_of(" "));
+         commit.date = safe_convert::stringTo<boost::int64_t>(fields[2], 0);
+         commit.author = unescapeCacheField(fields[3]);
+         commit.description = unescapeCacheField(fields[4]);
+         segment.push_back(commit);
+      }
+   }
+
+   if (!valid || segments.empty())
+   {
+      Error error = systemError(boost::system::errc::invalid_argument,
+                                ERROR_LOCATION);
+      error.addProperty("path", cachePath.absolutePath());
+      return error;
+   }
+
+   pHistory->tip = tip;
+   for (std::vector<std::vector<CachedCommit> >::reverse_iterator
+        it = segments.rbegin(); it != segments.rend(); ++it)
+   {
+      pHistory->commits.insert(pHistory->commits.end(),
+                               it->begin(), it->end());
+   }
+   computeCommitGraph(&(pHistory->commits));
+
+   return Success();
+}
+
+// write the commits added for a tip (starting a new journal if requested)
+Error writeCommitCache(const FilePath& cachePath,
+                       const std::string& tip,
+                       std::vector<CachedCommit>::const_iterator begin,
+                       std::vector<CachedCommit>::const_iterator end,
+                       bool truncate)
+{
+   Error error = cachePath.parent().ensureDirectory();
+   if (error)
+      return error;
+
+   boost::shared_ptr<std::ostream> pStream;
+   error = cachePath.open_w(&pStream, truncate);
+   if (error)
+      return error;
+
+   try
+   {
+      pStream->exceptions(std::ostream::failbit | std::ostream::badbit);
+      pStream->seekp(0, std::ios_base::end);
+
+      std::ostream& os = *pStream;
+      if (truncate)
+         os << kCommitCacheVersion << "\n";
+      os << "tip\t" << tip << "\t" << std::distance(begin, end) << "\n";
+      for (std::vector<CachedCommit>::const_iterator it = begin;
+           it != end; ++it)
+      {
+         os << it->id << "\t"
+            << boost::algorithm::join(it->parents, " ") << "\t"
+            << it->date << "\t"
+            << escapeCacheField(it->author) << "\t"
+            << escapeCacheField(it->description) << "\n";
+      }
+      os.flush();
+   }
+   catch(const std::exception& e)
+   {
+      Error error = systemError(boost::system::errc::io_error,
+                                ERROR_LOCATION);
+      error.addProperty("what", e.what());
+      error.addProperty("path", cachePath.absolutePath());
+      return error;
+   }
+
+   return Success();
+}
+
 class Git : public boost::noncopyable
 {
 private:
@@ -786,27 +1197,6 @@ public:
       return Success();
    }
 
-   boost::int64_t convertGitRawDate(const std::string& time,
-                          const std::string& timeZone)
-   {
-      boost::int64_t secs = safe_convert::stringTo<boost::int64_t>(time, 0);
-
-      int offset = safe_convert::stringTo<int>(timeZone, 0);
-
-      // Positive timezone offset means we have to SUBTRACT
-      // the offset to get UTC time, and vice versa
-      int factor = offset > 0 ? -1 : 1;
-
-      offset = abs(offset);
-      int hours = offset / 100;
-      int minutes = offset % 100;
-
-      secs += factor * (hours * 60*60);
-      secs += factor * (minutes * 60);
-
-      return secs;
-   }
-
    core::Error applyPatch(const FilePath& patchFile,
                           PatchMode patchMode)
    {
@@ -855,10 +1245,374 @@ public:
       }
    }
 
+   // resolve revs to commit ids (returns false if any can't be resolved)
+   bool resolveCommits(const std::vector<std::string>& revs,
+                       std::vector<std::string>* pIds)
+   {
+      ShellArgs args = ShellArgs() << "rev-parse";
+      BOOST_FOREACH(const std::string& rev, revs)
+      {
+         args << rev + "^{commit}";
+      }
+
+      std::string output;
+      int exitCode;
+      Error error = runGit(args, &output, NULL, &exitCode);
+      if (error || exitCode != EXIT_SUCCESS)
+         return false;
+
+      boost::algorithm::trim(output);
+      boost::algorithm::split(*pIds, output,
+                              boost::algorithm::is_any_of("\r\n"),
+                              boost::algorithm::token_compress_on);
+      return pIds->size() == revs.size();
+   }
+
+   // get the history reachable from a commit, bringing it up to date (or
+   // loading it from disk) as necessary
+   core::Error commitHistory(const std::string& rev,
+                             const std::string& tip,
+                             boost::shared_ptr<CommitHistory>* ppHistory)
+   {
+      // find the history we last used for this repo/rev
+      std::string key = root_.absolutePath() + "\n" + rev;
+      boost::shared_ptr<CommitHistory> pPrevious;
+      typedef std::pair<std::string, boost::shared_ptr<CommitHistory> >
+                                                                  HistoryEntry;
+      for (std::list<HistoryEntry>::iterator it = s_commitHistories.begin();
+           it != s_commitHistories.end(); ++it)
+      {
+         if (it->first == key)
+         {
+            pPrevious = it->second;
+            s_commitHistories.erase(it);
+            break;
+         }
+      }
+
+      // no history in memory, try the one persisted by a previous session
+      FilePath cachePath = commitCachePath(root_, rev);
+      if (!pPrevious && cachePath.exists())
+      {
+         boost::shared_ptr<CommitHistory> pPersisted(new CommitHistory());
+         Error error = readCommitCache(cachePath, pPersisted.get());
+         if (error)
+            LOG_ERROR(error);
+         else
+            pPrevious = pPersisted;
+      }
+
+      // up to date
+      if (pPrevious && pPrevious->tip == tip)
+      {
+         s_commitHistories.push_front(std::make_pair(key, pPrevious));
+         *ppHistory = pPrevious;
+         return Success();
+      }
+
+      // we can extend the previous history if its tip is an ancestor of
+      // the new one (otherwise e.g. after a reset or rebase, rebuild)
+      bool extend = false;
+      if (pPrevious)
+      {
+         std::string mergeBase;
+         int exitCode;
+         Error error = runGit(ShellArgs() << "merge-base"
+                                          << pPrevious->tip << tip,
+                              &mergeBase, NULL, &exitCode);
+         if (error)
+            return error;
+         extend = exitCode == EXIT_SUCCESS &&
+                  boost::algorithm::trim_copy(mergeBase) == pPrevious->tip;
+      }
+
+      // read the new commits. note that when extending, the combined
+      // history isn't strictly in git's date order (commits merged in
+      // from older branches are listed above the previous tip) but it is
+      // still topologically ordered which is all the graph requires
+      ShellArgs args = ShellArgs() << "log" << "--encoding=UTF-8"
+                       << "--pretty=raw" << "--date-order" << tip;
+      if (extend)
+         args << "^" + pPrevious->tip;
+      std::string output;
+      Error error = runGit(args, &output);
+      if (error)
+         return error;
+
+      boost::shared_ptr<CommitHistory> pHistory(new CommitHistory());
+      pHistory->tip = tip;
+      parseRawLog(output, &(pHistory->commits));
+      output.clear();
+      std::size_t added = pHistory->commits.size();
+      if (extend)
+      {
+         pHistory->commits.insert(pHistory->commits.end(),
+                                  pPrevious->commits.begin(),
+                                  pPrevious->commits.end());
+      }
+      computeCommitGraph(&(pHistory->commits));
+
+      // persist (appending to the journal if we extended)
+      error = writeCommitCache(cachePath,
+                               tip,
+                               pHistory->commits.begin(),
+                               pHistory->commits.begin() + added,
+                               !extend);
+      if (error)
+         LOG_ERROR(error);
+
+      // keep in memory
+      s_commitHistories.push_front(std::make_pair(key, pHistory));
+      if (s_commitHistories.size() > kMaxCommitHistories)
+         s_commitHistories.pop_back();
+
+      *ppHistory = pHistory;
+      return Success();
+   }
+
+   // get the indexes of the commits in a history which match a file filter
+   // and search text (NULL if all commits match)
+   core::Error matchingCommits(CommitHistory* pHistory,
+                               const FilePath& fileFilter,
+                               const std::string& searchText,
+                               const std::vector<std::size_t>** ppMatches)
+   {
+      *ppMatches = NULL;
+      if (fileFilter.empty() && searchText.empty())
+         return Success();
+
+      // check for recent results
+      std::string key = fileFilter.absolutePath() + "\n" + searchText;
+      typedef std::pair<std::string, std::vector<std::size_t> > MatchesEntry;
+      for (std::list<MatchesEntry>::iterator it = pHistory->matches.begin();
+           it != pHistory->matches.end(); ++it)
+      {
+         if (it->first == key)
+         {
+            pHistory->matches.splice(pHistory->matches.begin(),
+                                     pHistory->matches, it);
+            *ppMatches = &(pHistory->matches.front().second);
+            return Success();
+         }
+      }
+
+      buildSearchIndex(pHistory);
+
+      // the commits which touched the file (git still has to walk the
+      // history for this but doesn't need to format it)
+      std::vector<bool> touchesFile;
+      if (!fileFilter.empty())
+      {
+         std::string output;
+         Error error = runGit(ShellArgs() << "rev-list" << pHistory->tip
+                                          << "--" << fileFilter,
+                              &output);
+         if (error)
+            return error;
+
+         touchesFile.resize(pHistory->commits.size(), false);
+         BOOST_FOREACH(const std::string& id, split(output))
+         {
+            boost::unordered_map<std::string, std::size_t>::const_iterator
+                                       it = pHistory->commitIndexes.find(id);
+            if (it != pHistory->commitIndexes.end())
+               touchesFile[it->second] = true;
+         }
+      }
+
+      // search patterns (all of which must match)
+      std::vector<std::string> patterns;
+      if (!searchText.empty())
+      {
+         boost::algorithm::split(patterns,
+                                 boost::algorithm::to_lower_copy(searchText),
+                                 boost::algorithm::is_any_of(" \t\r\n"),
+                                 boost::algorithm::token_compress_on);
+      }
+
+      std::vector<std::size_t> matches;
+      for (std::size_t i = 0; i < pHistory->commits.size(); i++)
+      {
+         if (!touchesFile.empty() && !touchesFile[i])
+            continue;
+
+         bool isMatch = true;
+         BOOST_FOREACH(const std::string& pattern, patterns)
+         {
+            if (pHistory->searchIndex[i].find(pattern) == std::string::npos)
+            {
+               isMatch = false;
+               break;
+            }
+         }
+         if (isMatch)
+            matches.push_back(i);
+      }
+
+      pHistory->matches.push_front(std::make_pair(key, matches));
+      if (pHistory->matches.size() > kMaxCommitHistoryMatches)
+         pHistory->matches.pop_back();
+      *ppMatches = &(pHistory->matches.front().second);
+      return Success();
+   }
+
+   // get the refs and tags pointing at each commit (as --decorate=full)
+   core::Error refDecorations(
+         const std::string& head,
+         std::map<std::string, std::vector<std::string> >* pRefs,
+         std::map<std::string, std::vector<std::string> >* pTags)
+   {
+      std::string output;
+      Error error = runGit(ShellArgs() << "for-each-ref"
+                           << "--format=%(objectname) %(*objectname) %(refname)",
+                           &output);
+      if (error)
+         return error;
+
+      (*pRefs)[head].push_back("HEAD");
+      BOOST_FOREACH(const std::string& line, split(output))
+      {
+         // annotated tags are peeled to the commit they point at
+         std::vector<std::string> fields;
+         boost::algorithm::split(fields, line,
+                                 boost::algorithm::is_any_of(" "));
+         if (fields.size() != 3)
+            continue;
+         const std::string& id = fields[1].empty() ? fields[0] : fields[1];
+         const std::string& ref = fields[2];
+
+         if (boost::algorithm::starts_with(ref, "refs/tags/"))
+            (*pTags)[id].push_back(ref);
+         else if (!boost::algorithm::starts_with(ref, "refs/bisect/"))
+            (*pRefs)[id].push_back(ref);
+      }
+
+      return Success();
+   }
+
+   // page through the history (or count it) using the commit cache.
+   // returns false if the rev doesn't resolve to a commit
+   bool cachedLog(const std::string& rev,
+                  const FilePath& fileFilter,
+                  int skip,
+                  int maxentries,
+                  const std::string& searchText,
+                  std::vector<CommitInfo>* pOutput,
+                  int* pLength,
+                  Error* pError)
+   {
+      std::vector<std::string> revs, ids;
+      revs.push_back("HEAD");
+      if (!rev.empty())
+         revs.push_back(rev);
+      if (!resolveCommits(revs, &ids))
+         return false;
+
+      boost::shared_ptr<CommitHistory> pHistory;
+      *pError = commitHistory(rev, ids.back(), &pHistory);
+      if (*pError)
+         return true;
+
+      const std::vector<std::size_t>* pMatches;
+      *pError = matchingCommits(pHistory.get(), fileFilter, searchText,
+                                &pMatches);
+      if (*pError)
+         return true;
+
+      std::size_t count = pMatches ? pMatches->size()
+                                   : pHistory->commits.size();
+      if (pLength)
+         *pLength = static_cast<int>(count);
+      if (!pOutput)
+         return true;
+
+      std::map<std::string, std::vector<std::string> > refs, tags;
+      *pError = refDecorations(ids.front(), &refs, &tags);
+      if (*pError)
+         return true;
+
+      std::size_t begin = std::min(static_cast<std::size_t>(
+                                            std::max(skip, 0)), count);
+      std::size_t end = maxentries < 0 ? count :
+                  std::min(begin + static_cast<std::size_t>(maxentries), count);
+      for (std::size_t i = begin; i < end; i++)
+      {
+         const CachedCommit& commit =
+                        pHistory->commits[pMatches ? (*pMatches)[i] : i];
+
+         CommitInfo info;
+         info.id = commit.id;
+         info.author = commit.author;
+         info.date = commit.date;
+         info.description = commit.description;
+         info.subject = commit.description.substr(
+                                       0, commit.description.find('\n'));
+         BOOST_FOREACH(const std::string& parent, commit.parents)
+         {
+            if (!info.parent.empty())
+               info.parent.push_back(' ');
+            info.parent.append(parent, 0, 8);
+         }
+         info.refs = refs[commit.id];
+         info.tags = tags[commit.id];
+
+         // the graph is only meaningful for the unfiltered history
+         if (!pMatches)
+            info.graph = commit.graph;
+
+         pOutput->push_back(info);
+      }
+
+      return true;
+   }
+
    core::Error logLength(const std::string &rev,
                          const FilePath& fileFilter,
                          const std::string &searchText,
                          int *pLength)
+   {
+      LOCK_MUTEX(s_commitHistoriesMutex)
+      {
+         Error error;
+         if (cachedLog(rev, fileFilter, 0, 0, searchText, NULL, pLength,
+                       &error))
+         {
+            return error;
+         }
+      }
+      END_LOCK_MUTEX
+
+      return logLengthFromGit(rev, fileFilter, searchText, pLength);
+   }
+
+   core::Error log(const std::string& rev,
+                   const FilePath& fileFilter,
+                   int skip,
+                   int maxentries,
+                   const std::string& searchText,
+                   std::vector<CommitInfo>* pOutput)
+   {
+      LOCK_MUTEX(s_commitHistoriesMutex)
+      {
+         Error error;
+         if (cachedLog(rev, fileFilter, skip, maxentries, searchText,
+                       pOutput, NULL, &error))
+         {
+            return error;
+         }
+      }
+      END_LOCK_MUTEX
+
+      return logFromGit(rev, fileFilter, skip, maxentries, searchText,
+                        pOutput);
+   }
+
+   // read the history directly from git (used when the rev can't be
+   // resolved to a single commit to key the commit cache)
+   core::Error logLengthFromGit(const std::string &rev,
+                                const FilePath& fileFilter,
+                                const std::string &searchText,
+                                int *pLength)
    {
       if (searchText.empty())
       {
@@ -881,7 +1635,7 @@ public:
       else
       {
          std::vector<CommitInfo> output;
-         Error error = log(rev, fileFilter, 0, -1, searchText, &output);
+         Error error = logFromGit(rev, fileFilter, 0, -1, searchText, &output);
          if (error)
             return error;
          *pLength = output.size();
@@ -889,12 +1643,12 @@ public:
       }
    }
 
-   core::Error log(const std::string& rev,
-                   const FilePath& fileFilter,
-                   int skip,
-                   int maxentries,
-                   const std::string& searchText,
-                   std::vector<CommitInfo>* pOutput)
+   core::Error logFromGit(const std::string& rev,
+                          const FilePath& fileFilter,
+                          int skip,
+                          int maxentries,
+                          const std::string& searchText,
+                          std::vector<CommitInfo>* pOutput)
    {
       ShellArgs args = ShellArgs() << "log" << "--encoding=UTF-8"
                        << "--pretty=raw" << "--decorate=full"
@@ -1674,6 +2428,21 @@ Error vcsSetIgnores(const json::JsonRpcRequest& request,
 }
 
 
+// equivalent of fileFilterPath which resolves against the captured home
+// path (the history rpcs are served from worker threads)
+FilePath historyFileFilterPath(const json::Value& fileFilterJson)
+{
+   if (json::isType<std::string>(fileFilterJson))
+   {
+      return FilePath::resolveAliasedPath(fileFilterJson.get_str(),
+                                          processContext().homePath);
+   }
+   else
+   {
+      return FilePath();
+   }
+}
+
 Error vcsHistoryCount(const json::JsonRpcRequest& request,
                       json::JsonRpcResponse* pResponse)
 {
@@ -1686,7 +2455,7 @@ Error vcsHistoryCount(const json::JsonRpcRequest& request,
    if (error)
       return error;
 
-   FilePath fileFilter = fileFilterPath(fileFilterJson);
+   FilePath fileFilter = historyFileFilterPath(fileFilterJson);
 
    boost::algorithm::trim(searchText);
 
@@ -1717,7 +2486,7 @@ Error vcsHistory(const json::JsonRpcRequest& request,
    if (error)
       return error;
 
-   FilePath fileFilter = fileFilterPath(fileFilterJson);
+   FilePath fileFilter = historyFileFilterPath(fileFilterJson);
 
    boost::algorithm::trim(searchText);
 
@@ -2595,6 +3364,8 @@ core::Error initialize()
 
    module_context::events().onShutdown.connect(onShutdown);
 
+   s_mainThreadId = boost::this_thread::get_id();
+
    initGitBin();
 
    bool interceptAskPass;
@@ -2631,6 +3402,11 @@ core::Error initialize()
       core::system::setenv("SSH_ASKPASS", "rpostback-askpass");
    }
 
+   // keep the snapshot of the environment used by worker threads current
+   ProcessContext context;
+   captureProcessContext(&context);
+   module_context::events().onDetectChanges.connect(onDetectChanges);
+
    // add suspend/resume handler
    addSuspendHandler(SuspendHandler(onSuspend, onResume));
 
@@ -2657,8 +3433,8 @@ core::Error initialize()
       (bind(registerRpcMethod, "git_pull", vcsPull))
       (bind(registerRpcMethod, "git_diff_file", vcsDiffFile))
       (bind(registerRpcMethod, "git_apply_patch", vcsApplyPatch))
-      (bind(registerRpcMethod, "git_history_count", vcsHistoryCount))
-      (bind(registerRpcMethod, "git_history", vcsHistory))
+      (bind(registerThreadSafeRpcMethod, "git_history_count", vcsHistoryCount))
+      (bind(registerThreadSafeRpcMethod, "git_history", vcsHistory))
       (bind(registerRpcMethod, "git_show", vcsShow))
       (bind(registerRpcMethod, "git_show_file", vcsShowFile))
       (bind(registerRpcMethod, "git_export_file", vcsExportFile))
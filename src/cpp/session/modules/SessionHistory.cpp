@@ -19,12 +19,17 @@
 #include <sstream>
 #include <vector>
 #include <algorithm>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <set>
 
 #include <boost/utility.hpp>
 #include <boost/bind.hpp>
 #include <boost/function.hpp>
 #include <boost/format.hpp>
 #include <boost/tokenizer.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 
@@ -88,7 +93,7 @@ void historyEntriesAsJson(const std::vector<HistoryEntry>& entries,
 class HistoryEntryReader
 {
 public:
-   HistoryEntryReader() : nextIndex_(0) {}
+   explicit HistoryEntryReader(int nextIndex = 0) : nextIndex_(nextIndex) {}
    
    ReadCollectionAction operator()(const std::string& line, 
                                    HistoryEntry* pEntry)
@@ -97,15 +102,17 @@ public:
       if (line.find(':') == std::string::npos)
          return ReadCollectionIgnoreLine;
 
-      pEntry->index = nextIndex_++; 
       std::istringstream istr(line);
       istr >> pEntry->timestamp ;
       istr.ignore(1, ':');
       std::getline(istr, pEntry->command);
       
-      // if we had a read failure log it and return ignore state
+      // if we had a read failure log it and return ignore state (the index
+      // only advances for lines which are added, since it is the entry's
+      // position in the entries vector)
       if (!istr.fail())
       {
+         pEntry->index = nextIndex_++;
          return ReadCollectionAddLine;
       }
       else
@@ -120,62 +127,278 @@ private:
 };
    
    
+bool matches(const HistoryEntry& entry,
+             const std::vector<std::string>& searchTerms)
+{   
+   // look for each search term in the input
+   for (std::vector<std::string>::const_iterator it = searchTerms.begin();
+        it != searchTerms.end();
+        ++it)
+   {
+      if (!boost::algorithm::contains(entry.command, *it))
+         return false;
+   }
+   
+   // had all of the search terms, return true
+   return true;
+}
+
+bool hasMoreEntries(const std::vector<HistoryEntry>& entries, int maxEntries)
+{
+   return entries.size() < static_cast<std::size_t>(std::max(maxEntries, 0));
+}
+
+// index over the history archive. search terms match anywhere within a
+// command (not just on token boundaries) so term lookups are narrowed via
+// postings lists of the trigrams they contain. prefix lookups use an
+// ordered map of the distinct commands. postings are kept in ascending
+// index order (entries are only ever appended)
+class HistoryIndex : boost::noncopyable
+{
+public:
+   void clear()
+   {
+      trigrams_.clear();
+      commands_.clear();
+   }
+
+   void add(const HistoryEntry& entry)
+   {
+      std::vector<unsigned int> trigrams;
+      trigramsOf(entry.command, &trigrams);
+      for (std::vector<unsigned int>::const_iterator it = trigrams.begin();
+           it != trigrams.end();
+           ++it)
+      {
+         trigrams_[*it].push_back(entry.index);
+      }
+
+      commands_[entry.command].push_back(entry.index);
+   }
+
+   // get the (ascending) indexes of entries which may contain all of the
+   // search terms. returns false if none of the terms are long enough
+   // to be looked up in the index
+   bool candidates(const std::vector<std::string>& searchTerms,
+                   std::vector<int>* pIndexes) const
+   {
+      // collect the postings lists for every trigram in every term
+      std::vector<const std::vector<int>*> postings;
+      for (std::vector<std::string>::const_iterator it = searchTerms.begin();
+           it != searchTerms.end();
+           ++it)
+      {
+         std::vector<unsigned int> trigrams;
+         trigramsOf(*it, &trigrams);
+         for (std::vector<unsigned int>::const_iterator
+                 tIt = trigrams.begin(); tIt != trigrams.end(); ++tIt)
+         {
+            Trigrams::const_iterator pIt = trigrams_.find(*tIt);
+            if (pIt == trigrams_.end())
+            {
+               pIndexes->clear();
+               return true;
+            }
+            postings.push_back(&(pIt->second));
+         }
+      }
+
+      if (postings.empty())
+         return false;
+
+      // intersect starting with the shortest list
+      std::sort(postings.begin(), postings.end(), shorterPostings);
+      *pIndexes = *postings[0];
+      for (std::size_t i = 1; i < postings.size() && !pIndexes->empty(); i++)
+      {
+         std::vector<int> intersection;
+         std::set_intersection(pIndexes->begin(), pIndexes->end(),
+                               postings[i]->begin(), postings[i]->end(),
+                               std::back_inserter(intersection));
+         pIndexes->swap(intersection);
+      }
+      return true;
+   }
+
+   // get the indexes (most recent first) of up to maxEntries entries
+   // whose command starts with the prefix
+   void prefixMatches(const std::string& prefix,
+                      int maxEntries,
+                      bool uniqueOnly,
+                      std::vector<int>* pIndexes) const
+   {
+      pIndexes->clear();
+      for (Commands::const_iterator it = commands_.lower_bound(prefix);
+           it != commands_.end() &&
+              boost::algorithm::starts_with(it->first, prefix);
+           ++it)
+      {
+         if (uniqueOnly)
+            pIndexes->push_back(it->second.back());
+         else
+            pIndexes->insert(pIndexes->end(),
+                             it->second.begin(),
+                             it->second.end());
+      }
+
+      std::size_t count = std::min(pIndexes->size(),
+               static_cast<std::size_t>(std::max(maxEntries, 0)));
+      std::partial_sort(pIndexes->begin(),
+                        pIndexes->begin() + count,
+                        pIndexes->end(),
+                        std::greater<int>());
+      pIndexes->resize(count);
+   }
+
+private:
+   static void trigramsOf(const std::string& str,
+                          std::vector<unsigned int>* pTrigrams)
+   {
+      pTrigrams->clear();
+      for (std::size_t i = 0; i + 2 < str.size(); i++)
+      {
+         unsigned int trigram =
+               (static_cast<unsigned char>(str[i]) << 16) |
+               (static_cast<unsigned char>(str[i+1]) << 8) |
+                static_cast<unsigned char>(str[i+2]);
+         pTrigrams->push_back(trigram);
+      }
+      std::sort(pTrigrams->begin(), pTrigrams->end());
+      pTrigrams->erase(std::unique(pTrigrams->begin(), pTrigrams->end()),
+                       pTrigrams->end());
+   }
+
+   static bool shorterPostings(const std::vector<int>* pLhs,
+                               const std::vector<int>* pRhs)
+   {
+      return pLhs->size() < pRhs->size();
+   }
+
+private:
+   typedef boost::unordered_map<unsigned int, std::vector<int> > Trigrams;
+   Trigrams trigrams_;
+   typedef std::map<std::string, std::vector<int> > Commands;
+   Commands commands_;
+};
+   
 class History : boost::noncopyable
 {
 private:
-   History() : entryCacheLastWriteTime_(-1) {}
+   History() : entryCacheLastWriteTime_(-1), entryCacheFileSize_(0) {}
    friend History& historyArchive();
    
 public:
    
    Error add(const std::string& command)
    {
-      // reset the cache (since this write will invalidate the current one,
-      // no sense in keeping our cache around in memory)
-      entries_.clear();
-      entryCacheLastWriteTime_ = -1;
+      // pick up any entries written by other processes so that the
+      // offset we advance below remains in sync with the file
+      FilePath historyDBPath = historyDatabaseFilePath();
+      syncEntries(historyDBPath);
 
       // write the entry to the file
       std::ostringstream ostrEntry ;
       double currentTime = core::date_time::millisecondsSinceEpoch();
       writeEntry(currentTime, command, &ostrEntry);
       ostrEntry << std::endl;
-      return appendToFile(historyDatabaseFilePath(), ostrEntry.str());
+      std::string entry = ostrEntry.str();
+      Error error = appendToFile(historyDBPath, entry);
+      if (error)
+      {
+         resetEntries();
+         return error;
+      }
+
+      // if the file is exactly our cached contents plus this entry then
+      // append it to our in-memory copy (otherwise someone else wrote to
+      // the file concurrently so force a full re-read next time)
+      if (historyDBPath.size() == (entryCacheFileSize_ + entry.size()))
+      {
+         parseEntries(entry);
+         entryCacheFileSize_ += entry.size();
+         entryCacheLastWriteTime_ = historyDBPath.lastWriteTime();
+      }
+      else
+      {
+         resetEntries();
+      }
+
+      return Success();
    }
 
    const std::vector<HistoryEntry>& entries() const
    {
-      // calculate path to history db
-      FilePath historyDBPath = historyDatabaseFilePath();
+      syncEntries(historyDatabaseFilePath());
+      return entries_;
+   }
 
-      // if the file doesn't exist then clear the collection
-      if (!historyDBPath.exists())
+   void search(const std::vector<std::string>& searchTerms,
+               int maxEntries,
+               std::vector<HistoryEntry>* pMatchingEntries) const
+   {
+      syncEntries(historyDatabaseFilePath());
+
+      // narrow using the index if we can, otherwise check every entry
+      std::vector<int> candidates;
+      if (index_.candidates(searchTerms, &candidates))
       {
-         entries_.clear();
+         for (std::vector<int>::const_reverse_iterator
+                 it = candidates.rbegin();
+              it != candidates.rend() &&
+                 hasMoreEntries(*pMatchingEntries, maxEntries);
+              ++it)
+         {
+            const HistoryEntry& entry = entries_[*it];
+            if (matches(entry, searchTerms))
+               pMatchingEntries->push_back(entry);
+         }
       }
-
-      // otherwise check for divergent lastWriteTime and read the file
-      // if our internal list isn't up to date
-      else if (historyDBPath.lastWriteTime() != entryCacheLastWriteTime_)
+      else
       {
-         entries_.clear();
-         Error error = readCollectionFromFile<std::vector<HistoryEntry> >(
-                                                      historyDBPath,
-                                                      &entries_,
-                                                      HistoryEntryReader());
-         if (error)
+         for (std::vector<HistoryEntry>::const_reverse_iterator
+                 it = entries_.rbegin();
+              it != entries_.rend() &&
+                 hasMoreEntries(*pMatchingEntries, maxEntries);
+              ++it)
          {
-            LOG_ERROR(error);
+            if (matches(*it, searchTerms))
+               pMatchingEntries->push_back(*it);
          }
-         else
+      }
+   }
+
+   void searchByPrefix(const std::string& prefix,
+                       int maxEntries,
+                       bool uniqueOnly,
+                       std::vector<HistoryEntry>* pMatchingEntries) const
+   {
+      syncEntries(historyDatabaseFilePath());
+
+      // an empty prefix matches everything so the most recent entries
+      // are the result (no need to consult the index)
+      if (prefix.empty())
+      {
+         std::set<std::string> matchedCommands;
+         for (std::vector<HistoryEntry>::const_reverse_iterator
+                 it = entries_.rbegin();
+              it != entries_.rend() &&
+                 hasMoreEntries(*pMatchingEntries, maxEntries);
+              ++it)
          {
-            entryCacheLastWriteTime_ = historyDBPath.lastWriteTime();
+            if (!uniqueOnly || matchedCommands.insert(it->command).second)
+               pMatchingEntries->push_back(*it);
          }
+         return;
+      }
 
+      std::vector<int> indexes;
+      index_.prefixMatches(prefix, maxEntries, uniqueOnly, &indexes);
+      for (std::vector<int>::const_iterator it = indexes.begin();
+           it != indexes.end();
+           ++it)
+      {
+         pMatchingEntries->push_back(entries_[*it]);
       }
-      
-      // return entries
-      return entries_;
    }
 
    static void migrateRhistoryIfNecessary()
@@ -221,11 +444,117 @@ private:
    {
       return module_context::userScratchPath().complete("history_database");
    }
-   
+
+   void resetEntries() const
+   {
+      entries_.clear();
+      index_.clear();
+      entryCacheLastWriteTime_ = -1;
+      entryCacheFileSize_ = 0;
+   }
+
+   void syncEntries(const FilePath& historyDBPath) const
+   {
+      // if the file doesn't exist then clear the collection
+      if (!historyDBPath.exists())
+      {
+         resetEntries();
+         return;
+      }
+
+      // if the size and lastWriteTime are what we last saw then we
+      // are already up to date
+      uintmax_t fileSize = historyDBPath.size();
+      std::time_t lastWriteTime = historyDBPath.lastWriteTime();
+      if (fileSize == entryCacheFileSize_ &&
+          lastWriteTime == entryCacheLastWriteTime_)
+      {
+         return;
+      }
+
+      // the file is append-only so anything other than growth means it
+      // was truncated or replaced -- in that case re-read from the start
+      if (fileSize <= entryCacheFileSize_)
+         resetEntries();
+
+      // read the entries appended since our last read
+      Error error = readEntriesFrom(historyDBPath, entryCacheFileSize_);
+      if (error)
+      {
+         LOG_ERROR(error);
+         resetEntries();
+      }
+      else
+      {
+         entryCacheLastWriteTime_ = lastWriteTime;
+      }
+   }
+
+   Error readEntriesFrom(const FilePath& historyDBPath,
+                         uintmax_t offset) const
+   {
+      // open the file and read everything past the offset
+      boost::shared_ptr<std::istream> pIfs;
+      Error error = historyDBPath.open_r(&pIfs);
+      if (error)
+         return error;
+
+      std::string contents;
+      try
+      {
+         pIfs->seekg(offset);
+         if (pIfs->fail())
+            return systemError(boost::system::errc::io_error, ERROR_LOCATION);
+
+         contents.assign(std::istreambuf_iterator<char>(*pIfs),
+                         std::istreambuf_iterator<char>());
+      }
+      catch(const std::exception& e)
+      {
+         Error error = systemError(boost::system::errc::io_error,
+                                   ERROR_LOCATION);
+         error.addProperty("what", e.what());
+         error.addProperty("path", historyDBPath.absolutePath());
+         return error;
+      }
+
+      // only consume complete lines (a trailing partial line may still
+      // be in the process of being written)
+      std::string::size_type end = contents.rfind('\n');
+      if (end == std::string::npos)
+         return Success();
+      contents.resize(end + 1);
+
+      parseEntries(contents);
+      entryCacheFileSize_ = offset + contents.size();
+      return Success();
+   }
+
+   void parseEntries(const std::string& lines) const
+   {
+      HistoryEntryReader reader(entries_.size());
+      std::istringstream istr(lines);
+      std::string line;
+      while (std::getline(istr, line))
+      {
+         boost::algorithm::trim(line);
+         if (line.empty())
+            continue;
+
+         HistoryEntry entry;
+         if (reader(line, &entry) == ReadCollectionAddLine)
+         {
+            entries_.push_back(entry);
+            index_.add(entry);
+         }
+      }
+   }
    
 private:
    mutable std::time_t entryCacheLastWriteTime_;
+   mutable uintmax_t entryCacheFileSize_;
    mutable std::vector<HistoryEntry> entries_;
+   mutable HistoryIndex index_;
 };
    
 History& historyArchive()
@@ -262,22 +591,6 @@ Error setJsonResultFromHistory(int startIndex,
    return Success();
 }
    
-bool matches(const HistoryEntry& entry,
-             const std::vector<std::string>& searchTerms)
-{   
-   // look for each search term in the input
-   for (std::vector<std::string>::const_iterator it = searchTerms.begin();
-        it != searchTerms.end();
-        ++it)
-   {
-      if (!boost::algorithm::contains(entry.command, *it))
-         return false;
-   }
-   
-   // had all of the search terms, return true
-   return true;
-}
-
 
 void historyRangeAsJson(int startIndex,
                         int endIndex,
@@ -432,24 +745,8 @@ Error searchHistoryArchive(const json::JsonRpcRequest& request,
    std::copy(tok.begin(), tok.end(), std::back_inserter(searchTerms));
    
    // examine the items in the history for matches
-   const std::vector<HistoryEntry>& allEntries =  historyArchive().entries();
    std::vector<HistoryEntry> matchingEntries;
-   for (std::vector<HistoryEntry>::const_reverse_iterator 
-            it = allEntries.rbegin();
-            it != allEntries.rend();
-            ++it)
-   {
-      // check limit
-      if (matchingEntries.size() >= static_cast<std::size_t>(maxEntries))
-         break;
-
-      // look for match
-      if (matches(*it, searchTerms))
-      {
-         // add entry
-         matchingEntries.push_back(*it);
-      }
-   }
+   historyArchive().search(searchTerms, maxEntries, &matchingEntries);
 
    // return json
    json::Object entriesJson;
@@ -474,28 +771,11 @@ Error searchHistoryArchiveByPrefix(const json::JsonRpcRequest& request,
    boost::algorithm::trim(prefix);
    
    // examine the items in the history for matches
-   const std::vector<HistoryEntry>& allEntries = historyArchive().entries();
-   std::set<std::string> matchedCommands;
    std::vector<HistoryEntry> matchingEntries;
-   for (std::vector<HistoryEntry>::const_reverse_iterator 
-        it = allEntries.rbegin();
-        it != allEntries.rend();
-        ++it)
-   {
-      // check limit
-      if (matchingEntries.size() >= static_cast<std::size_t>(maxEntries))
-         break;
-      
-      // look for match 
-      if (boost::algorithm::starts_with(it->command, prefix))
-      {
-         if (!uniqueOnly || (matchedCommands.count(it->command) == 0))
-         {
-            matchingEntries.push_back(*it);
-            matchedCommands.insert(it->command);
-         }
-      }
-   }
+   historyArchive().searchByPrefix(prefix,
+                                   maxEntries,
+                                   uniqueOnly,
+                                   &matchingEntries);
    
    // return json
    json::Object entriesJson;
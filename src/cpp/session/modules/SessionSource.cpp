@@ -19,8 +19,10 @@
 #include <map>
 
 #include <boost/bind.hpp>
+#include <boost/assert.hpp>
 #include <boost/foreach.hpp>
 #include <boost/utility.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <core/r_util/RSourceIndex.hpp>
 
@@ -94,6 +96,28 @@ public:
       indexes_[pDoc->id()] = pIndex;
    }
 
+   // update the index of a document whose contents were changed by
+   // replacing [offset, offset+removedLength) with insertedLength bytes
+   void update(boost::shared_ptr<SourceDocument> pDoc,
+               std::size_t offset,
+               std::size_t removedLength,
+               std::size_t insertedLength)
+   {
+      // reindex only the edited statements if we have an index of the
+      // document's previous contents (otherwise index the whole thing)
+      IndexMap::iterator it = indexes_.find(pDoc->id());
+      if (it == indexes_.end() || it->second->context() != pDoc->path())
+      {
+         update(pDoc);
+         return;
+      }
+
+      it->second->update(pDoc->contents(),
+                         offset,
+                         removedLength,
+                         insertedLength);
+   }
+
    void remove(const std::string& id)
    {
       indexes_.erase(id);
@@ -252,6 +276,7 @@ Error openDocument(const json::JsonRpcRequest& request,
 } 
 
 Error saveDocumentCore(const std::string& contents,
+                       bool contentsChanged,
                        const json::Value& jsonPath,
                        const json::Value& jsonType,
                        const json::Value& jsonEncoding,
@@ -271,7 +296,7 @@ Error saveDocumentCore(const std::string& contents,
    // update dirty state: dirty if there was no path AND the new contents
    // are different from the old contents (and was thus a content autosave
    // as distinct from a fold-spec or scroll-position/selection autosave)
-   pDoc->setDirty(!hasPath && (contents != pDoc->contents()));
+   pDoc->setDirty(!hasPath && contentsChanged);
    
    bool hasType = json::isType<std::string>(jsonType);
    if (hasType)
@@ -348,7 +373,9 @@ Error saveDocumentCore(const std::string& contents,
    }
 
    // always update the contents so it holds the original UTF-8 data
-   pDoc->setContents(contents);
+   // (unless it already does, e.g. after a diff was spliced into it)
+   if (pDoc->contents() != contents)
+      pDoc->setContents(contents);
 
    return Success();
 }
@@ -376,7 +403,8 @@ Error saveDocument(const json::JsonRpcRequest& request,
    if (error)
       return error ;
    
-   error = saveDocumentCore(contents, jsonPath, jsonType, jsonEncoding,
+   error = saveDocumentCore(contents, contents != pDoc->contents(),
+                            jsonPath, jsonType, jsonEncoding,
                             jsonFoldSpec, pDoc);
    if (error)
       return error;
@@ -453,19 +481,46 @@ Error saveDocumentDiff(const json::JsonRpcRequest& request,
       if (error)
          return Success(); // UTF8 decoding failed. Abort differential save.
 
+      std::size_t byteOffset = rangeBegin - contents.begin();
+      std::size_t byteLength = rangeEnd - rangeBegin;
+
       contents.erase(rangeBegin, rangeEnd);
       contents.insert(rangeBegin, replacement.begin(), replacement.end());
+
+      // note whether this changes the contents before applying the change
+      // to the document (its hash is updated from the change rather than
+      // computed over all of the contents)
+      bool contentsChanged = pDoc->contents().compare(byteOffset,
+                                                      byteLength,
+                                                      replacement) != 0;
+      pDoc->replaceContents(byteOffset, byteLength, replacement);
       
-      error = saveDocumentCore(contents, jsonPath, jsonType, jsonEncoding,
+      error = saveDocumentCore(contents, contentsChanged,
+                               jsonPath, jsonType, jsonEncoding,
                                jsonFoldSpec, pDoc);
       if (error)
          return error;
+
+      // an autosave which changed the contents leaves the document dirty
+      BOOST_ASSERT(hasPath || !contentsChanged || pDoc->dirty());
       
-      // write to the source_database
-      error = sourceDatabasePutWithUpdatedContents(pDoc);
+      // write to the source_database (documents saved to a path are
+      // re-read from disk so they are written in full, autosaves only
+      // record the change)
+      if (hasPath)
+         error = source_database::put(pDoc);
+      else
+         error = source_database::putChange(pDoc,
+                                            byteOffset,
+                                            byteLength,
+                                            replacement);
       if (error)
          return error;
 
+      // update the index for the edited region
+      rSourceIndexes().update(pDoc, byteOffset, byteLength,
+                              replacement.size());
+
       pResponse->setResult(pDoc->hash());
    }
    
@@ -923,6 +978,60 @@ SEXP rs_fileEdit(SEXP fileSEXP)
    return R_NilValue;
 }
 
+// latency of the source database rpcs (available via .rs.sourceRpcLatency)
+struct RpcLatency
+{
+   RpcLatency() : calls(0), totalMs(0), maxMs(0) {}
+   int calls;
+   double totalMs;
+   double maxMs;
+};
+std::map<std::string, RpcLatency> s_rpcLatency;
+
+Error timedRpcMethod(const std::string& name,
+                     const json::JsonRpcFunction& function,
+                     const json::JsonRpcRequest& request,
+                     json::JsonRpcResponse* pResponse)
+{
+   using namespace boost::posix_time;
+   ptime start = microsec_clock::universal_time();
+
+   Error error = function(request, pResponse);
+
+   double ms = (microsec_clock::universal_time() - start).total_microseconds()
+                                                                  / 1000.0;
+   RpcLatency& latency = s_rpcLatency[name];
+   latency.calls++;
+   latency.totalMs += ms;
+   latency.maxMs = std::max(latency.maxMs, ms);
+
+   return error;
+}
+
+Error registerTimedRpcMethod(const std::string& name,
+                             const json::JsonRpcFunction& function)
+{
+   return module_context::registerRpcMethod(
+                  name, boost::bind(timedRpcMethod, name, function, _1, _2));
+}
+
+SEXP rs_sourceRpcLatency()
+{
+   json::Object latencyJson;
+   for (std::map<std::string, RpcLatency>::const_iterator
+        it = s_rpcLatency.begin(); it != s_rpcLatency.end(); ++it)
+   {
+      json::Object methodJson;
+      methodJson["calls"] = it->second.calls;
+      methodJson["mean_ms"] = it->second.totalMs / it->second.calls;
+      methodJson["max_ms"] = it->second.maxMs;
+      latencyJson[it->first] = methodJson;
+   }
+
+   r::sexp::Protect rProtect;
+   return r::sexp::create(latencyJson, &rProtect);
+}
+
 } // anonymous namespace
 
 Error clientInitDocuments(core::json::Array* pJsonDocs)
@@ -988,23 +1097,30 @@ Error initialize()
    methodDef.numArgs = 1;
    r::routines::addCallMethod(methodDef);
 
+   // register sourceRpcLatency method
+   R_CallMethodDef latencyMethodDef ;
+   latencyMethodDef.name = "rs_sourceRpcLatency" ;
+   latencyMethodDef.fun = (DL_FUNC) rs_sourceRpcLatency ;
+   latencyMethodDef.numArgs = 0;
+   r::routines::addCallMethod(latencyMethodDef);
+
    // install rpc methods
    using boost::bind;
    using namespace r::function_hook;
    ExecBlock initBlock ;
    initBlock.addFunctions()
-      (bind(registerRpcMethod, "new_document", newDocument))
-      (bind(registerRpcMethod, "open_document", openDocument))
-      (bind(registerRpcMethod, "save_document", saveDocument))
-      (bind(registerRpcMethod, "save_document_diff", saveDocumentDiff))
-      (bind(registerRpcMethod, "check_for_external_edit", checkForExternalEdit))
-      (bind(registerRpcMethod, "ignore_external_edit", ignoreExternalEdit))
-      (bind(registerRpcMethod, "set_source_document_on_save", setSourceDocumentOnSave))
-      (bind(registerRpcMethod, "modify_document_properties", modifyDocumentProperties))
-      (bind(registerRpcMethod, "revert_document", revertDocument))
-      (bind(registerRpcMethod, "reopen_with_encoding", reopenWithEncoding))
-      (bind(registerRpcMethod, "close_document", closeDocument))
-      (bind(registerRpcMethod, "close_all_documents", closeAllDocuments))
+      (bind(registerTimedRpcMethod, "new_document", newDocument))
+      (bind(registerTimedRpcMethod, "open_document", openDocument))
+      (bind(registerTimedRpcMethod, "save_document", saveDocument))
+      (bind(registerTimedRpcMethod, "save_document_diff", saveDocumentDiff))
+      (bind(registerTimedRpcMethod, "check_for_external_edit", checkForExternalEdit))
+      (bind(registerTimedRpcMethod, "ignore_external_edit", ignoreExternalEdit))
+      (bind(registerTimedRpcMethod, "set_source_document_on_save", setSourceDocumentOnSave))
+      (bind(registerTimedRpcMethod, "modify_document_properties", modifyDocumentProperties))
+      (bind(registerTimedRpcMethod, "revert_document", revertDocument))
+      (bind(registerTimedRpcMethod, "reopen_with_encoding", reopenWithEncoding))
+      (bind(registerTimedRpcMethod, "close_document", closeDocument))
+      (bind(registerTimedRpcMethod, "close_all_documents", closeAllDocuments))
       (bind(registerRpcMethod, "get_source_template", getSourceTemplate))
       (bind(registerRpcMethod, "create_rd_shell", createRdShell))
       (bind(sourceModuleRFile, "SessionSource.R"));
@@ -20,6 +20,9 @@
 #include <boost/bind.hpp>
 #include <boost/format.hpp>
 #include <boost/utility.hpp>
+#include <boost/foreach.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
@@ -217,9 +220,11 @@ void onResume(const Settings& settings)
 }
 
 
-// detect changes in the environment by inspecting the list of variable
-// names as well as the SEXP pointers (a new pointer implies a mutation of
-// an object)
+// detect changes in the environment by inspecting the bindings of its
+// frame as well as the SEXP pointers (a new pointer implies a mutation of
+// an object). the previous bindings are kept in a hash map keyed by symbol
+// so that each check is a single unsorted pass over the environment and
+// names are only materialized for bindings that changed
 class GlobalEnvironmentMonitor : boost::noncopyable
 {
 public:
@@ -236,84 +241,106 @@ public:
    
    void checkForChanges()
    {
-      // get the current environment
-      std::vector<r::sexp::Variable> currentEnv ;
-      listEnvironment(&currentEnv);
+      // get the current bindings in the global environment (reuses the
+      // buffer so we don't reallocate on every prompt)
+      r::sexp::listFrameBindings(R_GlobalEnv, false, &currentEnv_);
       
       // force refresh event the first time
       if (!initialized_)
       {
          enqueRefreshEvent();
          initialized_ = true;
+         resetLastEnv();
+         return;
       }
-      
-      // if there are changes
-      else if (currentEnv != lastEnv_)
-      {      
-         // optimize for empty currentEnv (user reset workspace) or empty 
-         // lastEnv_ (startup) by just sending a single WorkspaceRefresh event
-         if (currentEnv.empty() || lastEnv_.empty())
-         {
+
+      // optimize for empty currentEnv (user reset workspace) or empty 
+      // lastEnv_ (startup) by just sending a single WorkspaceRefresh event
+      if (currentEnv_.empty() || lastEnv_.empty())
+      {
+         if (currentEnv_.size() != lastEnv_.size())
             enqueRefreshEvent();
+         resetLastEnv();
+         return;
+      }
+
+      // find adds & assigns (all bindings in the current environment which
+      // are either new or have a different value), updating lastEnv_ as
+      // we go so it ends up a superset of the current environment
+      std::vector<Variable> addedVars ;
+      BOOST_FOREACH(const Binding& binding, currentEnv_)
+      {
+         std::pair<Bindings::iterator,bool> result =
+                                             lastEnv_.insert(binding);
+         if (result.second || result.first->second != binding.second)
+         {
+            result.first->second = binding.second;
+            addedVars.push_back(std::make_pair(
+                                    r::sexp::symbolName(binding.first),
+                                    binding.second));
+         }
+      }
+
+      // find deletes (all bindings in the previous environment but NOT in
+      // the current environment). if lastEnv_ is the same size as the
+      // current environment then there can't be any so we can skip this.
+      std::vector<Variable> removedVars ;
+      if (lastEnv_.size() != currentEnv_.size())
+      {
+         boost::unordered_set<SEXP> currentSymbols;
+         BOOST_FOREACH(const Binding& binding, currentEnv_)
+         {
+            currentSymbols.insert(binding.first);
          }
-         else
+
+         for (Bindings::iterator it = lastEnv_.begin(); it != lastEnv_.end(); )
          {
-            // find deletes (all variable names in the previous environment but
-            // NOT in the current environment)
-            std::vector<Variable> removedVars ;
-            std::set_difference(lastEnv_.begin(), lastEnv_.end(),
-                                currentEnv.begin(), currentEnv.end(),
-                                std::back_inserter(removedVars),
-                                boost::bind(
-                                  &GlobalEnvironmentMonitor::compareVarName,
-                                  this, _1, _2));
-                                
-            // fire removed event for deletes
-            std::for_each(removedVars.begin(), 
-                          removedVars.end(), 
-                          enqueRemovedEvent);
-            
-            // find adds & assigns (all variable name/value combinations in the 
-            // current environment but NOT in the previous environment)
-            std::vector<Variable> addedVars ;
-            std::set_difference(currentEnv.begin(), currentEnv.end(),
-                                lastEnv_.begin(), lastEnv_.end(),
-                                std::back_inserter(addedVars));
-                                
-            // fire assigned event for adds & assigns
-            std::for_each(addedVars.begin(), 
-                          addedVars.end(), 
-                          enqueAssignedEvent);
+            if (currentSymbols.find(it->first) == currentSymbols.end())
+            {
+               removedVars.push_back(std::make_pair(
+                                          r::sexp::symbolName(it->first),
+                                          it->second));
+               it = lastEnv_.erase(it);
+            }
+            else
+            {
+               ++it;
+            }
          }
       }
-      
-      // set the "last environment" list to the current env
-      // note that the SEXP values within the currentEnv are not protected
-      // beyond the scope of this call. this is OK because we only reference
-      // the pointer values not the underlying R objects. if we want to be
-      // able to manipulate the SEXPs directly we'll need a static protection
-      // context so the objects are guaranteed to survive until the next call
-      lastEnv_ = currentEnv;
+
+      // fire removed event for deletes
+      std::sort(removedVars.begin(), removedVars.end());
+      std::for_each(removedVars.begin(), 
+                    removedVars.end(), 
+                    enqueRemovedEvent);
+
+      // fire assigned event for adds & assigns
+      std::sort(addedVars.begin(), addedVars.end());
+      std::for_each(addedVars.begin(), 
+                    addedVars.end(), 
+                    enqueAssignedEvent);
+
+      // note that the SEXP values within lastEnv_ are not protected. this
+      // is OK because we only reference the pointer values not the
+      // underlying R objects. if we want to be able to manipulate the SEXPs
+      // directly we'll need a static protection context so the objects are
+      // guaranteed to survive until the next call
    }
    
 private:
    
-   void listEnvironment(std::vector<r::sexp::Variable>* pEnvironment)
+   void resetLastEnv()
    {
-      // get the variables currently in the global environment (note this list
-      // is guaranteed to be sorted based on the behavior of R_lsInternal)
-      r::sexp::Protect rProtect;
-      r::sexp::listEnvironment(R_GlobalEnv, false, &rProtect, pEnvironment);   
-   }
-   
-   // helper to deterine whether two variables have the same name
-   bool compareVarName(const Variable& var1, const Variable& var2)
-   {
-      return var1.first < var2.first ;
+      lastEnv_.clear();
+      lastEnv_.insert(currentEnv_.begin(), currentEnv_.end());
    }
    
 private:
-   std::vector<r::sexp::Variable> lastEnv_; 
+   typedef r::sexp::Binding Binding;
+   typedef boost::unordered_map<SEXP,SEXP> Bindings;
+   std::vector<Binding> currentEnv_;
+   Bindings lastEnv_; 
    bool initialized_ ;
 };
 